@@ -34,8 +34,69 @@
 
 /* Private types and definitions ------------------------------------------------------- */
 
-static const char* response_1x_prefix = "{";
-static const char* response_20_prefix = "{\"jsonrpc\": \"2.0\", ";
+// stats and traces are updated by one thread only, but can be read by others (without torn reads),
+// response cache, registry, limits and scheduler queues can be shared between threads
+#if defined(__GNUC__)
+#define RELAXED_LOAD(ptr)           __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define RELAXED_ADD(ptr, value)     __atomic_store_n((ptr), __atomic_load_n((ptr), __ATOMIC_RELAXED) + (value), __ATOMIC_RELAXED)
+#define ACQUIRE_LOAD(ptr)           __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define RELEASE_STORE(ptr, value)   __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define RELAXED_STORE(ptr, value)   __atomic_store_n((ptr), (value), __ATOMIC_RELAXED)
+#define ACQUIRE_FENCE()             __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define RELEASE_FENCE()             __atomic_thread_fence(__ATOMIC_RELEASE)
+#define TRY_LOCK(ptr)               (__atomic_exchange_n((ptr), 1, __ATOMIC_ACQUIRE) == 0)
+#define SEQ_CST_LOAD(ptr)           __atomic_load_n((ptr), __ATOMIC_SEQ_CST)
+#define SEQ_CST_STORE(ptr, value)   __atomic_store_n((ptr), (value), __ATOMIC_SEQ_CST)
+#define SEQ_CST_FETCH_ADD(ptr, v)   __atomic_fetch_add((ptr), (v), __ATOMIC_SEQ_CST)
+#define SEQ_CST_EXCHANGE(ptr, v)    __atomic_exchange_n((ptr), (v), __ATOMIC_SEQ_CST)
+#define COMPARE_EXCHANGE(ptr, expected_ptr, v) \
+        __atomic_compare_exchange_n((ptr), (expected_ptr), (v), 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)
+#if defined(__i386__) || defined(__x86_64__)
+#define CPU_RELAX()                 __builtin_ia32_pause()
+#else
+#define CPU_RELAX()                 __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#endif
+#elif defined(JSON_RPC_TINY_SINGLE_THREADED)
+// (plain loads and stores: nothing can be shared between threads)
+#define RELAXED_LOAD(ptr)           (*(ptr))
+#define RELAXED_ADD(ptr, value)     (*(ptr) += (value))
+#define ACQUIRE_LOAD(ptr)           (*(ptr))
+#define RELEASE_STORE(ptr, value)   (*(ptr) = (value))
+#define RELAXED_STORE(ptr, value)   (*(ptr) = (value))
+#define ACQUIRE_FENCE()
+#define RELEASE_FENCE()
+#define TRY_LOCK(ptr)               (*(ptr) ? 0 : (*(ptr) = 1))
+#define SEQ_CST_LOAD(ptr)           (*(ptr))
+#define SEQ_CST_STORE(ptr, value)   (*(ptr) = (value))
+#define SEQ_CST_FETCH_ADD(ptr, v)   ((*(ptr) += (v)) - (v))
+#define SEQ_CST_EXCHANGE(ptr, v)    exchange_ptr((ptr), (v))
+#define COMPARE_EXCHANGE(ptr, expected_ptr, v)  (*(ptr) == *(expected_ptr) ? (*(ptr) = (v), 1) : (*(expected_ptr) = *(ptr), 0))
+#define CPU_RELAX()
+#else
+#error "atomic builtins (GCC / Clang) are required, or define JSON_RPC_TINY_SINGLE_THREADED if instances, caches, registries, limits and queues are used by one thread only"
+#endif
+
+// trace hooks are compiled-in only if requested
+#ifdef JSON_RPC_TINY_TRACE
+#define TRACE_EVENT(self, event, fcn_id)  do { if((self)->trace) { trace_event((self), (event), (fcn_id)); } } while(0)
+#else
+#define TRACE_EVENT(self, event, fcn_id)  do { } while(0)
+#endif
+
+#define RESPONSE_1X_PREFIX  "{"
+#define RESPONSE_20_PREFIX  "{\"jsonrpc\": \"2.0\", "
+
+// appends a string literal (its length is known at compile time)
+#define APPEND_LITERAL(to, literal)  append_bytes((to), (literal), sizeof(literal) - 1)
+
+// standard errors (in order of json_rpc_20_errors): ERROR(code, message)
+#define STANDARD_ERRORS(ERROR) \
+    ERROR("-32700", "Parse error")      /* An error occurred on the server while parsing the JSON text */ \
+    ERROR("-32600", "Invalid Request")  /* The JSON sent is not a valid Request object */ \
+    ERROR("-32601", "Method not found") /* The method does not exist / is not available */ \
+    ERROR("-32602", "Invalid params")   /* Invalid method parameter(s) */ \
+    ERROR("-32603", "Internal error")   /* Internal JSON-RPC error */ \
+    ERROR("-32000", "Server busy")      /* (server error) Method's limit was reached */
 
 typedef struct json_rpc_error_code
 {
@@ -46,23 +107,47 @@ typedef struct json_rpc_error_code
 
 extern json_rpc_error_code_t json_rpc_err_codes[];
 
+#define ERROR_CODE(code, msg)  {code, msg},
 json_rpc_error_code_t json_rpc_err_codes[] =
 {
-    {"-32700", "Parse error"     },   /* An error occurred on the server while parsing the JSON text */
-    {"-32600", "Invalid Request" },   /* The JSON sent is not a valid Request object */
-    {"-32601", "Method not found"},   /* The method does not exist / is not available */
-    {"-32602", "Invalid params"  },   /* Invalid method parameter(s) */
-    {"-32603", "Internal error"  }    /* Internal JSON-RPC error */
+    STANDARD_ERRORS(ERROR_CODE)
+};
+
+// precomputed parts of responses (so that each is copied at once, knowing its length)
+typedef struct response_template
+{
+    const char* text;
+    int len;
+} response_template_t;
+
+#define TEMPLATE(literal)  {(literal), sizeof(literal) - 1}
+#define ERROR_TEMPLATE_1X(code, msg)  TEMPLATE(RESPONSE_1X_PREFIX "\"error\": {\"code\": " code ", \"message\": \"" msg "\"}"),
+#define ERROR_TEMPLATE_20(code, msg)  TEMPLATE(RESPONSE_20_PREFIX "\"error\": {\"code\": " code ", \"message\": \"" msg "\"}"),
+
+static const response_template_t error_templates[2][json_rpc_num_of_errors] = // [is JSON RPC 2.0][error]
+{
+    { STANDARD_ERRORS(ERROR_TEMPLATE_1X) },
+    { STANDARD_ERRORS(ERROR_TEMPLATE_20) }
+};
+static const response_template_t custom_error_prefixes[2] =
+{
+    TEMPLATE(RESPONSE_1X_PREFIX "\"error\": "),
+    TEMPLATE(RESPONSE_20_PREFIX "\"error\": ")
+};
+static const response_template_t result_prefixes[2] =
+{
+    TEMPLATE(RESPONSE_1X_PREFIX "\"result\": "),
+    TEMPLATE(RESPONSE_20_PREFIX "\"result\": ")
 };
 
 static json_rpc_handler_t obj_names[] =
 {
-    {0, "jsonrpc"},
-    {0, "method"},
-    {0, "params"},
-    {0, "id"},
-    {0, "result"},
-    {0, "error"},
+    {0, "jsonrpc", 0, 0, 0, 0},
+    {0, "method", 0, 0, 0, 0},
+    {0, "params", 0, 0, 0, 0},
+    {0, "id", 0, 0, 0, 0},
+    {0, "result", 0, 0, 0, 0},
+    {0, "error", 0, 0, 0, 0},
 
 };
 
@@ -76,6 +161,13 @@ enum obj_name_ids
     the_error
 };
 
+enum validation_states
+{
+    expect_value = 0,
+    expect_key,
+    after_value
+};
+
 enum request_info_flags
 {
     rpc_request_is_notification = 1,
@@ -84,20 +176,234 @@ enum request_info_flags
 
 static const int num_of_obj_names = sizeof(obj_names)/sizeof(obj_names[0]);
 
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* output of json_to_msgpack() (it can be in the same buffer as the input) */
+typedef struct msgpack_writer
+{
+    const char* input;
+    char* out;
+    char* out_end;
+    int in_place;
+} msgpack_writer_t;
+
+enum msgpack_header_types
+{
+    msgpack_str = 0,
+    msgpack_array,
+    msgpack_map
+};
+
+/* first bytes of MessagePack headers: fix, 8-bit, 16-bit and 32-bit length */
+static const unsigned char msgpack_headers[3][4] =
+{
+    {0xa0, 0xd9, 0xda, 0xdb}, // str
+    {0x90, 0x00, 0xdc, 0xdd}, // array (there is no 8-bit length)
+    {0x80, 0x00, 0xde, 0xdf}  // map
+};
+
+static const char* json_literals[] = {"true", "false", "null", "none"};
+static const unsigned char msgpack_literals[] = {0xc3, 0xc2, 0xc0, 0xc0};
+
+/* powers of 10 that are exact as doubles */
+static const double exact_powers_of_10[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* big integer (little-endian 32-bit limbs), used to round decimal numbers to doubles correctly */
+#define BIG_NUM_MAX_LIMBS   48  /* (enough for 10^310, or 2^1076 * 5^363) */
+typedef struct big_num
+{
+    uint32_t limbs[BIG_NUM_MAX_LIMBS];
+    int len;
+} big_num_t;
+
+/* 'do-it-yourself' floating point (significand and binary exponent), used for double formatting */
+typedef struct diy_fp
+{
+    uint64_t f;
+    int e;
+} diy_fp_t;
+
+/* normalised significands and binary exponents of 10^-348, 10^-340, .., 10^340 */
+static const uint64_t cached_powers_f[] =
+{
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const int16_t cached_powers_e[] =
+{
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007,  -980,
+     -954,  -927,  -901,  -874,  -847,  -821,  -794,  -768,  -741,  -715,
+     -688,  -661,  -635,  -608,  -582,  -555,  -529,  -502,  -475,  -449,
+     -422,  -396,  -369,  -343,  -316,  -289,  -263,  -236,  -210,  -183,
+     -157,  -130,  -103,   -77,   -50,   -24,     3,    30,    56,    83,
+      109,   136,   162,   189,   216,   242,   269,   295,   322,   348,
+      375,   402,   428,   455,   481,   508,   534,   561,   588,   614,
+      641,   667,   694,   720,   747,   774,   800,   827,   853,   880,
+      907,   933,   960,   986,  1013,  1039,  1066
+};
+
+static const uint64_t pow10_table[] =
+{
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL
+};
+
 
 /* Private function declarations ------------------------------------------------------- */
 static int str_len(const char* str);
 static char* append_str(char* to, const char* from, int len = -1);
+static inline char* append_bytes(char* to, const char* from, int len);
 static int str_are_equal(const char* first, const char* second_zero_ended);
 static int str_are_equal(const char* first, int first_len, const char* second_zero_ended);
 static int int_val(char symbol, int* result);
 static int convert_to_int(const char* start, int length, int* result);
-static int json_find_member_value(int start_from, const char* input, struct json_token_info* info);
+static int convert_to_int64(const char* start, int length, int64_t* result);
+static int json_find_member_value(int start_from, const char* input, int input_len, struct json_token_info* info);
 static void reset_token_info(json_token_info_t* info);
 static int get_obj_id(const char* input, json_token_info_t* info);
 static int get_fcn_id(json_rpc_instance_t* self, const char* input, json_token_info_t* info);
 static int name_to_id(const char* name, json_rpc_instance* table);
-static int skip_all_of(const char* input, int start_at, const char* values, char reversed);
+static int skip_all_of(const char* input, int start_at, int input_len, const char* values, char reversed);
+static char* format_uint(char* to, uint64_t value);
+static uint64_t load_8_chars(const char* from);
+static int need_escaping(uint64_t chars);
+static diy_fp_t diy_fp_multiply(diy_fp_t x, diy_fp_t y);
+static diy_fp_t diy_fp_normalize(diy_fp_t x);
+static void grisu_round(char* digits, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w);
+static int grisu_digit_gen(diy_fp_t w, diy_fp_t mp, uint64_t delta, char* digits, int* k);
+static int grisu2(double value, char* digits, int* k);
+static int writer_begin_value(json_writer_t* writer, int max_len);
+static int find_member(const char* member_name, const char* input, int input_len, json_token_info_t* token_info,
+                       int* steps_left);
+static int find_member(int member_no_zero_based, const char* input, int input_len, json_token_info_t* token_info,
+                       int* steps_left);
+static int take_step(int* steps_left);
+static const char* find_param(const char* param_name, int member_no_zero_based, rpc_request_info_t* info,
+                              json_token_info_t* token);
+static const char* find_param_path(const json_path_t* path, rpc_request_info_t* info, json_token_info_t* token);
+static int find_path(const json_path_t* path, const char* input, int input_len, json_token_info_t* token,
+                     int* steps_left);
+static int skip_json_value(const char* input, int pos, int input_len);
+static void value_to_token(const char* input, int start, int end, json_token_info_t* token);
+static int extract_paths(const json_path_set_t* set, json_str_view_t* slots, const char* input, int input_len,
+                         int* steps_left);
+static int walk_paths(const json_path_set_t* set, int node_no, json_str_view_t* slots, const char* input, int pos,
+                      int input_len, int* found, int* steps_left);
+static int hex_to_uint(const char* from, int len, int num_of_digits, uint32_t* result);
+static char* encode_utf8(char* to, uint32_t code_point);
+static int skip_whitespace(const char* input, int start_at, int input_len);
+static int validate_string(const char* input, int start_at, int input_len);
+static int validate_utf8_char(const char* input, int start_at, int input_len);
+static int validate_number(const char* input, int start_at, int input_len);
+static int validate_literal(const char* input, int start_at, int input_len);
+static int highest_bit(uint64_t value);
+static json_rpc_instance_t* registry_enter(json_rpc_registry_t* registry, json_rpc_registry_reader_t* reader);
+static void registry_lock(json_rpc_registry_t* registry);
+static json_rpc_instance_t* registry_publish(json_rpc_registry_t* registry, json_rpc_instance_t* handlers,
+                                             const json_rpc_registry_reader_t* not_waited_for);
+static int registry_has_readers_before(json_rpc_registry_t* registry, uint32_t epoch,
+                                       const json_rpc_registry_reader_t* not_waited_for);
+static char* handle_json_request(json_rpc_instance_t* self, json_rpc_data_t* request_data, int quote_str_ids);
+static char* handle_msgpack_request(json_rpc_instance_t* self, json_rpc_data_t* request_data);
+static void move_bytes(char* to, const char* from, int len);
+static int msgpack_to_json(const unsigned char* input, int pos, int input_len, char** to, char* to_end, int depth);
+static int skip_msgpack(const unsigned char* input, int pos, int input_len, int depth);
+static int json_to_msgpack_value(msgpack_writer_t* writer, int pos, int input_len, int depth);
+static int json_number_to_msgpack(msgpack_writer_t* writer, int pos, int input_len);
+static uint64_t decimal_to_double_bits(uint64_t mantissa, int exponent);
+static int compare_decimal(uint64_t mantissa, int exponent, uint64_t value, int twos);
+static void big_num_mul(big_num_t* num, uint32_t factor);
+static void big_num_mul_pow5(big_num_t* num, int exponent);
+static void big_num_shift_left(big_num_t* num, int bits);
+static int count_json_members(const char* input, int pos, int input_len);
+static int skip_json_string(const char* input, int pos, int input_len);
+static char* msgpack_reserve(msgpack_writer_t* writer, int input_pos, int len);
+static int msgpack_header_len(int type, uint32_t len);
+static char* msgpack_put_header(char* to, int type, int header_len, uint32_t len);
+static int msgpack_put_int(msgpack_writer_t* writer, int input_pos, int negative, uint64_t magnitude);
+static char* store_be(char* to, uint64_t value, int num_of_bytes);
+static uint64_t load_be(const unsigned char* from, int num_of_bytes);
+static int limit_admit(json_rpc_limit_t* limit);
+static int handler_priority(const json_rpc_handler_t* handler);
+static int next_batch_pass(int* pass, int num_of_passes, int* next_r_pos, int batch_start);
+static int request_priority(json_rpc_instance_t* self, json_rpc_data_t* request_data);
+static int member_priority(json_rpc_instance_t* self, const char* input, const json_token_info_t* request_token);
+static int queue_push(json_rpc_queue_t* queue, json_rpc_data_t* request);
+static json_rpc_data_t* queue_pop(json_rpc_queue_t* queue);
+static void capture_request(json_rpc_capture_t* capture, const char* request, int request_len);
+static void capture_lock(json_rpc_capture_t* capture);
+static void capture_flush_full(json_rpc_capture_t* capture, char* full, int full_len);
+#if !defined(__GNUC__)
+static json_rpc_instance_t* exchange_ptr(json_rpc_instance_t** ptr, json_rpc_instance_t* value);
+#endif
+static int extract_params(const json_rpc_handler_t* handler, rpc_request_info_t* info, json_rpc_param_t* params);
+static int set_param(json_rpc_param_t* param, const json_rpc_param_spec_t* spec, const char* input,
+                     const json_token_info_t* token);
+static int bytes_are_equal(const char* first, const char* second, int len);
+static uint64_t hash_of(const char* data, int len);
+static int create_cache_key(const char* fcn_name, rpc_request_info_t* info, char* key, int max_key_len);
+static int cache_lookup_or_claim(json_rpc_cache_t* cache, const char* key, int key_len, uint64_t hash,
+                                 rpc_request_info_t* info, json_rpc_cache_entry_t** claimed_entry,
+                                 uint32_t* claimed_seq);
+static int cache_lookup(json_rpc_cache_t* cache, const char* key, int key_len, uint64_t hash, rpc_request_info_t* info,
+                        uint32_t* stale_seq);
+static json_rpc_cache_entry_t* cache_claim(json_rpc_cache_t* cache, const char* key, int key_len, uint64_t hash,
+                                           uint32_t stale_seq, int* already_cached, uint32_t* claimed_seq);
+static int cache_is_stale(json_rpc_cache_t* cache, json_rpc_cache_entry_t* entry, uint32_t stale_seq);
+static void cache_complete(json_rpc_cache_t* cache, json_rpc_cache_entry_t* entry, uint32_t claimed_seq,
+                           int key_len, uint64_t hash, const char* result, int result_len);
+static void cache_lock(json_rpc_cache_t* cache);
+#ifdef JSON_RPC_TINY_TRACE
+static void trace_event(json_rpc_instance_t* self, int event, int fcn_id);
+#endif
+static void update_stats(json_rpc_instance_t* self, int fcn_id, rpc_request_info_t* info,
+                         uint64_t parse_started, uint64_t handler_started);
+static void writer_open(json_writer_t* writer, char bracket);
+static void writer_close(json_writer_t* writer, char bracket);
 
 /* Exported functions ------------------------------------------------------- */
 void json_rpc_init(json_rpc_instance_t* self, json_rpc_handler_t* table_for_handlers, int max_num_of_handlers)
@@ -106,28 +412,478 @@ void json_rpc_init(json_rpc_instance_t* self, json_rpc_handler_t* table_for_hand
     self->handlers = table_for_handlers;
     self->num_of_handlers = 0;
     self->max_num_of_handlers = max_num_of_handlers;
+    self->options = 0;
+    self->stats = 0;
+    self->num_of_stats = 0;
+    self->clock = 0;
+    self->trace = 0;
+    self->cache = 0;
+    self->registry = 0;
+    self->capture = 0;
+    self->budget = 0;
+    self->registry_reader.active = 0;
+    self->registry_reader.next = 0;
 
     for (i = 0; i < self->max_num_of_handlers; i++)
     {
         self->handlers[i].fcn_name = 0;
         self->handlers[i].handler = 0;
+        self->handlers[i].flags = 0;
+        self->handlers[i].params_schema = 0;
+        self->handlers[i].num_of_params = 0;
+        self->handlers[i].limit = 0;
     }
 }
 
 void json_rpc_register_handler(json_rpc_instance_t* self, const char* fcn_name, json_rpc_handler_fcn handler)
+{
+    json_rpc_register_handler(self, fcn_name, handler, 0);
+}
+
+void json_rpc_register_handler(json_rpc_instance_t* self, const char* fcn_name, json_rpc_handler_fcn handler,
+                               unsigned int flags)
+{
+    json_rpc_register_handler(self, fcn_name, handler, flags, 0, 0);
+}
+
+void json_rpc_register_handler(json_rpc_instance_t* self, const char* fcn_name, json_rpc_handler_fcn handler,
+                               unsigned int flags, const json_rpc_param_spec_t* params_schema, int num_of_params)
 {
     if (self->num_of_handlers < self->max_num_of_handlers)
     {
-        if (fcn_name && handler)
+        if (fcn_name && handler && num_of_params <= JSON_RPC_MAX_SCHEMA_PARAMS)
         {
             self->handlers[self->num_of_handlers].fcn_name = fcn_name;
             self->handlers[self->num_of_handlers].handler = handler;
+            self->handlers[self->num_of_handlers].flags = flags;
+            self->handlers[self->num_of_handlers].params_schema = params_schema;
+            self->handlers[self->num_of_handlers].num_of_params = params_schema ? num_of_params : 0;
+            self->handlers[self->num_of_handlers].limit = 0;
             self->num_of_handlers++;
         }
     }
 }
 
+void json_rpc_cache_init(json_rpc_cache_t* cache, json_rpc_cache_entry_t* storage_for_entries, int max_num_of_entries)
+{
+    cache->entries = storage_for_entries;
+    cache->num_of_sets = max_num_of_entries > 0 ? max_num_of_entries / 4 : 0;
+    cache->writer_lock = 0;
+    cache->clock = 0;
+    cache->pending_timeout = 0;
+    json_rpc_cache_clear(cache);
+}
+
+void json_rpc_cache_set_timeout(json_rpc_cache_t* cache, json_rpc_clock_fcn clock, uint64_t pending_timeout)
+{
+    cache->clock = clock;
+    cache->pending_timeout = pending_timeout;
+}
+
+void json_rpc_cache_clear(json_rpc_cache_t* cache)
+{
+    uint32_t i;
+    for(i = 0; i < cache->num_of_sets * 4; i++)
+    {
+        cache->entries[i].seq = 0;
+        cache->entries[i].referenced = 0;
+        cache->entries[i].hash = 0;
+        cache->entries[i].claimed_at = 0;
+        cache->entries[i].key_len = 0;
+        cache->entries[i].result_len = 0;
+    }
+}
+
+void json_rpc_enable_cache(json_rpc_instance_t* self, json_rpc_cache_t* cache)
+{
+    self->cache = (cache && cache->num_of_sets) ? cache : 0;
+}
+
+void json_rpc_registry_init(json_rpc_registry_t* registry, json_rpc_instance_t* handlers)
+{
+    registry->current = handlers;
+    registry->epoch = 0;
+    registry->lock = 0;
+    registry->readers = 0;
+}
+
+void json_rpc_enable_registry(json_rpc_instance_t* self, json_rpc_registry_t* registry)
+{
+    json_rpc_registry_reader_t** reader;
+
+    if(self->registry)
+    {
+        registry_lock(self->registry);
+        for(reader = &self->registry->readers; *reader; reader = &(*reader)->next)
+        {
+            if(*reader == &self->registry_reader)
+            {
+                *reader = self->registry_reader.next;
+                break;
+            }
+        }
+        RELEASE_STORE(&self->registry->lock, 0);
+    }
+
+    self->registry = registry;
+    self->registry_reader.active = 0;
+    self->registry_reader.next = 0;
+    if(registry)
+    {
+        registry_lock(registry);
+        self->registry_reader.next = registry->readers;
+        registry->readers = &self->registry_reader;
+        RELEASE_STORE(&registry->lock, 0);
+    }
+}
+
+json_rpc_instance_t* json_rpc_registry_publish(json_rpc_registry_t* registry, json_rpc_instance_t* handlers)
+{
+    return registry_publish(registry, handlers, 0);
+}
+
+json_rpc_instance_t* json_rpc_registry_publish_in_handler(json_rpc_instance_t* self, json_rpc_instance_t* handlers)
+{
+    // (request of the handler calling it completes with previous handlers: it is not waited for)
+    return registry_publish(self->registry, handlers, &self->registry_reader);
+}
+
+void json_rpc_limit_init(json_rpc_limit_t* limit, uint32_t max_in_flight, uint32_t calls_per_second, uint32_t burst,
+                         json_rpc_clock_fcn clock, uint64_t ticks_per_second)
+{
+    limit->max_in_flight = max_in_flight;
+    limit->in_flight = 0;
+    limit->interval = calls_per_second ? ticks_per_second / calls_per_second : 0;
+    limit->burst_tolerance = burst > 1 ? limit->interval * (burst - 1) : 0;
+    limit->next_call_time = 0;
+    limit->clock = clock;
+}
+
+int json_rpc_set_limit(json_rpc_instance_t* self, const char* fcn_name, json_rpc_limit_t* limit)
+{
+    int fcn_id = name_to_id(fcn_name, self);
+    if(fcn_id < 0)
+    {
+        return 0;
+    }
+    self->handlers[fcn_id].limit = limit;
+    return 1;
+}
+
+int json_rpc_scheduler_init(json_rpc_scheduler_t* scheduler, json_rpc_queue_slot_t* storage_for_slots,
+                            int slots_per_priority, int max_bypass)
+{
+    int i;
+    int j;
+    if(slots_per_priority <= 0 || (slots_per_priority & (slots_per_priority - 1)))
+    {
+        return 0; // (slots are indexed with a mask)
+    }
+    for(i = 0; i < json_rpc_num_of_priorities; i++)
+    {
+        scheduler->queues[i].slots = storage_for_slots + i * slots_per_priority;
+        scheduler->queues[i].mask = slots_per_priority - 1;
+        scheduler->queues[i].head = 0;
+        scheduler->queues[i].tail = 0;
+        for(j = 0; j < slots_per_priority; j++)
+        {
+            scheduler->queues[i].slots[j].seq = j;
+            scheduler->queues[i].slots[j].request = 0;
+        }
+        scheduler->bypassed[i] = 0;
+    }
+    scheduler->max_bypass = max_bypass;
+    return 1;
+}
+
+int json_rpc_schedule(json_rpc_scheduler_t* scheduler, json_rpc_instance_t* self, json_rpc_data_t* request_data)
+{
+    return queue_push(&scheduler->queues[request_priority(self, request_data)], request_data);
+}
+
+json_rpc_data_t* json_rpc_scheduler_next(json_rpc_scheduler_t* scheduler)
+{
+    json_rpc_data_t* request;
+    int i;
+    int j;
+
+    // requests of lower priorities that were passed over too many times go first..
+    for(i = json_rpc_num_of_priorities - 1; i > 0; i--)
+    {
+        if(RELAXED_LOAD(&scheduler->bypassed[i]) >= scheduler->max_bypass &&
+           (request = queue_pop(&scheduler->queues[i])))
+        {
+            RELAXED_STORE(&scheduler->bypassed[i], 0);
+            return request;
+        }
+    }
+
+    // ..otherwise the highest priority goes first
+    for(i = 0; i < json_rpc_num_of_priorities; i++)
+    {
+        request = queue_pop(&scheduler->queues[i]);
+        if(request)
+        {
+            for(j = i + 1; j < json_rpc_num_of_priorities; j++)
+            {
+                if(RELAXED_LOAD(&scheduler->queues[j].head) != RELAXED_LOAD(&scheduler->queues[j].tail))
+                {
+                    RELAXED_ADD(&scheduler->bypassed[j], 1); // (not exact if there are many consumers)
+                }
+            }
+            RELAXED_STORE(&scheduler->bypassed[i], 0);
+            return request;
+        }
+    }
+    return 0;
+}
+
+void json_rpc_capture_init(json_rpc_capture_t* capture, char* buffer, int buffer_len, json_rpc_clock_fcn clock,
+                           uint64_t ticks_per_second, json_rpc_capture_flush_fcn flush, void* flush_arg)
+{
+    int i;
+    capture->buffer = buffer;
+    capture->spare = flush ? buffer + buffer_len / 2 : 0;
+    capture->buffer_len = flush ? buffer_len / 2 : buffer_len;
+    capture->used = 0;
+    capture->clock = clock;
+    capture->flush = flush;
+    capture->flush_arg = flush_arg;
+    capture->dropped = 0;
+    capture->lock = 0;
+    if(capture->buffer_len >= JSON_RPC_CAPTURE_HEADER_LEN)
+    {
+        for(i = 0; i < 8; i++)
+        {
+            buffer[i] = JSON_RPC_CAPTURE_MAGIC[i];
+        }
+        store_be(buffer + 8, ticks_per_second, 8);
+        capture->used = JSON_RPC_CAPTURE_HEADER_LEN;
+    }
+    else
+    {
+        capture->buffer_len = 0; // (everything will be dropped)
+    }
+}
+
+void json_rpc_enable_capture(json_rpc_instance_t* self, json_rpc_capture_t* capture)
+{
+    self->capture = capture;
+}
+
+void json_rpc_capture_flush(json_rpc_capture_t* capture)
+{
+    char* full = 0;
+    int full_len = 0;
+
+    capture_lock(capture);
+    while(capture->flush && !capture->spare)
+    {
+        RELEASE_STORE(&capture->lock, 0); // (wait until the other half is flushed)
+        CPU_RELAX();
+        capture_lock(capture);
+    }
+    if(capture->flush && capture->used)
+    {
+        full = capture->buffer;
+        full_len = capture->used;
+        capture->buffer = capture->spare;
+        capture->spare = 0;
+        capture->used = 0;
+    }
+    RELEASE_STORE(&capture->lock, 0);
+    if(full)
+    {
+        capture_flush_full(capture, full, full_len);
+    }
+}
+
+int64_t json_rpc_capture_open(const char* log, int64_t log_len, uint64_t* ticks_per_second)
+{
+    int i;
+    if(log_len < JSON_RPC_CAPTURE_HEADER_LEN)
+    {
+        return -1;
+    }
+    for(i = 0; i < 8; i++)
+    {
+        if(log[i] != JSON_RPC_CAPTURE_MAGIC[i])
+        {
+            return -1;
+        }
+    }
+    *ticks_per_second = load_be((const unsigned char*)log + 8, 8);
+    return JSON_RPC_CAPTURE_HEADER_LEN;
+}
+
+int64_t json_rpc_capture_next(const char* log, int64_t log_len, int64_t pos,
+                              uint64_t* timestamp, const char** request, int* request_len)
+{
+    uint64_t len;
+    if(pos < 0 || log_len - pos < JSON_RPC_CAPTURE_RECORD_HEADER_LEN)
+    {
+        return -1;
+    }
+    len = load_be((const unsigned char*)log + pos + 8, 4);
+    if((uint64_t)(log_len - pos - JSON_RPC_CAPTURE_RECORD_HEADER_LEN) < len)
+    {
+        return -1; // (truncated record)
+    }
+    *timestamp = load_be((const unsigned char*)log + pos, 8);
+    *request = log + pos + JSON_RPC_CAPTURE_RECORD_HEADER_LEN;
+    *request_len = (int)len;
+    return pos + JSON_RPC_CAPTURE_RECORD_HEADER_LEN + (int64_t)len;
+}
+
+void json_rpc_set_options(json_rpc_instance_t* self, unsigned int options)
+{
+    self->options = options;
+}
+
+void json_rpc_set_parse_budget(json_rpc_instance_t* self, const json_parse_budget_t* budget)
+{
+    self->budget = budget;
+}
+
+void json_rpc_enable_stats(json_rpc_instance_t* self, json_rpc_method_stats_t* table_for_stats, int num_of_stats,
+                           json_rpc_clock_fcn clock)
+{
+    char* p = (char*)table_for_stats;
+    char* end = (char*)(table_for_stats + num_of_stats);
+    while(p < end)
+    {
+        *p++ = 0;
+    }
+    self->clock = clock;
+    self->num_of_stats = num_of_stats;
+    self->stats = num_of_stats > 0 ? table_for_stats : 0;
+}
+
+void json_rpc_enable_trace(json_rpc_instance_t* self, json_rpc_trace_t* trace,
+                           json_rpc_trace_event_t* storage_for_events, int max_num_of_events)
+{
+    uint32_t num_of_events = 1;
+    self->trace = 0;
+    if(trace && storage_for_events && max_num_of_events > 0)
+    {
+        while(num_of_events * 2 <= (uint32_t)max_num_of_events)
+        {
+            num_of_events *= 2;
+        }
+        trace->events = storage_for_events;
+        trace->mask = num_of_events - 1;
+        trace->request_no = 0;
+        trace->head = 0;
+        self->trace = trace;
+    }
+}
+
+void json_rpc_trace_export(json_rpc_instance_t* self, json_writer_t* writer, double ticks_per_us, int thread_id)
+{
+    static const char* phases[] = {"B", "E", "i", "B", "E", "i"};
+    json_rpc_trace_t* trace = self->trace;
+    json_rpc_instance_t* handlers = self; // (instance with handlers used for names)
+    json_rpc_trace_event_t event;
+    uint64_t num_of_events;
+    uint64_t head;
+    uint64_t i;
+    const char* name;
+
+    if(!trace)
+    {
+        return;
+    }
+
+    if(self->registry)
+    {
+        // published handlers are used, and they can't be replaced (and released) while names are written
+        registry_lock(self->registry);
+        handlers = ACQUIRE_LOAD(&self->registry->current);
+    }
+
+    num_of_events = (uint64_t)trace->mask + 1;
+    head = ACQUIRE_LOAD(&trace->head);
+    for(i = (head > num_of_events) ? head - num_of_events : 0; i < head; i++)
+    {
+        event = trace->events[i & trace->mask];
+        ACQUIRE_FENCE(); // (event is read before head is loaded again)
+        if(i + num_of_events <= RELAXED_LOAD(&trace->head)) // overwritten while it was read: skip it
+        {
+            continue;
+        }
+
+        switch(event.event)
+        {
+        case json_rpc_trace_parse_start:
+        case json_rpc_trace_parse_end:
+            name = "parse";
+            break;
+
+        case json_rpc_trace_handler_start:
+        case json_rpc_trace_handler_end:
+            name = (event.fcn_id >= 0 && event.fcn_id < handlers->num_of_handlers) ?
+                    handlers->handlers[event.fcn_id].fcn_name : "handler";
+            break;
+
+        case json_rpc_trace_dispatch:
+            name = "dispatch";
+            break;
+
+        default:
+            name = "response";
+            break;
+        }
+
+        json_writer_begin_object(writer);
+        json_writer_key(writer, "name");
+        json_writer_value_str(writer, name, -1);
+        json_writer_key(writer, "ph");
+        json_writer_value_str(writer, event.event <= json_rpc_trace_response_written ? phases[event.event] : "i", 1);
+        json_writer_key(writer, "ts");
+        json_writer_value_double(writer, ticks_per_us > 0 ? (double)event.timestamp / ticks_per_us : (double)event.timestamp);
+        json_writer_key(writer, "pid");
+        json_writer_value_int(writer, 1);
+        json_writer_key(writer, "tid");
+        json_writer_value_int(writer, thread_id);
+        if(event.event == json_rpc_trace_dispatch || event.event == json_rpc_trace_response_written)
+        {
+            json_writer_key(writer, "s");
+            json_writer_value_str(writer, "t", 1);
+        }
+        json_writer_key(writer, "args");
+        json_writer_begin_object(writer);
+        json_writer_key(writer, "request");
+        json_writer_value_int(writer, event.request_no);
+        if(event.event == json_rpc_trace_dispatch)
+        {
+            json_writer_key(writer, "fcn_id");
+            json_writer_value_int(writer, event.fcn_id);
+        }
+        json_writer_end_object(writer);
+        json_writer_end_object(writer);
+    }
+
+    if(self->registry)
+    {
+        RELEASE_STORE(&self->registry->lock, 0);
+    }
+}
+
 char* json_rpc_handle_request(json_rpc_instance_t* self, json_rpc_data_t* request_data)
+{
+    if(self->capture)
+    {
+        capture_request(self->capture, request_data->request, request_data->request_len); // (as received)
+    }
+
+    if(json_is_msgpack(request_data->request, request_data->request_len))
+    {
+        return handle_msgpack_request(self, request_data);
+    }
+    return handle_json_request(self, request_data, 0);
+}
+
+static char* handle_json_request(json_rpc_instance_t* self, json_rpc_data_t* request_data, int quote_str_ids)
 {
     char* res = 0;
     rpc_request_info_t request_info;
@@ -142,13 +898,63 @@ char* json_rpc_handle_request(json_rpc_instance_t* self, json_rpc_data_t* reques
     int obj_id = -1;
     int fcn_id = -2;
 
+    int batch_start = 0;
+    int pass = 0;
+    int num_of_passes = 1;
+
+    uint64_t parse_started = 0;
+    uint64_t handler_started = 0;
+
+    char cache_key[JSON_RPC_CACHE_DATA_SIZE];
+    int cache_key_len = 0;
+    uint64_t cache_key_hash = 0;
+    json_rpc_cache_entry_t* cache_entry = 0;
+    uint32_t cache_entry_seq = 0;
+    json_rpc_param_t extracted_params[JSON_RPC_MAX_SCHEMA_PARAMS];
+
+    json_rpc_instance_t* handlers = self; // (instance with handlers used for this call)
+    json_rpc_limit_t* limit = 0;
+
     request_info.data = request_data;
     if(request_data->response && request_data->response_len)
     {
         *request_data->response = 0; // null
     }
 
-    next_r_pos = skip_all_of(request_data->request, 0, " \n\r\t", 0);
+    if((self->options & json_rpc_option_strict_parsing) &&
+       !json_validate(request_data->request, request_data->request_len))
+    {
+        // reject malformed requests before anything else is done
+        request_info.info_flags = rpc_request_is_rpc_20;
+        request_info.id_start = -1;
+        res = json_rpc_create_error(json_rpc_err_parse_error, &request_info);
+        if(self->stats)
+        {
+            update_stats(self, -1, &request_info, 0, 0);
+        }
+        return res;
+    }
+
+    if(self->budget &&
+       json_check_budget(request_data->request, request_data->request_len, self->budget) != json_budget_ok)
+    {
+        // (rejected in one pass, before it is parsed)
+        request_info.info_flags = rpc_request_is_rpc_20;
+        request_info.id_start = -1;
+        res = json_rpc_create_error(json_rpc_err_invalid_request, &request_info);
+        if(self->stats)
+        {
+            update_stats(self, -1, &request_info, 0, 0);
+        }
+        return res;
+    }
+
+    if(self->registry)
+    {
+        handlers = registry_enter(self->registry, &self->registry_reader);
+    }
+
+    next_r_pos = skip_all_of(request_data->request, 0, request_data->request_len, " \n\r\t", 0);
 
     reset_token_info(&next_req_token);
     next_req_token.values_start = next_r_pos;
@@ -157,24 +963,50 @@ char* json_rpc_handle_request(json_rpc_instance_t* self, json_rpc_data_t* reques
     // skip [] bracket for a batch..
     if(json_next_member_is_list(request_data->request, &next_req_token))
     {
-        next_r_pos = skip_all_of(request_data->request, next_r_pos+1, " \n\r\t", 0);
+        next_r_pos = skip_all_of(request_data->request, next_r_pos+1, request_data->request_len, " \n\r\t", 0);
         if(request_data->response && request_data->response_len)
         {
             append_str(request_data->response, "[");
         }
+        if(self->options & json_rpc_option_reorder_batch)
+        {
+            num_of_passes = json_rpc_num_of_priorities; // (a pass over the batch for each priority)
+            batch_start = next_r_pos;
+        }
     }
 
-    while(next_r_pos < request_data->request_len)
+    while(next_r_pos < request_data->request_len ||
+          next_batch_pass(&pass, num_of_passes, &next_r_pos, batch_start))
     {
         // reset some of the request info data
         request_info.id_start = -1;
         request_info.info_flags = 0;
+        request_info.error = -1;
+        request_info.result_start = -1;
+        request_info.result_len = 0;
+        request_info.params = 0;
+        request_info.steps_left = (self->budget && self->budget->max_steps) ? self->budget->max_steps : -1;
+        cache_key_len = 0;
+        cache_entry = 0;
+        limit = 0;
         fcn_id = -2;
         obj_id = -1;
 
-
         // extract next request (there can be a batch of them)
         next_r_pos = json_find_next_member(next_r_pos, request_data->request, request_data->request_len, &next_req_token);
+        if(num_of_passes > 1 && pass != member_priority(handlers, request_data->request, &next_req_token))
+        {
+            continue; // (will be handled in another pass: it is not traced nor timed in this one)
+        }
+
+        if(self->clock && self->stats)
+        {
+            parse_started = self->clock();
+        }
+        TRACE_EVENT(self, json_rpc_trace_parse_start, -1);
+
+        request_info.params_start = next_req_token.values_start; // (no params: empty span at the request)
+        request_info.params_len = 0;
         if(json_next_member_is_object(request_data->request, &next_req_token))
         {
             curr_pos = next_req_token.values_start+1; // move past this next object
@@ -185,7 +1017,7 @@ char* json_rpc_handle_request(json_rpc_instance_t* self, json_rpc_data_t* reques
         }
 
         // skip the whitespace
-        curr_pos = skip_all_of(request_data->request, curr_pos, " \n\r\t", 0);
+        curr_pos = skip_all_of(request_data->request, curr_pos, request_data->request_len, " \n\r\t", 0);
 
         next_req_max_pos = next_req_token.values_start+next_req_token.values_len;
         while(curr_pos < next_req_max_pos)
@@ -207,7 +1039,7 @@ char* json_rpc_handle_request(json_rpc_instance_t* self, json_rpc_data_t* reques
                         break;
 
                     case method:
-                        fcn_id = get_fcn_id(self, request_data->request, &next_mem_token);
+                        fcn_id = get_fcn_id(handlers, request_data->request, &next_mem_token);
                         if(fcn_id >= 0)
                         {
                             request_info.info_flags |= rpc_request_is_notification; // assume it is notification
@@ -226,6 +1058,11 @@ char* json_rpc_handle_request(json_rpc_instance_t* self, json_rpc_data_t* reques
                             request_info.info_flags &= ~rpc_request_is_notification;
                             request_info.id_start = next_mem_token.values_start;
                             request_info.id_len = next_mem_token.values_len;
+                            if(quote_str_ids && request_data->request[request_info.id_start - 1] == '\"')
+                            {
+                                request_info.id_start--; // (id is written with its quotes)
+                                request_info.id_len += 2;
+                            }
                         }
                         break;
                 }
@@ -236,6 +1073,13 @@ char* json_rpc_handle_request(json_rpc_instance_t* self, json_rpc_data_t* reques
             }
         }
 
+        TRACE_EVENT(self, json_rpc_trace_parse_end, -1);
+        if(self->clock && self->stats)
+        {
+            handler_started = self->clock();
+        }
+
+        TRACE_EVENT(self, json_rpc_trace_dispatch, fcn_id < 0 ? -1 : fcn_id);
         if(fcn_id < 0)
         {
             if(fcn_id == -1)
@@ -247,13 +1091,59 @@ char* json_rpc_handle_request(json_rpc_instance_t* self, json_rpc_data_t* reques
                 res = json_rpc_create_error(json_rpc_err_invalid_request, &request_info);
             }
         }
-        else if(request_info.params_start < 0)
+        else
         {
-            res = json_rpc_create_error(json_rpc_err_invalid_request, &request_info);
+            limit = handlers->handlers[fcn_id].limit;
+            if(self->cache && (handlers->handlers[fcn_id].flags & json_rpc_handler_cacheable))
+            {
+                cache_key_len = create_cache_key(handlers->handlers[fcn_id].fcn_name, &request_info,
+                                                 cache_key, sizeof(cache_key));
+                cache_key_hash = cache_key_len > 0 ? hash_of(cache_key, cache_key_len) : 0;
+            }
+
+            if(cache_key_len > 0 && cache_lookup_or_claim(self->cache, cache_key, cache_key_len, cache_key_hash,
+                                                          &request_info, &cache_entry, &cache_entry_seq))
+            {
+                res = request_data->response; // responded with the cached result
+            }
+            else
+            {
+                if(limit && !limit_admit(limit))
+                {
+                    res = json_rpc_create_error(json_rpc_err_server_busy, &request_info);
+                    limit = 0; // (not admitted)
+                }
+                else if(handlers->handlers[fcn_id].num_of_params &&
+                        !extract_params(&handlers->handlers[fcn_id], &request_info, extracted_params))
+                {
+                    res = json_rpc_create_error(json_rpc_err_invalid_params, &request_info);
+                }
+                else
+                {
+                    request_info.params = handlers->handlers[fcn_id].num_of_params ? extracted_params : 0;
+                    TRACE_EVENT(self, json_rpc_trace_handler_start, fcn_id);
+                    res = handlers->handlers[fcn_id].handler(&request_info); // everything OK, can call a handler
+                    TRACE_EVENT(self, json_rpc_trace_handler_end, fcn_id);
+                }
+
+                if(limit && limit->max_in_flight)
+                {
+                    SEQ_CST_FETCH_ADD(&limit->in_flight, -1);
+                }
+
+                if(cache_entry)
+                {
+                    int cacheable = request_info.error < 0 && request_info.result_start >= 0;
+                    cache_complete(self->cache, cache_entry, cache_entry_seq, cache_key_len, cache_key_hash,
+                                   cacheable ? request_data->response + request_info.result_start : 0,
+                                   request_info.result_len);
+                }
+            }
         }
-        else
+
+        if(self->stats)
         {
-            res = self->handlers[fcn_id].handler(&request_info); // everything OK, can call a handler
+            update_stats(self, fcn_id, &request_info, parse_started, handler_started);
         }
     }
 
@@ -262,88 +1152,235 @@ char* json_rpc_handle_request(json_rpc_instance_t* self, json_rpc_data_t* reques
     {
         append_str(request_data->response+str_len(request_data->response), "]");
     }
+    TRACE_EVENT(self, json_rpc_trace_response_written, -1);
 
+    if(self->registry)
+    {
+        RELEASE_STORE(&self->registry_reader.active, 0);
+    }
     return res;
 }
 
 
+int json_rpc_response_len(const json_rpc_data_t* request_data)
+{
+    if(!request_data->response || !request_data->response_len)
+    {
+        return 0;
+    }
+    if(json_is_msgpack(request_data->response, request_data->response_len))
+    {
+        return skip_msgpack((const unsigned char*)request_data->response, 0, request_data->response_len, 0);
+    }
+    return str_len(request_data->response);
+}
+
+void json_rpc_stats_merge(json_rpc_method_stats_t* into, const json_rpc_method_stats_t* from, int num_of_stats)
+{
+    int i;
+    int j;
+    for(i = 0; i < num_of_stats; i++)
+    {
+        into[i].calls += RELAXED_LOAD(&from[i].calls);
+        for(j = 0; j <= json_rpc_num_of_errors; j++)
+        {
+            into[i].errors[j] += RELAXED_LOAD(&from[i].errors[j]);
+        }
+        into[i].parse_time += RELAXED_LOAD(&from[i].parse_time);
+        into[i].handler_time += RELAXED_LOAD(&from[i].handler_time);
+        for(j = 0; j < JSON_RPC_LATENCY_BUCKETS; j++)
+        {
+            into[i].latency[j] += RELAXED_LOAD(&from[i].latency[j]);
+        }
+    }
+}
+
+void json_rpc_stats_snapshot(json_rpc_method_stats_t* into, const json_rpc_method_stats_t* from, int num_of_stats)
+{
+    char* p = (char*)into;
+    char* end = (char*)(into + num_of_stats);
+    while(p < end)
+    {
+        *p++ = 0;
+    }
+    json_rpc_stats_merge(into, from, num_of_stats);
+}
+
+uint64_t json_rpc_stats_percentile(const json_rpc_method_stats_t* stats, int per_mille)
+{
+    uint64_t total = 0;
+    uint64_t count = 0;
+    uint64_t wanted;
+    int i;
+    for(i = 0; i < JSON_RPC_LATENCY_BUCKETS; i++)
+    {
+        total += stats->latency[i];
+    }
+    if(!total)
+    {
+        return 0;
+    }
+
+    wanted = (total * per_mille + 999) / 1000;
+    for(i = 0; i < JSON_RPC_LATENCY_BUCKETS - 1; i++)
+    {
+        count += stats->latency[i];
+        if(count >= wanted)
+        {
+            break;
+        }
+    }
+    return json_rpc_latency_bucket_min(i);
+}
+
+int json_rpc_latency_bucket(uint64_t ticks)
+{
+    int bucket;
+    int msb;
+    if(ticks < 4)
+    {
+        return (int)ticks;
+    }
+    msb = highest_bit(ticks);
+    bucket = (msb - 1) * 4 + (int)((ticks >> (msb - 2)) & 3); // 4 sub-buckets per power of 2
+    return bucket < JSON_RPC_LATENCY_BUCKETS ? bucket : JSON_RPC_LATENCY_BUCKETS - 1;
+}
+
+uint64_t json_rpc_latency_bucket_min(int bucket)
+{
+    if(bucket < 4)
+    {
+        return (uint64_t)bucket;
+    }
+    return (uint64_t)(4 + bucket % 4) << (bucket / 4 - 1);
+}
+
 const char* rpc_extract_param_str(const char* param_name, int* str_length, rpc_request_info_t* info)
 {
-    return json_extract_member_str(param_name, // just find a member, but narrow-down the search to params
-                                   str_length,
-                                   info->data->request+info->params_start,
-                                   info->params_len);
+    json_token_info_t token_info;
+    const char* result = find_param(param_name, 0, info, &token_info); // just find a member, but within params
+    *str_length = token_info.values_len;
+    return result;
 }
 
 
 int rpc_extract_param_int(const char* param_name, int* result, rpc_request_info_t* info)
 {
-    return json_extract_member_int(param_name,
-                                   result,
-                                   info->data->request+info->params_start,
-                                   info->params_len);
+    json_token_info_t token_info;
+    const char* p = find_param(param_name, 0, info, &token_info);
+    return p && token_info.values_len && convert_to_int(p, token_info.values_len, result);
 }
 
 
 const char* rpc_extract_param_str(int member_no_zero_based, int* str_length, rpc_request_info_t* info)
 {
-    return json_extract_member_str(member_no_zero_based, str_length,
-                                   info->data->request + info->params_start,
-                                   info->params_len);
+    json_token_info_t token_info;
+    const char* result = find_param(0, member_no_zero_based, info, &token_info);
+    *str_length = token_info.values_len;
+    return result;
+}
+
+int rpc_extract_param_view(const char* param_name, json_str_view_t* view, rpc_request_info_t* info)
+{
+    json_token_info_t token_info;
+    int found = find_param(param_name, 0, info, &token_info) != 0;
+    view->start = info->data->request + info->params_start + token_info.values_start;
+    view->len = token_info.values_len;
+    view->has_escapes = token_info.values_flags & json_value_has_escapes;
+    return found;
+}
+
+int rpc_extract_param_view(int member_no_zero_based, json_str_view_t* view, rpc_request_info_t* info)
+{
+    json_token_info_t token_info;
+    int found = find_param(0, member_no_zero_based, info, &token_info) != 0;
+    view->start = info->data->request + info->params_start + token_info.values_start;
+    view->len = token_info.values_len;
+    view->has_escapes = token_info.values_flags & json_value_has_escapes;
+    return found;
 }
 
 int rpc_extract_param_int(int member_no_zero_based, int* result, rpc_request_info_t* info)
 {
-    return json_extract_member_int(member_no_zero_based,
-                                   result,
-                                   info->data->request+info->params_start,
-                                   info->params_len);
+    json_token_info_t token_info;
+    const char* p = find_param(0, member_no_zero_based, info, &token_info);
+    return p && token_info.values_len && convert_to_int(p, token_info.values_len, result);
 }
 
-char* json_rpc_create_result(const char* result_str, rpc_request_info_t* info)
+const char* rpc_extract_param_path(const char* path, int* str_length, rpc_request_info_t* info)
 {
-    char* buf;
-    if(!info->data->response_len || !info->data->response) // if no space nor response, return..
+    json_path_t compiled;
+    *str_length = 0;
+    return json_path_compile(&compiled, path) ? rpc_extract_param_path(&compiled, str_length, info) : 0;
+}
+
+const char* rpc_extract_param_path(const json_path_t* path, int* str_length, rpc_request_info_t* info)
+{
+    json_token_info_t token_info;
+    const char* result = find_param_path(path, info, &token_info);
+    *str_length = result ? token_info.values_len : 0;
+    return result;
+}
+
+int rpc_extract_param_path_int(const char* path, int* result, rpc_request_info_t* info)
+{
+    json_path_t compiled;
+    return json_path_compile(&compiled, path) && rpc_extract_param_path_int(&compiled, result, info);
+}
+
+int rpc_extract_param_path_int(const json_path_t* path, int* result, rpc_request_info_t* info)
+{
+    json_token_info_t token_info;
+    const char* p = find_param_path(path, info, &token_info);
+    return p && token_info.values_len && convert_to_int(p, token_info.values_len, result);
+}
+
+int rpc_extract_param_path_view(const json_path_t* path, json_str_view_t* view, rpc_request_info_t* info)
+{
+    json_token_info_t token_info;
+    const char* p = find_param_path(path, info, &token_info);
+    view->start = p ? p : info->data->request + info->params_start;
+    view->len = p ? token_info.values_len : 0;
+    view->has_escapes = p && (token_info.values_flags & json_value_has_escapes);
+    return p != 0;
+}
+
+int rpc_extract_param_paths(const json_path_set_t* set, json_str_view_t* slots, rpc_request_info_t* info)
+{
+    const char* params = info->data->request + info->params_start;
+    int params_len = info->params_len;
+    int pos = skip_whitespace(params, 0, params_len);
+    int by_position = 0;
+    int child;
+
+    for(child = set->num_of_nodes ? set->nodes[0].first_child : -1; child >= 0; child = set->nodes[child].next_sibling)
     {
-        return info->data->response;
+        by_position |= (set->nodes[child].index >= 0);
     }
-
-    buf = info->data->response + str_len(info->data->response);
-    if(buf - info->data->response > 2) // not the beginning of a batch response
+    if(!by_position && pos < params_len && params[pos] == '[') // (named params passed as [{...}])
     {
-        buf = append_str(buf, ", ", 2);
+        pos = skip_whitespace(params, pos + 1, params_len);
+        params += pos;
+        params_len -= pos;
     }
+    return extract_paths(set, slots, params, params_len, &info->steps_left);
+}
 
-    if(!(info->info_flags & rpc_request_is_notification))
+char* json_rpc_create_result(const char* result_str, rpc_request_info_t* info)
+{
+    char* buf = json_rpc_result_begin(info);
+    if(buf)
     {
-        if(info->info_flags & rpc_request_is_rpc_20)
-        {
-            buf = append_str(buf, response_20_prefix);
-        }
-        else
-        {
-            buf = append_str(buf, response_1x_prefix);
-        }
-
-        buf = append_str(buf, "\"result\": ");
         buf = append_str(buf, result_str);
-        if(!(info->info_flags & rpc_request_is_rpc_20))
-        {
-            buf = append_str(buf, ", \"error\": none");
-        }
-        if(info->id_start > 0)
-        {
-            buf = append_str(buf, ", \"id\": ");
-            buf = append_str(buf, info->data->request + info->id_start, info->id_len);
-        }
-        buf = append_str(buf, "}");
     }
-    return info->data->response;
+    return json_rpc_result_end(buf, info);
 }
 
 char* json_rpc_create_error(int err, rpc_request_info_t* info)
 {
     char* buf;
+    info->error = err;
+    info->result_start = -1;
     if(!info->data->response_len || !info->data->response) // if no space nor response, return..
     {
         return info->data->response;
@@ -357,32 +1394,21 @@ char* json_rpc_create_error(int err, rpc_request_info_t* info)
 
     if(!(info->info_flags & rpc_request_is_notification))
     {
-        if(info->info_flags & rpc_request_is_rpc_20)
-        {
-            buf = append_str(buf, response_20_prefix);
-        }
-        else
-        {
-            buf = append_str(buf, response_1x_prefix);
-        }
-        buf = append_str(buf, "\"error\": {\"code\": ");
-        buf = append_str(buf, json_rpc_err_codes[err].error_code);
-        buf = append_str(buf, ", \"message\": \"");
-        buf = append_str(buf, json_rpc_err_codes[err].error_msg);
-        buf = append_str(buf, "\"}");
-        if(info->id_start > 0 || err == json_rpc_err_invalid_request)
+        const response_template_t* error = &error_templates[(info->info_flags & rpc_request_is_rpc_20) ? 1 : 0][err];
+        buf = append_bytes(buf, error->text, error->len);
+        if(info->id_start > 0 || err == json_rpc_err_invalid_request || err == json_rpc_err_parse_error)
         {
-            buf = append_str(buf, ", \"id\": ");
+            buf = APPEND_LITERAL(buf, ", \"id\": ");
             if(info->id_start > 0)
             {
                 buf = append_str(buf, info->data->request + info->id_start, info->id_len);
             }
             else
             {
-                buf = append_str(buf, "none");
+                buf = APPEND_LITERAL(buf, "none");
             }
         }
-        buf = append_str(buf, "}");
+        buf = APPEND_LITERAL(buf, "}");
     }
     return info->data->response;
 }
@@ -390,6 +1416,8 @@ char* json_rpc_create_error(int err, rpc_request_info_t* info)
 char* json_rpc_create_error(const char* err_msg, rpc_request_info_t* info)
 {
     char* buf;
+    info->error = json_rpc_num_of_errors; // (custom error)
+    info->result_start = -1;
     if(!info->data->response_len || !info->data->response) // if no space nor response, return..
     {
         return info->data->response;
@@ -403,26 +1431,97 @@ char* json_rpc_create_error(const char* err_msg, rpc_request_info_t* info)
 
     if(!(info->info_flags & rpc_request_is_notification))
     {
-        if(info->info_flags & rpc_request_is_rpc_20)
+        const response_template_t* prefix = &custom_error_prefixes[(info->info_flags & rpc_request_is_rpc_20) ? 1 : 0];
+        buf = append_bytes(buf, prefix->text, prefix->len);
+        buf = append_str(buf, err_msg);
+        if(info->id_start > 0)
         {
-            buf = append_str(buf, response_20_prefix);
+            buf = APPEND_LITERAL(buf, ", \"id\": ");
+            buf = append_str(buf, info->data->request + info->id_start, info->id_len);
         }
-        else
+        buf = APPEND_LITERAL(buf, "}");
+    }
+    return info->data->response;
+}
+
+char* json_rpc_result_begin(rpc_request_info_t* info)
+{
+    const response_template_t* prefix;
+    char* buf;
+    if(!info->data->response_len || !info->data->response || // if no space nor response..
+       (info->info_flags & rpc_request_is_notification))      // ..or nothing to respond to, return
+    {
+        return 0;
+    }
+
+    buf = info->data->response + str_len(info->data->response);
+    if(buf - info->data->response > 2) // not the beginning of a batch response
+    {
+        buf = append_str(buf, ", ", 2);
+    }
+
+    prefix = &result_prefixes[(info->info_flags & rpc_request_is_rpc_20) ? 1 : 0];
+    buf = append_bytes(buf, prefix->text, prefix->len);
+    info->result_start = (int)(buf - info->data->response);
+    return buf;
+}
+
+char* json_rpc_result_end(char* cursor, rpc_request_info_t* info)
+{
+    if(cursor)
+    {
+        info->result_len = (int)(cursor - info->data->response) - info->result_start;
+        if(!(info->info_flags & rpc_request_is_rpc_20))
         {
-            buf = append_str(buf, response_1x_prefix);
+            cursor = APPEND_LITERAL(cursor, ", \"error\": none");
         }
-        buf = append_str(buf, "\"error\": ");
-        buf = append_str(buf, err_msg);
         if(info->id_start > 0)
         {
-            buf = append_str(buf, ", \"id\": ");
-            buf = append_str(buf, info->data->request + info->id_start, info->id_len);
+            cursor = APPEND_LITERAL(cursor, ", \"id\": ");
+            cursor = append_str(cursor, info->data->request + info->id_start, info->id_len);
         }
-        buf = append_str(buf, "}");
+        APPEND_LITERAL(cursor, "}");
     }
     return info->data->response;
 }
 
+void json_rpc_writer_begin(json_writer_t* writer, rpc_request_info_t* info)
+{
+    char* response_end = 0;
+    char* buf;
+    int reserved = 32; // space left for what json_rpc_result_end() (and the end of a batch) will append
+
+    if(info->data->response_len && info->data->response)
+    {
+        response_end = info->data->response + str_len(info->data->response);
+    }
+
+    buf = json_rpc_result_begin(info);
+    if(buf)
+    {
+        if(info->id_start > 0)
+        {
+            reserved += info->id_len;
+        }
+        json_writer_init(writer, buf, info->data->response_len - (int)(buf - info->data->response) - reserved);
+        writer->start = response_end; // (so that the whole response could be discarded on overflow)
+    }
+    else
+    {
+        json_writer_init(writer, 0, 0);
+    }
+}
+
+char* json_rpc_writer_end(json_writer_t* writer, rpc_request_info_t* info)
+{
+    if(writer->overflow)
+    {
+        *writer->start = 0; // discard what was written for this response and report an error instead
+        return json_rpc_create_error(json_rpc_err_internal_error, info);
+    }
+    return json_rpc_result_end(writer->cursor, info);
+}
+
 int json_begining_of_next_object(int start_from, const char* input, int input_len)
 {
     int next_obj_start = start_from;
@@ -452,7 +1551,7 @@ int json_find_next_member(int start_from, const char* input, int input_len, stru
         return input_len;
     }
 
-    curr_pos = skip_all_of(input, curr_pos, " \n\r\t", 0);
+    curr_pos = skip_all_of(input, curr_pos, input_len, " \n\r\t", 0);
     if(curr_pos >= input_len)
     {
         return input_len;
@@ -461,16 +1560,16 @@ int json_find_next_member(int start_from, const char* input, int input_len, stru
     if(input[curr_pos] != '{' && input[curr_pos] != '[') // if it's an object, get it as a value
     {
         start_from = curr_pos; // re-use start_from variable
-        while(start_from < input_len)
+        while(start_from + 1 < input_len)
         {
             start_from++;
             if(input[start_from] == ':')
             {
                 // ok, found member name (a.k.a key)
                 info->name_start = curr_pos; // assume start was beginning found above
-                info->name_start = skip_all_of(input, info->name_start, "\"", 0); // strip begin
+                info->name_start = skip_all_of(input, info->name_start, input_len, "\"", 0); // strip begin
                 curr_pos = start_from + 1;   // move curr past what we've parsed already
-                start_from = skip_all_of(input, start_from, " :\"", 1); // strip end
+                start_from = skip_all_of(input, start_from, input_len, " :\"", 1); // strip end
                 info->name_len = start_from - info->name_start + 1;
                 break;
             }
@@ -480,42 +1579,20 @@ int json_find_next_member(int start_from, const char* input, int input_len, stru
             }
         }
     }
-    return json_find_member_value(curr_pos, input, info);
+    return json_find_member_value(curr_pos, input, input_len, info);
 }
 
 const char* json_extract_member_str(const char* member_name, int* str_length, const char* input, int input_len)
 {
     const char* result = 0;
     json_token_info_t token_info;
-    int curr_pos = 0;
-    reset_token_info(&token_info);
     *str_length = 0; // on error - return 0 as length (default)
 
-    while(true)
+    if(find_member(member_name, input, input_len, &token_info, 0))
     {
-        curr_pos = json_find_next_member(curr_pos,
-                                         input,
-                                         input_len,
-                                         &token_info);
-        if(!token_info.values_len)
-        {
-            break;
-        }
-        else
-        {
-            if(str_are_equal(input+token_info.name_start, token_info.name_len, member_name))
-            {
-                *str_length = token_info.values_len;
-                result = input + token_info.values_start;
-                break;
-            }
-        }
-
-        if(json_next_member_is_object_or_list(input, &token_info))
-        {
-            curr_pos = token_info.values_start+1; // move past objects/list boundaries
-        }
-    };
+        *str_length = token_info.values_len;
+        result = input + token_info.values_start;
+    }
     return result;
 }
 
@@ -523,75 +1600,347 @@ const char* json_extract_member_str(int member_no_zero_based, int* str_length, c
 {
     const char* result = 0;
     json_token_info_t token_info;
-    int curr_param_no = 0;
-    int curr_pos = 0;
-
     *str_length = 0; // on error - return 0 as length (default)
 
-    reset_token_info(&token_info);
-    token_info.values_len = input_len;
-    if(json_next_member_is_object_or_list(input, &token_info)) // if it's object or list, enter..
+    if(find_member(member_no_zero_based, input, input_len, &token_info, 0))
     {
-        curr_pos = token_info.values_start+1; // move past the list begin
+        *str_length = token_info.values_len;
+        result = input + token_info.values_start;
     }
-
-    while(true)
-    {
-        curr_pos = json_find_next_member(curr_pos,
-                                         input,
-                                         input_len,
-                                         &token_info);
-        if(!token_info.values_len)
-        {
-            break;
-        }
-        else
-        {
-            if(curr_param_no == member_no_zero_based)
-            {
-                *str_length = token_info.values_len;
-                result = input + token_info.values_start;
-                break;
-            }
-            curr_param_no++;
-        }
-    };
     return result;
 }
 
-int json_extract_member_int(const char* member_name, int* result, const char* input, int input_len)
+int json_extract_member_view(const char* member_name, json_str_view_t* view, const char* input, int input_len)
 {
-    int extracted_ok = 0;
-    int result_str_len = 0;
-    const char* p  = json_extract_member_str(member_name, &result_str_len, input, input_len);
-    if(p && result_str_len)
-    {
-        if(convert_to_int(p, result_str_len, result))
-        {
-            extracted_ok = 1;
-        }
-    }
-    return extracted_ok;
+    json_token_info_t token_info;
+    int found = find_member(member_name, input, input_len, &token_info, 0);
+    view->start = input + token_info.values_start;
+    view->len = token_info.values_len;
+    view->has_escapes = token_info.values_flags & json_value_has_escapes;
+    return found;
 }
 
-int json_extract_member_int(int member_no_zero_based, int* result, const char* input, int input_len)
+int json_extract_member_view(int member_no_zero_based, json_str_view_t* view, const char* input, int input_len)
 {
-    int extracted_ok = 0;
-    int result_str_len = 0;
-    const char* p  = json_extract_member_str(member_no_zero_based, &result_str_len, input, input_len);
-    if(p && result_str_len)
+    json_token_info_t token_info;
+    int found = find_member(member_no_zero_based, input, input_len, &token_info, 0);
+    view->start = input + token_info.values_start;
+    view->len = token_info.values_len;
+    view->has_escapes = token_info.values_flags & json_value_has_escapes;
+    return found;
+}
+
+const char* json_str_view_decode(const json_str_view_t* view, char* storage, int storage_len, int* decoded_len)
+{
+    *decoded_len = view->len;
+    if(!view->has_escapes)
     {
-        if(convert_to_int(p, result_str_len, result))
-        {
-            extracted_ok = 1;
-        }
+        return view->start; // nothing to decode: zero-copy
     }
-    return extracted_ok;
+
+    *decoded_len = json_unescape(view->start, view->len, storage, storage_len);
+    if(*decoded_len < 0)
+    {
+        *decoded_len = 0;
+        return 0;
+    }
+    return storage;
 }
 
-int json_next_member_is_object(const char* input, struct json_token_info* info)
+int json_path_compile(json_path_t* path, const char* path_str)
 {
-    int is_object = 0;
+    // JSON Pointer ("/a/b/3", segments separated by '/', empty ones included),
+    // or dotted path ("a.b[3]", segments separated by any of ".[]", empty ones skipped)
+    int pointer = (*path_str == '/');
+    int names_len = 0;
+    json_path_segment_t* segment;
+    char c;
+
+    path->num_of_segments = 0;
+    path_str += pointer;
+    if(!pointer && !*path_str)
+    {
+        return 1; // (the whole input)
+    }
+
+    while(true)
+    {
+        if(!pointer)
+        {
+            while(*path_str == '.' || *path_str == '[' || *path_str == ']')
+            {
+                path_str++;
+            }
+            if(!*path_str)
+            {
+                return 1;
+            }
+        }
+        if(path->num_of_segments == JSON_PATH_MAX_SEGMENTS)
+        {
+            return 0;
+        }
+
+        segment = &path->segments[path->num_of_segments++];
+        segment->name_start = names_len;
+        segment->index = 0;
+        while(*path_str && (pointer ? *path_str != '/' : (*path_str != '.' && *path_str != '[' && *path_str != ']')))
+        {
+            c = *path_str++;
+            if(pointer && c == '~')
+            {
+                if(*path_str != '0' && *path_str != '1')
+                {
+                    return 0;
+                }
+                c = (*path_str++ == '0') ? '~' : '/';
+            }
+            if(names_len == JSON_PATH_MAX_NAMES_LEN)
+            {
+                return 0;
+            }
+            path->names[names_len++] = c;
+            if(segment->index >= 0)
+            {
+                segment->index = (c >= '0' && c <= '9' && segment->index < 100000000) ?
+                                 segment->index * 10 + (c - '0') : -1;
+            }
+        }
+        segment->name_len = names_len - segment->name_start;
+        if(!segment->name_len || (segment->name_len > 1 && path->names[segment->name_start] == '0'))
+        {
+            segment->index = -1; // (not a number, or with leading zeros)
+        }
+
+        if(pointer)
+        {
+            if(!*path_str)
+            {
+                return 1;
+            }
+            path_str++; // (past the '/')
+        }
+    }
+}
+
+const char* json_extract_path_str(const json_path_t* path, int* str_length, const char* input, int input_len)
+{
+    json_token_info_t token_info;
+    *str_length = 0;
+    if(!find_path(path, input, input_len, &token_info, 0))
+    {
+        return 0;
+    }
+    *str_length = token_info.values_len;
+    return input + token_info.values_start;
+}
+
+int json_extract_path_view(const json_path_t* path, json_str_view_t* view, const char* input, int input_len)
+{
+    json_token_info_t token_info;
+    int found = find_path(path, input, input_len, &token_info, 0);
+    view->start = input + (found ? token_info.values_start : 0);
+    view->len = found ? token_info.values_len : 0;
+    view->has_escapes = found && (token_info.values_flags & json_value_has_escapes);
+    return found;
+}
+
+void json_path_set_init(json_path_set_t* set, json_path_node_t* storage_for_nodes, int max_num_of_nodes)
+{
+    set->nodes = storage_for_nodes;
+    set->num_of_nodes = 0;
+    set->max_num_of_nodes = max_num_of_nodes;
+    set->num_of_paths = 0;
+    if(max_num_of_nodes > 0)
+    {
+        set->nodes[0].name_len = 0;
+        set->nodes[0].index = -1;
+        set->nodes[0].first_child = -1;
+        set->nodes[0].next_sibling = -1;
+        set->nodes[0].slot = -1;
+        set->num_of_nodes = 1;
+    }
+}
+
+int json_path_set_add(json_path_set_t* set, const char* path)
+{
+    json_path_t compiled;
+    const json_path_segment_t* segment;
+    json_path_node_t* node;
+    int node_no = 0;
+    int child;
+    int i;
+
+    if(!set->num_of_nodes || !json_path_compile(&compiled, path))
+    {
+        return -1;
+    }
+
+    for(i = 0; i < compiled.num_of_segments; i++)
+    {
+        segment = &compiled.segments[i];
+        if(segment->name_len > JSON_PATH_NODE_NAME_LEN)
+        {
+            return -1;
+        }
+
+        // child node for this segment (it's shared with other paths that have the same beginning)
+        for(child = set->nodes[node_no].first_child; child >= 0; child = set->nodes[child].next_sibling)
+        {
+            if(set->nodes[child].name_len == segment->name_len &&
+               bytes_are_equal(set->nodes[child].name, compiled.names + segment->name_start, segment->name_len))
+            {
+                break;
+            }
+        }
+        if(child < 0)
+        {
+            if(set->num_of_nodes == set->max_num_of_nodes)
+            {
+                return -1;
+            }
+            child = set->num_of_nodes++;
+            node = &set->nodes[child];
+            move_bytes(node->name, compiled.names + segment->name_start, segment->name_len);
+            node->name_len = segment->name_len;
+            node->index = segment->index;
+            node->first_child = -1;
+            node->slot = -1;
+            node->next_sibling = set->nodes[node_no].first_child;
+            set->nodes[node_no].first_child = child;
+        }
+        node_no = child;
+    }
+
+    if(set->nodes[node_no].slot < 0)
+    {
+        set->nodes[node_no].slot = set->num_of_paths++;
+    }
+    return set->nodes[node_no].slot;
+}
+
+int json_extract_paths(const json_path_set_t* set, json_str_view_t* slots, const char* input, int input_len)
+{
+    return extract_paths(set, slots, input, input_len, 0);
+}
+
+int json_str_view_to_int(const json_str_view_t* view, int* result)
+{
+    return view->start && view->len && convert_to_int(view->start, view->len, result);
+}
+
+int json_str_view_to_int64(const json_str_view_t* view, int64_t* result)
+{
+    return view->start && view->len && convert_to_int64(view->start, view->len, result);
+}
+
+int json_unescape(const char* from, int len, char* to, int to_len)
+{
+    const char* end = from + len;
+    char* to_begin = to;
+    char* to_end = to + to_len;
+    uint32_t code_point;
+    uint32_t low_surrogate;
+
+    while(from < end)
+    {
+        if(to >= to_end)
+        {
+            return -1;
+        }
+
+        if(*from != '\\')
+        {
+            *to++ = *from++;
+            continue;
+        }
+
+        if(++from >= end)
+        {
+            return -1;
+        }
+        switch(*from++)
+        {
+        case '\"': *to++ = '\"';  break;
+        case '\\': *to++ = '\\'; break;
+        case '/':  *to++ = '/';  break;
+        case 'b':  *to++ = '\b'; break;
+        case 'f':  *to++ = '\f'; break;
+        case 'n':  *to++ = '\n'; break;
+        case 'r':  *to++ = '\r'; break;
+        case 't':  *to++ = '\t'; break;
+        case 'u':
+            if(!hex_to_uint(from, end - from, 4, &code_point))
+            {
+                return -1;
+            }
+            from += 4;
+            if(code_point >= 0xD800 && code_point <= 0xDBFF) // high surrogate: should be followed by a low one
+            {
+                if(end - from >= 6 && from[0] == '\\' && from[1] == 'u' &&
+                   hex_to_uint(from + 2, 4, 4, &low_surrogate) &&
+                   low_surrogate >= 0xDC00 && low_surrogate <= 0xDFFF)
+                {
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low_surrogate - 0xDC00);
+                    from += 6;
+                }
+                else
+                {
+                    code_point = 0xFFFD; // unpaired surrogate: use replacement character
+                }
+            }
+            else if(code_point >= 0xDC00 && code_point <= 0xDFFF)
+            {
+                code_point = 0xFFFD;
+            }
+
+            if(to_end - to < 4)
+            {
+                return -1;
+            }
+            to = encode_utf8(to, code_point);
+            break;
+
+        default:
+            return -1;
+        }
+    }
+    return (int)(to - to_begin);
+}
+
+int json_extract_member_int(const char* member_name, int* result, const char* input, int input_len)
+{
+    int extracted_ok = 0;
+    int result_str_len = 0;
+    const char* p  = json_extract_member_str(member_name, &result_str_len, input, input_len);
+    if(p && result_str_len)
+    {
+        if(convert_to_int(p, result_str_len, result))
+        {
+            extracted_ok = 1;
+        }
+    }
+    return extracted_ok;
+}
+
+int json_extract_member_int(int member_no_zero_based, int* result, const char* input, int input_len)
+{
+    int extracted_ok = 0;
+    int result_str_len = 0;
+    const char* p  = json_extract_member_str(member_no_zero_based, &result_str_len, input, input_len);
+    if(p && result_str_len)
+    {
+        if(convert_to_int(p, result_str_len, result))
+        {
+            extracted_ok = 1;
+        }
+    }
+    return extracted_ok;
+}
+
+int json_next_member_is_object(const char* input, struct json_token_info* info)
+{
+    int is_object = 0;
     if(info->values_len > 0)
     {
         if(input[info->values_start] == '{' &&
@@ -633,60 +1982,539 @@ int json_next_member_is_object_or_list(const char* input, struct json_token_info
     return is_object;
 }
 
-/* Private functions ------------------------------------------------------- */
-static int json_find_member_value(int start_from, const char* input, struct json_token_info* info)
+int json_validate(const char* input, int input_len)
 {
-    int curr_pos = start_from;
-    int max_len = str_len(input);
+    uint64_t in_object = 0; // bit per nesting level: set for objects, clear for lists
+    int depth = 0;
+    int state = expect_value;
+    int pos = 0;
+    char closing;
+    char curr;
+
+    while(true)
+    {
+        pos = skip_whitespace(input, pos, input_len);
+        if(state == after_value && depth == 0)
+        {
+            return pos == input_len; // only whitespace is allowed after the top-level value
+        }
+        if(pos >= input_len)
+        {
+            return 0;
+        }
+
+        curr = input[pos];
+        switch(state)
+        {
+        case expect_key:
+            pos = validate_string(input, pos, input_len);
+            if(pos < 0)
+            {
+                return 0;
+            }
+            pos = skip_whitespace(input, pos, input_len);
+            if(pos >= input_len || input[pos] != ':')
+            {
+                return 0;
+            }
+            pos++;
+            state = expect_value;
+            break;
+
+        case after_value:
+            pos++;
+            closing = ((in_object >> depth) & 1) ? '}' : ']';
+            if(curr == ',')
+            {
+                state = ((in_object >> depth) & 1) ? expect_key : expect_value;
+            }
+            else if(curr == closing)
+            {
+                depth--;
+            }
+            else
+            {
+                return 0;
+            }
+            break;
+
+        default: // expect_value
+            if(curr == '{' || curr == '[')
+            {
+                if(++depth >= 64)
+                {
+                    return 0; // nested too deep
+                }
+                closing = (curr == '{') ? '}' : ']';
+                if(curr == '{')
+                {
+                    in_object |= (1ULL << depth);
+                }
+                else
+                {
+                    in_object &= ~(1ULL << depth);
+                }
+
+                pos = skip_whitespace(input, pos + 1, input_len);
+                if(pos < input_len && input[pos] == closing) // empty object / list
+                {
+                    pos++;
+                    depth--;
+                    state = after_value;
+                }
+                else
+                {
+                    state = (curr == '{') ? expect_key : expect_value;
+                }
+                break;
+            }
+
+            if(curr == '\"')
+            {
+                pos = validate_string(input, pos, input_len);
+            }
+            else if(curr == '-' || (curr >= '0' && curr <= '9'))
+            {
+                pos = validate_number(input, pos, input_len);
+            }
+            else
+            {
+                pos = validate_literal(input, pos, input_len);
+            }
+
+            if(pos < 0)
+            {
+                return 0;
+            }
+            state = after_value;
+            break;
+        }
+    }
+}
 
+int json_check_budget(const char* input, int input_len, const json_parse_budget_t* budget)
+{
+    int members[JSON_BUDGET_MAX_DEPTH + 1]; // (separators seen so far at each depth)
     int in_quotes = 0;
-    int in_object = 0;
-    int in_array = 0;
+    int depth = 0;
+    int pos;
     char curr;
-    int values_end = 0;
 
-    curr_pos = skip_all_of(input, curr_pos, "\n\r\t :", 0); // whitespace & colon: we'll be searching for a value
-    info->values_start = curr_pos;
+    if(budget->max_bytes && input_len > budget->max_bytes)
+    {
+        return json_budget_bytes_exceeded;
+    }
 
-    // find value(s) for this object
-    while(curr_pos < max_len)
+    members[0] = 0;
+    for(pos = 0; pos < input_len; pos++)
     {
-        curr = input[curr_pos];
+        curr = input[pos];
+        if(in_quotes)
+        {
+            if(curr == '\\')
+            {
+                pos++; // (skip the escaped character, it might be a quote)
+            }
+            else if(curr == '\"')
+            {
+                in_quotes = 0;
+            }
+            continue;
+        }
+
         switch(curr)
         {
         case '\"':
-            in_quotes = ~in_quotes;
-            curr_pos++;
-            continue;
+            in_quotes = 1;
+            break;
 
+        case '{':
         case '[':
-            if(!in_quotes)
+            depth++;
+            if(budget->max_depth && depth > budget->max_depth)
             {
-                in_array++;
+                return json_budget_depth_exceeded;
             }
-            curr_pos++;
-            continue;
-
-        case '{':
-            if(!in_quotes)
+            if(depth <= JSON_BUDGET_MAX_DEPTH)
             {
-                in_object++;
+                members[depth] = 0;
             }
-            curr_pos++;
-            continue;
+            break;
 
+        case '}':
         case ']':
-            curr_pos++;
-            if(!in_quotes)
+            depth -= depth > 0;
+            break;
+
+        case ',':
+            // (n separators: n + 1 members)
+            if(depth <= JSON_BUDGET_MAX_DEPTH && budget->max_members && ++members[depth] >= budget->max_members)
             {
-                in_array--;
-                if(in_array <= 0)
-                {
-                    if(!in_object)
-                    {
-                        values_end = curr_pos;
-                        break;
-                    }
+                return json_budget_members_exceeded;
+            }
+            break;
+        }
+    }
+    return json_budget_ok;
+}
+
+int json_is_msgpack(const char* input, int input_len)
+{
+    unsigned char first;
+    if(input_len <= 0)
+    {
+        return 0;
+    }
+    first = (unsigned char)input[0];
+    return (first >= 0x80 && first <= 0x9f) || (first >= 0xdc && first <= 0xdf); // (fixmap, fixarray, 16/32-bit)
+}
+
+int json_from_msgpack(const char* input, int input_len, char* output, int output_len)
+{
+    char* out = output;
+    if(output_len <= 0 ||
+       msgpack_to_json((const unsigned char*)input, 0, input_len, &out, output + output_len - 1, 0) != input_len)
+    {
+        return -1;
+    }
+    *out = 0;
+    return (int)(out - output);
+}
+
+int json_to_msgpack(const char* input, int input_len, char* output, int output_len)
+{
+    msgpack_writer_t writer;
+    int pos;
+    writer.input = input;
+    writer.out = output;
+    writer.out_end = output + output_len;
+    writer.in_place = (output <= input && output + output_len > input);
+
+    pos = json_to_msgpack_value(&writer, skip_whitespace(input, 0, input_len), input_len, 0);
+    if(pos < 0 || skip_whitespace(input, pos, input_len) != input_len)
+    {
+        return -1;
+    }
+    return (int)(writer.out - output);
+}
+
+char* json_format_int(char* to, int64_t value)
+{
+    if(value < 0)
+    {
+        *to++ = '-';
+        return format_uint(to, 0 - (uint64_t)value); // (also correct for the most negative value)
+    }
+    return format_uint(to, (uint64_t)value);
+}
+
+char* json_format_double(char* to, double value)
+{
+    char digits[20];
+    int num_of_digits;
+    int k = 0;
+    int point_at;
+    int i;
+    union
+    {
+        double d;
+        uint64_t u;
+    } bits;
+
+    bits.d = value;
+    if((bits.u & 0x7FF0000000000000ULL) == 0x7FF0000000000000ULL) // NaN or Infinity
+    {
+        return append_str(to, "null");
+    }
+
+    if(bits.u >> 63)
+    {
+        *to++ = '-';
+        bits.u &= ~(1ULL << 63);
+    }
+
+    if(bits.u == 0)
+    {
+        return append_str(to, "0");
+    }
+
+    num_of_digits = grisu2(bits.d, digits, &k); // value = digits * 10^k
+    point_at = num_of_digits + k;                // value = 0.digits * 10^point_at
+
+    if(num_of_digits <= point_at && point_at <= 21) // integer: 1234e7 -> 12340000000
+    {
+        to = append_str(to, digits, num_of_digits);
+        for(i = num_of_digits; i < point_at; i++)
+        {
+            *to++ = '0';
+        }
+    }
+    else if(0 < point_at && point_at <= 21) // 1234e-2 -> 12.34
+    {
+        to = append_str(to, digits, point_at);
+        *to++ = '.';
+        to = append_str(to, digits + point_at, num_of_digits - point_at);
+    }
+    else if(-6 < point_at && point_at <= 0) // 1234e-6 -> 0.001234
+    {
+        *to++ = '0';
+        *to++ = '.';
+        for(i = point_at; i < 0; i++)
+        {
+            *to++ = '0';
+        }
+        to = append_str(to, digits, num_of_digits);
+    }
+    else // exponent notation: 1234e30 -> 1.234e+33, 1e-7
+    {
+        *to++ = digits[0];
+        if(num_of_digits > 1)
+        {
+            *to++ = '.';
+            to = append_str(to, digits + 1, num_of_digits - 1);
+        }
+        *to++ = 'e';
+        if(point_at - 1 < 0)
+        {
+            *to++ = '-';
+            to = format_uint(to, 1 - point_at);
+        }
+        else
+        {
+            *to++ = '+';
+            to = format_uint(to, point_at - 1);
+        }
+    }
+    *to = 0;
+    return to;
+}
+
+char* json_format_str(char* to, const char* from, int len)
+{
+    const char* end;
+    char curr;
+    if(len < 0)
+    {
+        len = str_len(from);
+    }
+    end = from + len;
+
+    *to++ = '\"';
+    while(from < end)
+    {
+        // copy (the most common) runs of characters that don't need escaping a word at a time
+        while(end - from >= 8 && !need_escaping(load_8_chars(from)))
+        {
+            to = append_str(to, from, 8);
+            from += 8;
+        }
+        if(from == end)
+        {
+            break;
+        }
+
+        curr = *from++;
+        switch(curr)
+        {
+        case '\"':  *to++ = '\\'; *to++ = '\"';  break;
+        case '\\': *to++ = '\\'; *to++ = '\\'; break;
+        case '\b':  *to++ = '\\'; *to++ = 'b';  break;
+        case '\f':  *to++ = '\\'; *to++ = 'f';  break;
+        case '\n':  *to++ = '\\'; *to++ = 'n';  break;
+        case '\r':  *to++ = '\\'; *to++ = 'r';  break;
+        case '\t':  *to++ = '\\'; *to++ = 't';  break;
+        default:
+            if((unsigned char)curr < 0x20) // other control characters
+            {
+                to = append_str(to, "\\u00", 4);
+                *to++ = "0123456789abcdef"[(curr >> 4) & 0xF];
+                *to++ = "0123456789abcdef"[curr & 0xF];
+            }
+            else
+            {
+                *to++ = curr;
+            }
+            break;
+        }
+    }
+    *to++ = '\"';
+    *to = 0;
+    return to;
+}
+
+void json_writer_init(json_writer_t* writer, char* buf, int buf_len)
+{
+    writer->cursor = buf;
+    writer->start = buf;
+    writer->end = buf;
+    writer->has_members = 0;
+    writer->depth = 0;
+    writer->after_key = 0;
+    writer->overflow = 0;
+    if(buf)
+    {
+        if(buf_len > 0)
+        {
+            writer->end = buf + buf_len;
+            *buf = 0;
+        }
+        else
+        {
+            writer->overflow = 1;
+        }
+    }
+}
+
+void json_writer_begin_object(json_writer_t* writer)
+{
+    writer_open(writer, '{');
+}
+
+void json_writer_end_object(json_writer_t* writer)
+{
+    writer_close(writer, '}');
+}
+
+void json_writer_begin_array(json_writer_t* writer)
+{
+    writer_open(writer, '[');
+}
+
+void json_writer_end_array(json_writer_t* writer)
+{
+    writer_close(writer, ']');
+}
+
+void json_writer_key(json_writer_t* writer, const char* key)
+{
+    int key_len = str_len(key);
+    if(writer_begin_value(writer, 6*key_len + 4))
+    {
+        writer->cursor = json_format_str(writer->cursor, key, key_len);
+        writer->cursor = append_str(writer->cursor, ": ", 2);
+        writer->after_key = 1;
+    }
+}
+
+void json_writer_value_int(json_writer_t* writer, int64_t value)
+{
+    if(writer_begin_value(writer, JSON_FORMAT_INT_MAX_LEN))
+    {
+        writer->cursor = json_format_int(writer->cursor, value);
+    }
+}
+
+void json_writer_value_double(json_writer_t* writer, double value)
+{
+    if(writer_begin_value(writer, JSON_FORMAT_DOUBLE_MAX_LEN))
+    {
+        writer->cursor = json_format_double(writer->cursor, value);
+    }
+}
+
+void json_writer_value_bool(json_writer_t* writer, int value)
+{
+    if(writer_begin_value(writer, 5))
+    {
+        writer->cursor = append_str(writer->cursor, value ? "true" : "false");
+    }
+}
+
+void json_writer_value_null(json_writer_t* writer)
+{
+    if(writer_begin_value(writer, 4))
+    {
+        writer->cursor = append_str(writer->cursor, "null");
+    }
+}
+
+void json_writer_value_str(json_writer_t* writer, const char* str, int len)
+{
+    if(len < 0)
+    {
+        len = str_len(str);
+    }
+    if(writer_begin_value(writer, 6*len + 2))
+    {
+        writer->cursor = json_format_str(writer->cursor, str, len);
+    }
+}
+
+void json_writer_value_raw(json_writer_t* writer, const char* json, int len)
+{
+    if(len < 0)
+    {
+        len = str_len(json);
+    }
+    if(len > 0 && writer_begin_value(writer, len))
+    {
+        writer->cursor = append_str(writer->cursor, json, len);
+    }
+}
+
+/* Private functions ------------------------------------------------------- */
+static int json_find_member_value(int start_from, const char* input, int input_len, struct json_token_info* info)
+{
+    int curr_pos = start_from;
+    int max_len = input_len; // (input doesn't have to be null-terminated, e.g. a line of a log)
+
+    int in_quotes = 0;
+    int in_object = 0;
+    int in_array = 0;
+    char curr;
+    int values_end = 0;
+
+    curr_pos = skip_all_of(input, curr_pos, max_len, "\n\r\t :", 0); // whitespace & colon: we'll be searching for a value
+    info->values_start = curr_pos;
+
+    // find value(s) for this object
+    while(curr_pos < max_len)
+    {
+        curr = input[curr_pos];
+        switch(curr)
+        {
+        case '\"':
+            in_quotes = ~in_quotes;
+            curr_pos++;
+            continue;
+
+        case '\\':
+            if(in_quotes)
+            {
+                info->values_flags |= json_value_has_escapes;
+                curr_pos += 2; // skip the escaped character (it might be a quote)
+                continue;
+            }
+            break;
+
+        case '[':
+            if(!in_quotes)
+            {
+                in_array++;
+            }
+            curr_pos++;
+            continue;
+
+        case '{':
+            if(!in_quotes)
+            {
+                in_object++;
+            }
+            curr_pos++;
+            continue;
+
+        case ']':
+            curr_pos++;
+            if(!in_quotes)
+            {
+                in_array--;
+                if(in_array <= 0)
+                {
+                    if(!in_object)
+                    {
+                        values_end = curr_pos;
+                        break;
+                    }
                 }
             }
             continue;
@@ -695,278 +2523,2952 @@ static int json_find_member_value(int start_from, const char* input, struct json
             curr_pos++;
             if(!in_quotes)
             {
-                in_object--;
-                if(in_object <= 0)
+                in_object--;
+                if(in_object <= 0)
+                {
+                    if(!in_array)
+                    {
+                        values_end = curr_pos;
+                        break;
+                    }
+                }
+            }
+            continue;
+        }
+
+        if(values_end > 0 ||
+          ( curr == ',' && !in_object && !in_array && !in_quotes ))
+        {
+             // in_object or in_array will have negative values if a whole object and / or array
+             // was extracted, so adjust for this
+             values_end = curr_pos + in_object + in_array;
+             curr_pos++;
+             break;
+        }
+        curr_pos++;
+    }
+
+    if(values_end > info->values_start + 1 && // (nothing is read past the value, nor before it)
+       input[info->values_start] == '\"' && input[values_end-1] == '\"')
+    {
+        info->values_start++;
+        values_end--;
+    }
+    else
+    {
+        info->values_start = skip_all_of(input, info->values_start, max_len, " \t\n\r", 0);
+        while(values_end > info->values_start && // (trailing whitespace, but not past the value)
+              (input[values_end - 1] == ' ' || input[values_end - 1] == '\t' ||
+               input[values_end - 1] == '\n' || input[values_end - 1] == '\r'))
+        {
+            values_end--;
+        }
+    }
+
+    info->values_len = (values_end >= info->values_start) ? values_end - info->values_start : 0;
+    return curr_pos;
+}
+
+static int str_len(const char* str)
+{
+    // yes yes, the unsafe str_len.. hopefully we'll use it wisely ;)
+    int i = 0;
+    while(*str++)
+    {
+        i++;
+    }
+    return i;
+}
+
+static char* append_str(char* to, const char* from, int len/* = -1*/)
+{
+    if(len > 0)
+    {
+        while(len--)
+        {
+            *to++ = *from++;
+        }
+    }
+    else
+    {
+        while(*from)
+        {
+            *to++ = *from++;
+        }
+    }
+    *to = 0;
+    return to;
+}
+
+static inline char* append_bytes(char* to, const char* from, int len)
+{
+    // bulk copy of precomputed parts of responses (their length is known)
+#if defined(__GNUC__)
+    __builtin_memcpy(to, from, len);
+    to += len;
+#else
+    while(len-- > 0)
+    {
+        *to++ = *from++;
+    }
+#endif
+    *to = 0;
+    return to;
+}
+
+static int str_are_equal(const char* first, const char* second_zero_ended)
+{
+    int are_equal = 0;
+    while (*second_zero_ended != 0   &&  // not the end of string?
+           *first != 0  &&               // nor end of str
+           *first == *second_zero_ended) // until are equal
+    {
+        first++;
+        second_zero_ended++;
+    }
+
+    // here, if we're at the end of second = they do match
+    if (*second_zero_ended == 0)
+    {
+        are_equal = 1;
+    }
+    return are_equal;
+}
+
+static int str_are_equal(const char* first, int first_len, const char* second_zero_ended)
+{
+    int are_equal = 0;
+    while (*second_zero_ended != 0   &&  // not the end of string?
+           *first != 0  &&    // nor end of str
+           *first == *second_zero_ended) // until are equal
+    {
+        first++;
+        second_zero_ended++;
+        first_len--;
+    }
+
+    // here, if we're at the end of first and second they do match at least at first_len characters.
+    if (*second_zero_ended == 0 && first_len == 0)
+    {
+        are_equal = 1;
+    }
+    return are_equal;
+}
+
+static int int_val(char symbol, int* result)
+{
+    int value_ok = 1;
+    int correct_by = 0;
+
+    if ((symbol >= '0') && (symbol <= '9'))
+    {
+        correct_by = '0';
+    }
+    else if ((symbol >= 'A') && (symbol <= 'F'))
+    {
+        correct_by = ('A' - 10);
+    }
+    else if ((symbol >= 'a') && (symbol <= 'f'))
+    {
+        correct_by = ('a' - 10);
+    }
+    else
+    {
+        value_ok = 0;
+    }
+
+    *result = symbol - correct_by;
+    return value_ok;
+}
+
+static int convert_to_int(const char* start, int length, int* result)
+{
+    int64_t value = 0;
+    int extracted_ok = convert_to_int64(start, length, &value) && (int64_t)(int)value == value;
+
+    *result = extracted_ok ? (int)value : 0; // (values that don't fit are not truncated)
+    return extracted_ok;
+}
+
+static int convert_to_int64(const char* start, int length, int64_t* result)
+{
+    uint64_t magnitude = 0;
+    uint64_t limit = ((uint64_t)1 << 63) - 1;
+    int base = 10;
+    int value = 0;
+    int negative = 0;
+    int val_start = 0;
+    int i = 0;
+
+    if(length > 0 && start[0] == '-')
+    {
+        negative = 1;
+        limit++; // (one more negative value)
+        val_start++;
+    }
+
+    // find base: 0x: hex(16), 0:octal(8)
+    if(length > val_start+2 &&
+       start[val_start] == '0')
+    {
+        if(start[val_start+1] == 'x')
+        {
+            base = 16;
+            val_start += 2;
+        }
+        else
+        {
+            base = 8;
+            val_start += 1;
+        }
+    }
+
+    *result = 0;
+    for(i = val_start; i < length; i++)
+    {
+        if(!int_val(start[i], &value) ||
+           value > base ||
+           magnitude > (limit - value) / base) // (it would overflow)
+        {
+            return 0;
+        }
+        magnitude = magnitude * base + value;
+    }
+    *result = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude; // (also the lowest value: -2^63)
+    return 1;
+}
+
+static int name_to_id(const char* name, json_rpc_instance* table)
+{
+    const char* curr_name = name;
+    const char* curr_item;
+    int i;
+    for (i = 0; i < table->num_of_handlers; i++)
+    {
+        curr_name = name;
+        while(*curr_name == '\"')
+        {
+            curr_name++; // skip opening quotes
+        }
+
+        curr_item = table->handlers[i].fcn_name;
+
+        while (*curr_name != 0   &&  // not the end of string?
+               *curr_name != '\"' && // end of word marked by quote
+               *curr_item != 0  &&   // nor end of handler function name
+               *curr_name == *curr_item) // until are equal
+        {
+            curr_name++;
+            curr_item++;
+        }
+
+        // here, if we're at the end of either curr_: we've found it!
+        if (*curr_item == 0 && (*curr_name == 0 || *curr_name == '\"'))
+        {
+            break;
+        }
+    }
+    return i == table->num_of_handlers ? -1 : i; // if not found, return -1
+}
+
+static int get_fcn_id(json_rpc_instance_t* self, const char* input, json_token_info_t* info)
+{
+    const char* name = &input[info->values_start];
+    return name_to_id(name, self);
+}
+
+static int get_obj_id(const char* input, json_token_info_t* info)
+{
+    json_rpc_instance table;
+    table.handlers = (json_rpc_handler_t*)obj_names;
+    table.num_of_handlers = num_of_obj_names;
+    const char* name = &input[info->name_start];
+    return name_to_id(name, &table);
+}
+
+static void reset_token_info(json_token_info_t* info)
+{
+    info->name_start = 0;
+    info->name_len = 0;
+    info->values_start = 0;
+    info->values_len = 0;
+    info->values_flags = 0;
+}
+
+static int skip_all_of(const char* input, int start_at, int input_len, const char* values, char reversed)
+{
+    int size = str_len(values);
+    int i = 0;
+    char found = 0;
+    do
+    {
+        if(start_at >= input_len)
+        {
+            break; // (input doesn't have to be null-terminated)
+        }
+        for(i = 0; i < size; i++)
+        {
+            found = 0;
+            if(input[start_at] == values[i])
+            {
+                if(reversed)
+                {
+                    --start_at;
+                    if(start_at < 0)
+                    {
+                        return start_at;
+                    }
+                }
+                else
+                {
+                    ++start_at;
+                }
+                found = 1;
+                break;
+            }
+        }
+    }
+    while(found);
+    return start_at;
+}
+
+static char* format_uint(char* to, uint64_t value)
+{
+    int num_of_digits = 1;
+    uint64_t v = value;
+    char* end;
+    while(v >= 10)
+    {
+        v /= 10;
+        num_of_digits++;
+    }
+
+    end = to + num_of_digits;
+    to = end;
+    while(value >= 100) // two digits at a time (from the end)
+    {
+        int pair = (int)(value % 100) * 2;
+        value /= 100;
+        *--to = digit_pairs[pair + 1];
+        *--to = digit_pairs[pair];
+    }
+    if(value >= 10)
+    {
+        *--to = digit_pairs[value * 2 + 1];
+        *--to = digit_pairs[value * 2];
+    }
+    else
+    {
+        *--to = (char)('0' + value);
+    }
+    *end = 0;
+    return end;
+}
+
+static uint64_t load_8_chars(const char* from)
+{
+    // (compilers turn this into a single load where possible)
+    const unsigned char* p = (const unsigned char*)from;
+    return  (uint64_t)p[0]        | ((uint64_t)p[1] << 8)  | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+           ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static int need_escaping(uint64_t chars)
+{
+    // checks all 8 characters at once (SWAR): is any of them < 0x20, '"' or '\\'?
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highs = 0x8080808080808080ULL;
+    uint64_t quotes = chars ^ (ones * '\"');
+    uint64_t slashes = chars ^ (ones * '\\');
+    uint64_t found = ((chars - ones * 0x20) & ~chars) |
+                     ((quotes - ones) & ~quotes) |
+                     ((slashes - ones) & ~slashes);
+    return (found & highs) != 0;
+}
+
+static diy_fp_t diy_fp_multiply(diy_fp_t x, diy_fp_t y)
+{
+    // 64x64 bit multiplication, keeping (rounded) upper 64 bits
+    const uint64_t mask_32 = 0xFFFFFFFFULL;
+    uint64_t a = x.f >> 32;
+    uint64_t b = x.f & mask_32;
+    uint64_t c = y.f >> 32;
+    uint64_t d = y.f & mask_32;
+    uint64_t ac = a * c;
+    uint64_t bc = b * c;
+    uint64_t ad = a * d;
+    uint64_t bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & mask_32) + (bc & mask_32) + (1ULL << 31);
+    diy_fp_t result;
+    result.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+    result.e = x.e + y.e + 64;
+    return result;
+}
+
+static diy_fp_t diy_fp_normalize(diy_fp_t x)
+{
+    while(!(x.f & (1ULL << 63)))
+    {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+static void grisu_round(char* digits, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+    while(rest < wp_w && delta - rest >= ten_kappa &&
+          (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+    {
+        digits[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static int grisu_digit_gen(diy_fp_t w, diy_fp_t mp, uint64_t delta, char* digits, int* k)
+{
+    diy_fp_t one;
+    uint64_t wp_w = mp.f - w.f;
+    uint32_t p1;
+    uint64_t p2;
+    uint64_t rest;
+    int kappa = 1;
+    int len = 0;
+    int d;
+
+    one.f = 1ULL << -mp.e;
+    one.e = mp.e;
+    p1 = (uint32_t)(mp.f >> -one.e);
+    p2 = mp.f & (one.f - 1);
+    while(kappa < 10 && p1 >= pow10_table[kappa])
+    {
+        kappa++;
+    }
+
+    while(kappa > 0) // integral part
+    {
+        d = (int)(p1 / pow10_table[kappa - 1]);
+        p1 = (uint32_t)(p1 % pow10_table[kappa - 1]);
+        if(d || len)
+        {
+            digits[len++] = (char)('0' + d);
+        }
+        kappa--;
+        rest = ((uint64_t)p1 << -one.e) + p2;
+        if(rest <= delta)
+        {
+            *k += kappa;
+            grisu_round(digits, len, delta, rest, pow10_table[kappa] << -one.e, wp_w);
+            return len;
+        }
+    }
+
+    while(true) // fractional part
+    {
+        p2 *= 10;
+        delta *= 10;
+        d = (int)(p2 >> -one.e);
+        if(d || len)
+        {
+            digits[len++] = (char)('0' + d);
+        }
+        p2 &= one.f - 1;
+        kappa--;
+        if(p2 < delta)
+        {
+            *k += kappa;
+            grisu_round(digits, len, delta, p2, one.f, wp_w * (-kappa < 20 ? pow10_table[-kappa] : 0));
+            return len;
+        }
+    }
+}
+
+static int grisu2(double value, char* digits, int* k)
+{
+    // Grisu2 algorithm (F. Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with Integers")
+    const uint64_t hidden_bit = 0x0010000000000000ULL;
+    diy_fp_t v;
+    diy_fp_t w_minus;
+    diy_fp_t w_plus;
+    diy_fp_t c_mk;
+    diy_fp_t w;
+    double dk;
+    int biased_e;
+    int cached_k;
+    int index;
+    union
+    {
+        double d;
+        uint64_t u;
+    } bits;
+
+    bits.d = value;
+    biased_e = (int)((bits.u >> 52) & 0x7FF);
+    v.f = bits.u & (hidden_bit - 1);
+    if(biased_e)
+    {
+        v.f += hidden_bit;
+        v.e = biased_e - 1075;
+    }
+    else
+    {
+        v.e = -1074;
+    }
+
+    // normalised boundaries (m-, m+) of the value
+    w_plus.f = (v.f << 1) + 1;
+    w_plus.e = v.e - 1;
+    while(!(w_plus.f & (hidden_bit << 1)))
+    {
+        w_plus.f <<= 1;
+        w_plus.e--;
+    }
+    w_plus.f <<= 10;
+    w_plus.e -= 10;
+
+    if(v.f == hidden_bit)
+    {
+        w_minus.f = (v.f << 2) - 1;
+        w_minus.e = v.e - 2;
+    }
+    else
+    {
+        w_minus.f = (v.f << 1) - 1;
+        w_minus.e = v.e - 1;
+    }
+    w_minus.f <<= w_minus.e - w_plus.e;
+    w_minus.e = w_plus.e;
+
+    // cached power of ten (c_mk = 10^-k), so that the exponent of the product is within [-60, -32]
+    dk = (-61 - w_plus.e) * 0.30102999566398114 + 347;
+    cached_k = (int)dk;
+    if(dk - cached_k > 0.0)
+    {
+        cached_k++;
+    }
+    index = (cached_k >> 3) + 1;
+    c_mk.f = cached_powers_f[index];
+    c_mk.e = cached_powers_e[index];
+    *k = -(-348 + index * 8);
+
+    w = diy_fp_multiply(diy_fp_normalize(v), c_mk);
+    w_plus = diy_fp_multiply(w_plus, c_mk);
+    w_minus = diy_fp_multiply(w_minus, c_mk);
+    w_minus.f++;
+    w_plus.f--;
+    return grisu_digit_gen(w, w_plus, w_plus.f - w_minus.f, digits, k);
+}
+
+static int writer_begin_value(json_writer_t* writer, int max_len)
+{
+    uint64_t level_bit;
+    if(!writer->cursor || writer->overflow)
+    {
+        return 0;
+    }
+    level_bit = 1ULL << writer->depth; // (depth is below 64 unless overflow is set)
+
+    if(writer->end - writer->cursor < max_len + 3) // (value, separator and null)
+    {
+        writer->overflow = 1;
+        return 0;
+    }
+
+    if(writer->after_key)
+    {
+        writer->after_key = 0; // value of a member: separator was written before the key
+    }
+    else
+    {
+        if(writer->depth > 0 && (writer->has_members & level_bit))
+        {
+            writer->cursor = append_str(writer->cursor, ", ", 2);
+        }
+        writer->has_members |= level_bit;
+    }
+    return 1;
+}
+
+static void writer_open(json_writer_t* writer, char bracket)
+{
+    if(writer_begin_value(writer, 1))
+    {
+        if(writer->depth + 1 >= 64)
+        {
+            writer->overflow = 1; // nested too deep (bit per level in has_members)
+            return;
+        }
+        *writer->cursor++ = bracket;
+        *writer->cursor = 0;
+        writer->depth++;
+        writer->has_members &= ~(1ULL << writer->depth);
+    }
+}
+
+static void writer_close(json_writer_t* writer, char bracket)
+{
+    if(writer->cursor && !writer->overflow)
+    {
+        if(writer->end - writer->cursor < 2 || writer->depth <= 0)
+        {
+            writer->overflow = 1;
+            return;
+        }
+        *writer->cursor++ = bracket;
+        *writer->cursor = 0;
+        writer->depth--;
+    }
+}
+
+static int find_member(const char* member_name, const char* input, int input_len, json_token_info_t* token_info,
+                       int* steps_left)
+{
+    int curr_pos = 0;
+    reset_token_info(token_info);
+
+    while(take_step(steps_left))
+    {
+        curr_pos = json_find_next_member(curr_pos,
+                                         input,
+                                         input_len,
+                                         token_info);
+        if(!token_info->values_len)
+        {
+            break;
+        }
+        else
+        {
+            if(str_are_equal(input+token_info->name_start, token_info->name_len, member_name))
+            {
+                return 1;
+            }
+        }
+
+        if(json_next_member_is_object_or_list(input, token_info))
+        {
+            curr_pos = token_info->values_start+1; // move past objects/list boundaries
+        }
+    };
+    reset_token_info(token_info);
+    return 0;
+}
+
+static int find_member(int member_no_zero_based, const char* input, int input_len, json_token_info_t* token_info,
+                       int* steps_left)
+{
+    int curr_param_no = 0;
+    int curr_pos = 0;
+
+    reset_token_info(token_info);
+    token_info->values_len = input_len;
+    if(json_next_member_is_object_or_list(input, token_info)) // if it's object or list, enter..
+    {
+        curr_pos = token_info->values_start+1; // move past the list begin
+    }
+
+    while(take_step(steps_left))
+    {
+        curr_pos = json_find_next_member(curr_pos,
+                                         input,
+                                         input_len,
+                                         token_info);
+        if(!token_info->values_len)
+        {
+            break;
+        }
+        else
+        {
+            if(curr_param_no == member_no_zero_based)
+            {
+                return 1;
+            }
+            curr_param_no++;
+        }
+    };
+    reset_token_info(token_info);
+    return 0;
+}
+
+static int take_step(int* steps_left)
+{
+    if(!steps_left || *steps_left < 0)
+    {
+        return 1; // (not limited)
+    }
+    if(*steps_left == 0)
+    {
+        return 0;
+    }
+    (*steps_left)--;
+    return 1;
+}
+
+static const char* find_param(const char* param_name, int member_no_zero_based, rpc_request_info_t* info,
+                              json_token_info_t* token)
+{
+    // params are searched for (by name, or by position if there's no name) within params of the request only,
+    // taking steps from the budget of the request
+    const char* params = info->data->request + info->params_start;
+    int found = param_name ? find_member(param_name, params, info->params_len, token, &info->steps_left) :
+                             find_member(member_no_zero_based, params, info->params_len, token, &info->steps_left);
+    return found ? params + token->values_start : 0;
+}
+
+static const char* find_param_path(const json_path_t* path, rpc_request_info_t* info, json_token_info_t* token)
+{
+    const char* params = info->data->request + info->params_start;
+    int params_len = info->params_len;
+    int pos = skip_whitespace(params, 0, params_len);
+
+    // (named params passed as the first member of a list: [{...}])
+    if(path->num_of_segments && path->segments[0].index < 0 && pos < params_len && params[pos] == '[')
+    {
+        pos = skip_whitespace(params, pos + 1, params_len);
+        params += pos;
+        params_len -= pos;
+    }
+    return find_path(path, params, params_len, token, &info->steps_left) ? params + token->values_start : 0;
+}
+
+static int find_path(const json_path_t* path, const char* input, int input_len, json_token_info_t* token,
+                     int* steps_left)
+{
+    // walks down the path: members that are not on the path are skipped as a whole (not looked into),
+    // so the input is scanned once at most
+    const json_path_segment_t* segment;
+    int pos = skip_whitespace(input, 0, input_len);
+    int key_start = 0;
+    int key_len = 0;
+    int matched;
+    int index;
+    int end;
+    int i;
+    char open;
+
+    reset_token_info(token);
+    for(i = 0; i < path->num_of_segments; i++)
+    {
+        segment = &path->segments[i];
+        if(pos >= input_len || (input[pos] != '{' && input[pos] != '['))
+        {
+            return 0;
+        }
+        open = input[pos];
+        pos = skip_whitespace(input, pos + 1, input_len);
+
+        for(index = 0; ; index++)
+        {
+            if(pos >= input_len || input[pos] == '}' || input[pos] == ']' || !take_step(steps_left))
+            {
+                return 0;
+            }
+            if(open == '{')
+            {
+                if(input[pos] != '\"')
+                {
+                    return 0;
+                }
+                key_start = pos + 1;
+                pos = skip_json_string(input, pos, input_len);
+                if(pos < 0)
+                {
+                    return 0;
+                }
+                key_len = pos - 1 - key_start;
+                matched = key_len == segment->name_len &&
+                          bytes_are_equal(input + key_start, path->names + segment->name_start, key_len);
+                pos = skip_whitespace(input, pos, input_len);
+                if(pos >= input_len || input[pos] != ':')
+                {
+                    return 0;
+                }
+                pos = skip_whitespace(input, pos + 1, input_len);
+            }
+            else
+            {
+                matched = (index == segment->index);
+            }
+
+            if(matched)
+            {
+                break; // (enter this value)
+            }
+            pos = skip_json_value(input, pos, input_len);
+            if(pos < 0)
+            {
+                return 0;
+            }
+            pos = skip_whitespace(input, pos, input_len);
+            if(pos < input_len && input[pos] == ',')
+            {
+                pos = skip_whitespace(input, pos + 1, input_len);
+            }
+        }
+        token->name_start = (open == '{') ? key_start : 0;
+        token->name_len = (open == '{') ? key_len : 0;
+    }
+
+    end = skip_json_value(input, pos, input_len);
+    if(end <= pos)
+    {
+        reset_token_info(token);
+        return 0;
+    }
+    value_to_token(input, pos, end, token);
+    return 1;
+}
+
+static void value_to_token(const char* input, int start, int end, json_token_info_t* token)
+{
+    int i;
+    token->values_start = start;
+    token->values_len = end - start;
+    token->values_flags = 0;
+    if(input[start] == '\"')
+    {
+        token->values_start++;
+        token->values_len -= 2;
+        for(i = start + 1; i < end - 1; i++)
+        {
+            if(input[i] == '\\')
+            {
+                token->values_flags |= json_value_has_escapes;
+                break;
+            }
+        }
+    }
+}
+
+static int extract_paths(const json_path_set_t* set, json_str_view_t* slots, const char* input, int input_len,
+                         int* steps_left)
+{
+    json_token_info_t token;
+    int found = 0;
+    int pos = skip_whitespace(input, 0, input_len);
+    int end;
+    int i;
+
+    for(i = 0; i < set->num_of_paths; i++)
+    {
+        slots[i].start = 0;
+        slots[i].len = 0;
+        slots[i].has_escapes = 0;
+    }
+    if(!set->num_of_nodes || pos >= input_len)
+    {
+        return 0;
+    }
+
+    if(set->nodes[0].first_child >= 0 && (input[pos] == '{' || input[pos] == '['))
+    {
+        end = walk_paths(set, 0, slots, input, pos, input_len, &found, steps_left);
+    }
+    else
+    {
+        end = skip_json_value(input, pos, input_len);
+    }
+    if(set->nodes[0].slot >= 0 && end > pos) // (empty path: the whole input)
+    {
+        value_to_token(input, pos, end, &token);
+        slots[set->nodes[0].slot].start = input + token.values_start;
+        slots[set->nodes[0].slot].len = token.values_len;
+        slots[set->nodes[0].slot].has_escapes = token.values_flags & json_value_has_escapes;
+        found++;
+    }
+    return found;
+}
+
+static int walk_paths(const json_path_set_t* set, int node_no, json_str_view_t* slots, const char* input, int pos,
+                      int input_len, int* found, int* steps_left)
+{
+    // pos is at the beginning of an object / list: its members that are on any path are looked into
+    // (or their values are stored in slots), others are skipped as a whole.
+    // Returns position just past the object / list, -1 on error, or -2 when all values were found.
+    const json_path_node_t* nodes = set->nodes;
+    json_token_info_t token;
+    char open = input[pos];
+    int value_start;
+    int key_start;
+    int key_len;
+    int child;
+    int index;
+    int end;
+
+    pos = skip_whitespace(input, pos + 1, input_len);
+    for(index = 0; ; index++)
+    {
+        if(pos >= input_len)
+        {
+            return -1;
+        }
+        if(input[pos] == '}' || input[pos] == ']')
+        {
+            return pos + 1;
+        }
+        if(!take_step(steps_left))
+        {
+            return -1;
+        }
+
+        child = nodes[node_no].first_child;
+        if(open == '{')
+        {
+            if(input[pos] != '\"')
+            {
+                return -1;
+            }
+            key_start = pos + 1;
+            pos = skip_json_string(input, pos, input_len);
+            if(pos < 0)
+            {
+                return -1;
+            }
+            key_len = pos - 1 - key_start;
+            while(child >= 0 &&
+                  (nodes[child].name_len != key_len || !bytes_are_equal(nodes[child].name, input + key_start, key_len)))
+            {
+                child = nodes[child].next_sibling;
+            }
+            pos = skip_whitespace(input, pos, input_len);
+            if(pos >= input_len || input[pos] != ':')
+            {
+                return -1;
+            }
+            pos = skip_whitespace(input, pos + 1, input_len);
+        }
+        else
+        {
+            while(child >= 0 && nodes[child].index != index)
+            {
+                child = nodes[child].next_sibling;
+            }
+        }
+
+        value_start = pos;
+        if(child >= 0 && nodes[child].first_child >= 0 && pos < input_len && (input[pos] == '{' || input[pos] == '['))
+        {
+            end = walk_paths(set, child, slots, input, pos, input_len, found, steps_left);
+        }
+        else
+        {
+            end = skip_json_value(input, pos, input_len);
+        }
+        if(end < 0)
+        {
+            return end;
+        }
+
+        if(child >= 0 && nodes[child].slot >= 0 && end > value_start && !slots[nodes[child].slot].start)
+        {
+            value_to_token(input, value_start, end, &token);
+            slots[nodes[child].slot].start = input + token.values_start;
+            slots[nodes[child].slot].len = token.values_len;
+            slots[nodes[child].slot].has_escapes = token.values_flags & json_value_has_escapes;
+            if(++(*found) == set->num_of_paths)
+            {
+                return -2; // (nothing more to look for)
+            }
+        }
+
+        pos = skip_whitespace(input, end, input_len);
+        if(pos < input_len && input[pos] == ',')
+        {
+            pos = skip_whitespace(input, pos + 1, input_len);
+        }
+    }
+}
+
+static int skip_json_value(const char* input, int pos, int input_len)
+{
+    // (returns position just past the value, or -1): objects and lists are skipped as a whole
+    int depth = 0;
+    for(; pos < input_len; pos++)
+    {
+        switch(input[pos])
+        {
+        case '\"':
+            pos = skip_json_string(input, pos, input_len);
+            if(pos < 0)
+            {
+                return -1;
+            }
+            if(!depth)
+            {
+                return pos;
+            }
+            pos--;
+            break;
+
+        case '{':
+        case '[':
+            depth++;
+            break;
+
+        case '}':
+        case ']':
+            if(!depth)
+            {
+                return pos; // (end of the enclosing object / list)
+            }
+            if(!--depth)
+            {
+                return pos + 1;
+            }
+            break;
+
+        case ',':
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+            if(!depth)
+            {
+                return pos;
+            }
+            break;
+        }
+    }
+    return depth ? -1 : pos;
+}
+
+static int hex_to_uint(const char* from, int len, int num_of_digits, uint32_t* result)
+{
+    int value = 0;
+    int i;
+    *result = 0;
+    if(len < num_of_digits)
+    {
+        return 0;
+    }
+    for(i = 0; i < num_of_digits; i++)
+    {
+        if(!int_val(from[i], &value))
+        {
+            return 0;
+        }
+        *result = (*result << 4) | (uint32_t)value;
+    }
+    return 1;
+}
+
+static char* encode_utf8(char* to, uint32_t code_point)
+{
+    if(code_point < 0x80)
+    {
+        *to++ = (char)code_point;
+    }
+    else if(code_point < 0x800)
+    {
+        *to++ = (char)(0xC0 | (code_point >> 6));
+        *to++ = (char)(0x80 | (code_point & 0x3F));
+    }
+    else if(code_point < 0x10000)
+    {
+        *to++ = (char)(0xE0 | (code_point >> 12));
+        *to++ = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        *to++ = (char)(0x80 | (code_point & 0x3F));
+    }
+    else
+    {
+        *to++ = (char)(0xF0 | (code_point >> 18));
+        *to++ = (char)(0x80 | ((code_point >> 12) & 0x3F));
+        *to++ = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        *to++ = (char)(0x80 | (code_point & 0x3F));
+    }
+    return to;
+}
+
+static int skip_whitespace(const char* input, int start_at, int input_len)
+{
+    while(start_at < input_len &&
+          (input[start_at] == ' ' || input[start_at] == '\n' || input[start_at] == '\r' || input[start_at] == '\t'))
+    {
+        start_at++;
+    }
+    return start_at;
+}
+
+static int validate_string(const char* input, int start_at, int input_len)
+{
+    const uint64_t highs = 0x8080808080808080ULL;
+    uint64_t chars;
+    uint32_t code_point;
+    unsigned char curr;
+
+    if(start_at >= input_len || input[start_at] != '\"')
+    {
+        return -1;
+    }
+    start_at++;
+
+    while(true)
+    {
+        // skip runs of plain ASCII characters (the most common case) 8 at a time
+        while(input_len - start_at >= 8)
+        {
+            chars = load_8_chars(input + start_at);
+            if((chars & highs) || need_escaping(chars))
+            {
+                break;
+            }
+            start_at += 8;
+        }
+
+        if(start_at >= input_len)
+        {
+            return -1;
+        }
+
+        curr = (unsigned char)input[start_at];
+        if(curr == '\"')
+        {
+            return start_at + 1;
+        }
+        else if(curr == '\\')
+        {
+            if(start_at + 1 >= input_len)
+            {
+                return -1;
+            }
+            switch(input[start_at + 1])
+            {
+            case '\"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+                start_at += 2;
+                break;
+
+            case 'u':
+                if(!hex_to_uint(input + start_at + 2, input_len - start_at - 2, 4, &code_point))
+                {
+                    return -1;
+                }
+                start_at += 6;
+                break;
+
+            default:
+                return -1;
+            }
+        }
+        else if(curr < 0x20) // control characters must be escaped
+        {
+            return -1;
+        }
+        else if(curr >= 0x80)
+        {
+            start_at = validate_utf8_char(input, start_at, input_len);
+            if(start_at < 0)
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            start_at++;
+        }
+    }
+}
+
+static int validate_utf8_char(const char* input, int start_at, int input_len)
+{
+    // well-formed UTF-8 byte sequences as per Unicode standard (table 3-7):
+    // no overlong encodings, no surrogates and nothing above U+10FFFF
+    const unsigned char* p = (const unsigned char*)input + start_at;
+    int len;
+    unsigned char second_min = 0x80;
+    unsigned char second_max = 0xBF;
+    int i;
+
+    if(p[0] >= 0xC2 && p[0] <= 0xDF)
+    {
+        len = 2;
+    }
+    else if(p[0] >= 0xE0 && p[0] <= 0xEF)
+    {
+        len = 3;
+        if(p[0] == 0xE0)
+        {
+            second_min = 0xA0;
+        }
+        else if(p[0] == 0xED)
+        {
+            second_max = 0x9F;
+        }
+    }
+    else if(p[0] >= 0xF0 && p[0] <= 0xF4)
+    {
+        len = 4;
+        if(p[0] == 0xF0)
+        {
+            second_min = 0x90;
+        }
+        else if(p[0] == 0xF4)
+        {
+            second_max = 0x8F;
+        }
+    }
+    else
+    {
+        return -1;
+    }
+
+    if(input_len - start_at < len || p[1] < second_min || p[1] > second_max)
+    {
+        return -1;
+    }
+    for(i = 2; i < len; i++)
+    {
+        if((p[i] & 0xC0) != 0x80)
+        {
+            return -1;
+        }
+    }
+    return start_at + len;
+}
+
+static int validate_number(const char* input, int start_at, int input_len)
+{
+    int digits_start;
+    if(start_at < input_len && input[start_at] == '-')
+    {
+        start_at++;
+    }
+
+    // int part: 0 or digits without leading zeros
+    if(start_at < input_len && input[start_at] == '0')
+    {
+        start_at++;
+    }
+    else
+    {
+        digits_start = start_at;
+        while(start_at < input_len && input[start_at] >= '0' && input[start_at] <= '9')
+        {
+            start_at++;
+        }
+        if(start_at == digits_start)
+        {
+            return -1;
+        }
+    }
+
+    if(start_at < input_len && input[start_at] == '.') // fraction
+    {
+        digits_start = ++start_at;
+        while(start_at < input_len && input[start_at] >= '0' && input[start_at] <= '9')
+        {
+            start_at++;
+        }
+        if(start_at == digits_start)
+        {
+            return -1;
+        }
+    }
+
+    if(start_at < input_len && (input[start_at] == 'e' || input[start_at] == 'E')) // exponent
+    {
+        start_at++;
+        if(start_at < input_len && (input[start_at] == '+' || input[start_at] == '-'))
+        {
+            start_at++;
+        }
+        digits_start = start_at;
+        while(start_at < input_len && input[start_at] >= '0' && input[start_at] <= '9')
+        {
+            start_at++;
+        }
+        if(start_at == digits_start)
+        {
+            return -1;
+        }
+    }
+    return start_at;
+}
+
+static int validate_literal(const char* input, int start_at, int input_len)
+{
+    static const char* literals[] = {"true", "false", "null"};
+    const char* literal;
+    int i;
+    int j;
+    for(i = 0; i < 3; i++)
+    {
+        literal = literals[i];
+        for(j = 0; literal[j] && start_at + j < input_len && input[start_at + j] == literal[j]; j++)
+        {
+        }
+        if(!literal[j])
+        {
+            return start_at + j;
+        }
+    }
+    return -1;
+}
+
+static int highest_bit(uint64_t value)
+{
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while(value >>= 1)
+    {
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+static void update_stats(json_rpc_instance_t* self, int fcn_id, rpc_request_info_t* info,
+                         uint64_t parse_started, uint64_t handler_started)
+{
+    json_rpc_method_stats_t* stats;
+    uint64_t handler_finished;
+
+    if(fcn_id >= 0 && fcn_id < self->num_of_stats - 1)
+    {
+        stats = &self->stats[fcn_id];
+    }
+    else
+    {
+        stats = &self->stats[self->num_of_stats - 1]; // not dispatched
+    }
+
+    RELAXED_ADD(&stats->calls, 1);
+    if(info->error >= 0 && info->error <= json_rpc_num_of_errors)
+    {
+        RELAXED_ADD(&stats->errors[info->error], 1);
+    }
+
+    if(self->clock && parse_started)
+    {
+        handler_finished = self->clock();
+        RELAXED_ADD(&stats->parse_time, handler_started - parse_started);
+        RELAXED_ADD(&stats->handler_time, handler_finished - handler_started);
+        RELAXED_ADD(&stats->latency[json_rpc_latency_bucket(handler_finished - parse_started)], 1);
+    }
+}
+
+static int limit_admit(json_rpc_limit_t* limit)
+{
+    uint64_t now;
+    uint64_t next_call_time;
+    uint64_t earliest;
+
+    if(limit->max_in_flight && SEQ_CST_FETCH_ADD(&limit->in_flight, 1) >= limit->max_in_flight)
+    {
+        SEQ_CST_FETCH_ADD(&limit->in_flight, -1);
+        return 0;
+    }
+
+    if(limit->interval && limit->clock)
+    {
+        // rate limit (GCRA): each call moves the 'next call time' by the interval,
+        // calls are allowed if it's not further in the future than the burst tolerance
+        now = limit->clock();
+        next_call_time = RELAXED_LOAD(&limit->next_call_time);
+        do
+        {
+            earliest = next_call_time > now ? next_call_time : now;
+            if(earliest - now > limit->burst_tolerance)
+            {
+                if(limit->max_in_flight)
+                {
+                    SEQ_CST_FETCH_ADD(&limit->in_flight, -1);
+                }
+                return 0;
+            }
+        } while(!COMPARE_EXCHANGE(&limit->next_call_time, &next_call_time, earliest + limit->interval));
+    }
+    return 1;
+}
+
+static int handler_priority(const json_rpc_handler_t* handler)
+{
+    if(handler->flags & json_rpc_handler_priority_high)
+    {
+        return json_rpc_priority_high;
+    }
+    if(handler->flags & json_rpc_handler_priority_low)
+    {
+        return json_rpc_priority_low;
+    }
+    return json_rpc_priority_normal;
+}
+
+static int next_batch_pass(int* pass, int num_of_passes, int* next_r_pos, int batch_start)
+{
+    if(++(*pass) < num_of_passes)
+    {
+        *next_r_pos = batch_start;
+        return 1;
+    }
+    return 0;
+}
+
+static int request_priority(json_rpc_instance_t* self, json_rpc_data_t* request_data)
+{
+    // the lowest priority of methods of the request (or of requests in a batch)
+    const char* input = request_data->request;
+    json_token_info_t request_token;
+    int priority = json_rpc_priority_high;
+    int next_pos = skip_all_of(input, 0, request_data->request_len, " \n\r\t", 0);
+    int member_prio;
+
+    reset_token_info(&request_token);
+    request_token.values_start = next_pos;
+    request_token.values_len = request_data->request_len - next_pos;
+    if(json_next_member_is_list(input, &request_token))
+    {
+        next_pos++;
+    }
+
+    while(next_pos < request_data->request_len)
+    {
+        next_pos = json_find_next_member(next_pos, input, request_data->request_len, &request_token);
+        if(!request_token.values_len)
+        {
+            break;
+        }
+        member_prio = member_priority(self, input, &request_token);
+        priority = member_prio > priority ? member_prio : priority;
+    }
+    return priority;
+}
+
+static int member_priority(json_rpc_instance_t* self, const char* input, const json_token_info_t* request_token)
+{
+    // priority of the method of a request (normal, if it is not known)
+    json_token_info_t member_token;
+    int curr_pos = request_token->values_start + 1;
+    int end_pos = request_token->values_start + request_token->values_len;
+    int fcn_id = -1;
+
+    while(curr_pos < end_pos)
+    {
+        curr_pos = json_find_next_member(curr_pos, input, end_pos, &member_token);
+        if(member_token.name_start <= 0)
+        {
+            break;
+        }
+        if(get_obj_id(input, &member_token) == method)
+        {
+            fcn_id = get_fcn_id(self, input, &member_token);
+            break;
+        }
+    }
+    return fcn_id < 0 ? json_rpc_priority_normal : handler_priority(&self->handlers[fcn_id]);
+}
+
+static int queue_push(json_rpc_queue_t* queue, json_rpc_data_t* request)
+{
+    // bounded queue (by D. Vyukov): slot's sequence number tells if it can be written or read
+    json_rpc_queue_slot_t* slot;
+    uint32_t pos = RELAXED_LOAD(&queue->tail);
+    int32_t diff;
+
+    while(true)
+    {
+        slot = &queue->slots[pos & queue->mask];
+        diff = (int32_t)(ACQUIRE_LOAD(&slot->seq) - pos);
+        if(diff == 0)
+        {
+            if(COMPARE_EXCHANGE(&queue->tail, &pos, pos + 1))
+            {
+                break;
+            }
+        }
+        else if(diff < 0)
+        {
+            return 0; // full
+        }
+        else
+        {
+            pos = RELAXED_LOAD(&queue->tail);
+        }
+    }
+    slot->request = request;
+    RELEASE_STORE(&slot->seq, pos + 1);
+    return 1;
+}
+
+static json_rpc_data_t* queue_pop(json_rpc_queue_t* queue)
+{
+    json_rpc_queue_slot_t* slot;
+    json_rpc_data_t* request;
+    uint32_t pos = RELAXED_LOAD(&queue->head);
+    int32_t diff;
+
+    while(true)
+    {
+        slot = &queue->slots[pos & queue->mask];
+        diff = (int32_t)(ACQUIRE_LOAD(&slot->seq) - (pos + 1));
+        if(diff == 0)
+        {
+            if(COMPARE_EXCHANGE(&queue->head, &pos, pos + 1))
+            {
+                break;
+            }
+        }
+        else if(diff < 0)
+        {
+            return 0; // empty
+        }
+        else
+        {
+            pos = RELAXED_LOAD(&queue->head);
+        }
+    }
+    request = slot->request;
+    RELEASE_STORE(&slot->seq, pos + queue->mask + 1);
+    return request;
+}
+
+static char* handle_msgpack_request(json_rpc_instance_t* self, json_rpc_data_t* request_data)
+{
+    // request is converted to JSON, which is then moved to the end of the response buffer (and handled),
+    // and the response is moved to the end of the buffer, to be converted to MessagePack in its beginning
+    char* buffer = request_data->response;
+    int buffer_len = request_data->response_len;
+    json_rpc_data_t json_data = *request_data;
+    rpc_request_info_t request_info;
+    int len;
+
+    if(!buffer || buffer_len < 2)
+    {
+        return buffer;
+    }
+
+    json_data.response = buffer;
+    len = json_from_msgpack(request_data->request, request_data->request_len, buffer, buffer_len);
+    if(len < 0)
+    {
+        buffer[0] = 0;
+        request_info.data = &json_data;
+        request_info.info_flags = rpc_request_is_rpc_20;
+        request_info.id_start = -1;
+        json_rpc_create_error(json_rpc_err_parse_error, &request_info);
+        if(self->stats)
+        {
+            update_stats(self, -1, &request_info, 0, 0);
+        }
+    }
+    else
+    {
+        move_bytes(buffer + buffer_len - len - 1, buffer, len + 1);
+        json_data.request = buffer + buffer_len - len - 1;
+        json_data.request_len = len;
+        json_data.response_len = buffer_len - len - 1;
+        handle_json_request(self, &json_data, 1); // (string ids are written as strings, to be converted back)
+    }
+
+    len = str_len(buffer);
+    if(len)
+    {
+        move_bytes(buffer + buffer_len - len, buffer, len);
+        if(json_to_msgpack(buffer + buffer_len - len, len, buffer, buffer_len) < 0)
+        {
+            buffer[0] = 0; // (didn't fit)
+        }
+    }
+    return buffer;
+}
+
+static void move_bytes(char* to, const char* from, int len)
+{
+#if defined(__GNUC__)
+    __builtin_memmove(to, from, len);
+#else
+    if(to < from)
+    {
+        while(len-- > 0)
+        {
+            *to++ = *from++;
+        }
+    }
+    else
+    {
+        while(len-- > 0)
+        {
+            to[len] = from[len];
+        }
+    }
+#endif
+}
+
+static int msgpack_to_json(const unsigned char* input, int pos, int input_len, char** to, char* to_end, int depth)
+{
+    char* out = *to;
+    unsigned char type;
+    uint64_t value;
+    uint32_t count;
+    uint32_t i;
+    int num_of_bytes;
+    int shift;
+    int is_map;
+    union
+    {
+        double d;
+        uint64_t u;
+    } bits;
+    union
+    {
+        float f;
+        uint32_t u;
+    } bits32;
+
+    if(pos >= input_len || depth > JSON_RPC_MSGPACK_MAX_DEPTH)
+    {
+        return -1;
+    }
+
+    type = input[pos++];
+    if(type <= 0x7f || type >= 0xe0 || (type >= 0xcc && type <= 0xd3)) // integers
+    {
+        if(to_end - out < JSON_FORMAT_INT_MAX_LEN + 1)
+        {
+            return -1;
+        }
+        if(type <= 0x7f)
+        {
+            out = format_uint(out, type);
+        }
+        else if(type >= 0xe0)
+        {
+            out = json_format_int(out, (int8_t)type);
+        }
+        else
+        {
+            num_of_bytes = 1 << ((type - 0xcc) & 3);
+            if(input_len - pos < num_of_bytes)
+            {
+                return -1;
+            }
+            value = load_be(input + pos, num_of_bytes);
+            pos += num_of_bytes;
+            if(type <= 0xcf)
+            {
+                out = format_uint(out, value);
+            }
+            else
+            {
+                shift = 64 - 8 * num_of_bytes; // (sign extension)
+                out = json_format_int(out, (int64_t)(value << shift) >> shift);
+            }
+        }
+    }
+    else if((type >= 0xa0 && type <= 0xbf) || (type >= 0xd9 && type <= 0xdb)) // strings
+    {
+        num_of_bytes = type <= 0xbf ? 0 : 1 << (type - 0xd9);
+        if(input_len - pos < num_of_bytes)
+        {
+            return -1;
+        }
+        value = type <= 0xbf ? (type & 0x1f) : load_be(input + pos, num_of_bytes);
+        pos += num_of_bytes;
+        if((uint64_t)(input_len - pos) < value || (uint64_t)(to_end - out) < value * 6 + 2) // (if all escaped)
+        {
+            return -1;
+        }
+        out = json_format_str(out, (const char*)input + pos, (int)value);
+        pos += (int)value;
+    }
+    else if((type >= 0x80 && type <= 0x9f) || (type >= 0xdc && type <= 0xdf)) // arrays and maps
+    {
+        is_map = (type <= 0x8f || type >= 0xde);
+        num_of_bytes = type <= 0x9f ? 0 : (type & 1) ? 4 : 2;
+        if(input_len - pos < num_of_bytes || out >= to_end)
+        {
+            return -1;
+        }
+        count = type <= 0x9f ? (type & 0x0f) : (uint32_t)load_be(input + pos, num_of_bytes);
+        pos += num_of_bytes;
+
+        *out++ = is_map ? '{' : '[';
+        for(i = 0; i < count; i++)
+        {
+            if(i)
+            {
+                if(out >= to_end)
+                {
+                    return -1;
+                }
+                *out++ = ',';
+            }
+            if(is_map)
+            {
+                if(pos >= input_len || !((input[pos] >= 0xa0 && input[pos] <= 0xbf) ||
+                                         (input[pos] >= 0xd9 && input[pos] <= 0xdb)))
+                {
+                    return -1; // (keys have to be strings)
+                }
+                pos = msgpack_to_json(input, pos, input_len, &out, to_end, depth + 1);
+                if(pos < 0 || out >= to_end)
+                {
+                    return -1;
+                }
+                *out++ = ':';
+            }
+            pos = msgpack_to_json(input, pos, input_len, &out, to_end, depth + 1);
+            if(pos < 0)
+            {
+                return -1;
+            }
+        }
+        if(out >= to_end)
+        {
+            return -1;
+        }
+        *out++ = is_map ? '}' : ']';
+    }
+    else if(type == 0xca || type == 0xcb) // floating point
+    {
+        num_of_bytes = (type == 0xca) ? 4 : 8;
+        if(input_len - pos < num_of_bytes || to_end - out < JSON_FORMAT_DOUBLE_MAX_LEN + 1)
+        {
+            return -1;
+        }
+        if(type == 0xca)
+        {
+            bits32.u = (uint32_t)load_be(input + pos, 4);
+            bits.d = bits32.f;
+        }
+        else
+        {
+            bits.u = load_be(input + pos, 8);
+        }
+        pos += num_of_bytes;
+        out = json_format_double(out, bits.d);
+    }
+    else if(type == 0xc0 || type == 0xc2 || type == 0xc3) // nil, false, true
+    {
+        if(to_end - out < 5)
+        {
+            return -1;
+        }
+        out = append_str(out, type == 0xc0 ? "null" : type == 0xc2 ? "false" : "true");
+    }
+    else
+    {
+        return -1; // bin, ext (not supported)
+    }
+
+    *to = out;
+    return pos;
+}
+
+static int skip_msgpack(const unsigned char* input, int pos, int input_len, int depth)
+{
+    // (returns position just past the value, or -1)
+    unsigned char type;
+    uint64_t len = 0;
+    uint64_t count = 0;
+    int num_of_bytes = 0;
+
+    if(pos >= input_len || depth > JSON_RPC_MSGPACK_MAX_DEPTH)
+    {
+        return -1;
+    }
+    type = input[pos++];
+    if(type <= 0x7f || type >= 0xe0 || type == 0xc0 || type == 0xc2 || type == 0xc3)
+    {
+        return pos;
+    }
+    if(type >= 0xa0 && type <= 0xbf)
+    {
+        len = type & 0x1f;
+    }
+    else if(type >= 0x80 && type <= 0x9f)
+    {
+        count = (type & 0x0f) * ((type <= 0x8f) ? 2 : 1);
+    }
+    else if(type >= 0xcc && type <= 0xd3)
+    {
+        len = 1 << ((type - 0xcc) & 3);
+    }
+    else if(type >= 0xd4 && type <= 0xd8) // fixext
+    {
+        len = 1 + (1 << (type - 0xd4));
+    }
+    else if(type == 0xca || type == 0xcb)
+    {
+        len = (type == 0xca) ? 4 : 8;
+    }
+    else
+    {
+        // length follows: bin (c4..c6), ext (c7..c9), str (d9..db), array / map (dc..df)
+        num_of_bytes = (type <= 0xc9) ? 1 << ((type - 0xc4) % 3) :
+                       (type <= 0xdb) ? 1 << (type - 0xd9) : (type & 1) ? 4 : 2;
+        if(type == 0xc1 || input_len - pos < num_of_bytes)
+        {
+            return -1;
+        }
+        len = load_be(input + pos, num_of_bytes);
+        pos += num_of_bytes;
+        if(type >= 0xc7 && type <= 0xc9)
+        {
+            len++; // (ext type)
+        }
+        else if(type >= 0xdc)
+        {
+            count = len * ((type >= 0xde) ? 2 : 1);
+            len = 0;
+        }
+    }
+
+    if((uint64_t)(input_len - pos) < len)
+    {
+        return -1;
+    }
+    pos += (int)len;
+    while(count-- > 0 && pos >= 0)
+    {
+        pos = skip_msgpack(input, pos, input_len, depth + 1);
+    }
+    return pos;
+}
+
+static int json_to_msgpack_value(msgpack_writer_t* writer, int pos, int input_len, int depth)
+{
+    const char* input = writer->input;
+    char* out;
+    char closing;
+    int type;
+    int count;
+    int header_len;
+    int str_end;
+    int i;
+
+    if(pos >= input_len || depth > JSON_RPC_MSGPACK_MAX_DEPTH)
+    {
+        return -1;
+    }
+
+    switch(input[pos])
+    {
+    case '{':
+    case '[':
+        type = (input[pos] == '{') ? msgpack_map : msgpack_array;
+        closing = (input[pos] == '{') ? '}' : ']';
+        count = count_json_members(input, pos, input_len);
+        header_len = msgpack_header_len(type, count);
+        out = (count < 0) ? 0 : msgpack_reserve(writer, pos + 1, header_len);
+        if(!out)
+        {
+            return -1;
+        }
+        msgpack_put_header(out, type, header_len, count);
+
+        pos = skip_whitespace(input, pos + 1, input_len);
+        for(i = 0; i < count; i++)
+        {
+            if(type == msgpack_map)
+            {
+                if(pos >= input_len || input[pos] != '\"')
+                {
+                    return -1;
+                }
+                pos = json_to_msgpack_value(writer, pos, input_len, depth + 1);
+                pos = (pos < 0) ? input_len : skip_whitespace(input, pos, input_len);
+                if(pos >= input_len || input[pos] != ':')
+                {
+                    return -1;
+                }
+                pos = skip_whitespace(input, pos + 1, input_len);
+            }
+            pos = json_to_msgpack_value(writer, pos, input_len, depth + 1);
+            if(pos < 0)
+            {
+                return -1;
+            }
+            pos = skip_whitespace(input, pos, input_len);
+            if(pos >= input_len || input[pos] != ((i + 1 < count) ? ',' : closing))
+            {
+                return -1;
+            }
+            pos = skip_whitespace(input, pos + 1, input_len);
+        }
+        return count ? pos : pos + 1; // (past the closing bracket)
+
+    case '\"':
+        str_end = skip_json_string(input, pos, input_len);
+        header_len = msgpack_header_len(msgpack_str, str_end - pos - 2); // (decoded string is not longer)
+        out = (str_end < 0) ? 0 : msgpack_reserve(writer, pos + 1, header_len);
+        count = out ? json_unescape(input + pos + 1, str_end - pos - 2, writer->out,
+                                    (int)(writer->out_end - writer->out)) : -1;
+        if(count < 0)
+        {
+            return -1;
+        }
+        msgpack_put_header(out, msgpack_str, header_len, count);
+        writer->out += count;
+        return str_end;
+
+    case 't':
+    case 'f':
+    case 'n':
+        for(i = 0; i < (int)(sizeof(msgpack_literals) / sizeof(msgpack_literals[0])); i++)
+        {
+            count = str_len(json_literals[i]);
+            if(input_len - pos >= count && bytes_are_equal(input + pos, json_literals[i], count))
+            {
+                out = msgpack_reserve(writer, pos + count, 1);
+                if(!out)
+                {
+                    return -1;
+                }
+                *out = (char)msgpack_literals[i];
+                return pos + count;
+            }
+        }
+        return -1;
+
+    default:
+        return json_number_to_msgpack(writer, pos, input_len);
+    }
+}
+
+static int json_number_to_msgpack(msgpack_writer_t* writer, int pos, int input_len)
+{
+    // integers (that fit in 64 bits) are encoded as integers, other numbers as float64
+    const char* input = writer->input;
+    const uint64_t max_before_digit = 1844674407370955161ULL; // ((2^64 - 1) / 10)
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int exponent_value = 0;
+    int exponent_negative = 0;
+    int negative = 0;
+    int is_integer = 1;
+    int num_of_digits = 0;
+    int digit;
+    char* out;
+    union
+    {
+        double d;
+        uint64_t u;
+    } bits;
+
+    if(pos < input_len && input[pos] == '-')
+    {
+        negative = 1;
+        pos++;
+    }
+
+    if(input_len - pos > 2 && input[pos] == '0' && (input[pos + 1] == 'x' || input[pos + 1] == 'X'))
+    {
+        // (hexadecimal integers are accepted in requests)
+        for(pos += 2; pos < input_len && int_val(input[pos], &digit) && !(mantissa >> 60); pos++)
+        {
+            mantissa = (mantissa << 4) | digit;
+            num_of_digits++;
+        }
+    }
+    else
+    {
+        for(; pos < input_len && input[pos] >= '0' && input[pos] <= '9'; pos++, num_of_digits++)
+        {
+            if(mantissa < max_before_digit || (mantissa == max_before_digit && input[pos] <= '5'))
+            {
+                mantissa = mantissa * 10 + (input[pos] - '0');
+            }
+            else
+            {
+                exponent++; // (too many digits for an integer)
+                is_integer = 0;
+            }
+        }
+        if(pos < input_len && input[pos] == '.')
+        {
+            is_integer = 0;
+            for(pos++; pos < input_len && input[pos] >= '0' && input[pos] <= '9'; pos++)
+            {
+                if(mantissa < max_before_digit || (mantissa == max_before_digit && input[pos] <= '5'))
+                {
+                    mantissa = mantissa * 10 + (input[pos] - '0');
+                    exponent--;
+                }
+            }
+        }
+        if(pos < input_len && (input[pos] == 'e' || input[pos] == 'E'))
+        {
+            is_integer = 0;
+            pos++;
+            if(pos < input_len && (input[pos] == '-' || input[pos] == '+'))
+            {
+                exponent_negative = (input[pos++] == '-');
+            }
+            for(; pos < input_len && input[pos] >= '0' && input[pos] <= '9'; pos++)
+            {
+                exponent_value = (exponent_value < 10000) ? exponent_value * 10 + (input[pos] - '0') : exponent_value;
+            }
+            exponent += exponent_negative ? -exponent_value : exponent_value;
+        }
+    }
+
+    if(!num_of_digits)
+    {
+        return -1;
+    }
+    if(is_integer && (!negative || mantissa <= (1ULL << 63)))
+    {
+        return msgpack_put_int(writer, pos, negative, mantissa) ? pos : -1;
+    }
+
+    bits.u = decimal_to_double_bits(mantissa, exponent);
+    bits.d = negative ? -bits.d : bits.d;
+
+    out = msgpack_reserve(writer, pos, 9);
+    if(!out)
+    {
+        return -1;
+    }
+    *out = (char)0xcb;
+    store_be(out + 1, bits.u, 8);
+    return pos;
+}
+
+static uint64_t decimal_to_double_bits(uint64_t mantissa, int exponent)
+{
+    // correctly rounded (to nearest, ties to even) double of mantissa * 10^exponent: an approximation
+    // is made using floating point, and it's corrected by comparing the decimal with halfway points
+    // between the approximation and its neighbours (exactly, using big integers); digits beyond the first 19
+    // are not taken into account (json_format_double() writes up to 17)
+    const uint64_t max_bits = 0x7fefffffffffffffULL; // (the largest finite double)
+    uint64_t m;
+    int twos;
+    int num_of_digits = 1;
+    int e = exponent;
+    int cmp;
+    union
+    {
+        double d;
+        uint64_t u;
+    } bits;
+
+    if(!mantissa)
+    {
+        return 0;
+    }
+    bits.d = (double)mantissa;
+    if(mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22)
+    {
+        // exact mantissa and power of 10: the result of one operation is correctly rounded
+        bits.d = (exponent >= 0) ? bits.d * exact_powers_of_10[exponent] : bits.d / exact_powers_of_10[-exponent];
+        return bits.u;
+    }
+    for(m = mantissa; m >= 10; m /= 10)
+    {
+        num_of_digits++;
+    }
+    if(exponent + num_of_digits > 310)
+    {
+        return 0x7ff0000000000000ULL; // (infinity)
+    }
+    if(exponent + num_of_digits < -324)
+    {
+        return 0;
+    }
+
+    for(; e > 22; e -= 22)
+    {
+        bits.d *= exact_powers_of_10[22];
+    }
+    for(; e < -22; e += 22)
+    {
+        bits.d /= exact_powers_of_10[22];
+    }
+    bits.d = (e >= 0) ? bits.d * exact_powers_of_10[e] : bits.d / exact_powers_of_10[-e];
+    if(bits.u > max_bits)
+    {
+        bits.u = max_bits; // (approximation overflowed)
+    }
+
+    while(true)
+    {
+        // approximation is m * 2^twos
+        m = bits.u & ((1ULL << 52) - 1);
+        twos = (int)(bits.u >> 52);
+        if(twos)
+        {
+            m |= (1ULL << 52);
+            twos -= 1075;
+        }
+        else
+        {
+            twos = -1074; // (subnormal)
+        }
+
+        // above the halfway point to the next double?
+        cmp = compare_decimal(mantissa, exponent, 2 * m + 1, twos - 1);
+        if(cmp > 0 || (cmp == 0 && (m & 1)))
+        {
+            if(bits.u == max_bits)
+            {
+                return 0x7ff0000000000000ULL;
+            }
+            bits.u++;
+            continue;
+        }
+
+        // below the halfway point to the previous one (which is closer at a power of 2)?
+        if(!bits.u)
+        {
+            return bits.u;
+        }
+        if(m == (1ULL << 52) && bits.u > (1ULL << 52))
+        {
+            cmp = compare_decimal(mantissa, exponent, 4 * m - 1, twos - 2);
+        }
+        else
+        {
+            cmp = compare_decimal(mantissa, exponent, 2 * m - 1, twos - 1);
+        }
+        if(cmp < 0 || (cmp == 0 && (m & 1)))
+        {
+            bits.u--;
+            continue;
+        }
+        return bits.u;
+    }
+}
+
+static int compare_decimal(uint64_t mantissa, int exponent, uint64_t value, int twos)
+{
+    // sign of (mantissa * 10^exponent - value * 2^twos), both sides are scaled to integers
+    big_num_t decimal;
+    big_num_t binary;
+    int decimal_twos = 0;
+    int i;
+
+    decimal.limbs[0] = (uint32_t)mantissa;
+    decimal.limbs[1] = (uint32_t)(mantissa >> 32);
+    decimal.len = decimal.limbs[1] ? 2 : 1;
+    binary.limbs[0] = (uint32_t)value;
+    binary.limbs[1] = (uint32_t)(value >> 32);
+    binary.len = binary.limbs[1] ? 2 : 1;
+    if(exponent >= 0)
+    {
+        big_num_mul_pow5(&decimal, exponent);
+        decimal_twos = exponent;
+    }
+    else
+    {
+        big_num_mul_pow5(&binary, -exponent);
+        twos -= exponent;
+    }
+    if(decimal_twos > twos)
+    {
+        big_num_shift_left(&decimal, decimal_twos - twos);
+    }
+    else
+    {
+        big_num_shift_left(&binary, twos - decimal_twos);
+    }
+
+    if(decimal.len != binary.len)
+    {
+        return decimal.len > binary.len ? 1 : -1;
+    }
+    for(i = decimal.len - 1; i >= 0; i--)
+    {
+        if(decimal.limbs[i] != binary.limbs[i])
+        {
+            return decimal.limbs[i] > binary.limbs[i] ? 1 : -1;
+        }
+    }
+    return 0;
+}
+
+static void big_num_mul(big_num_t* num, uint32_t factor)
+{
+    uint64_t carry = 0;
+    int i;
+    for(i = 0; i < num->len; i++)
+    {
+        carry += (uint64_t)num->limbs[i] * factor;
+        num->limbs[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    if(carry && num->len < BIG_NUM_MAX_LIMBS)
+    {
+        num->limbs[num->len++] = (uint32_t)carry;
+    }
+}
+
+static void big_num_mul_pow5(big_num_t* num, int exponent)
+{
+    for(; exponent >= 13; exponent -= 13)
+    {
+        big_num_mul(num, 1220703125); // (5^13)
+    }
+    if(exponent)
+    {
+        uint32_t factor = 1;
+        for(; exponent; exponent--)
+        {
+            factor *= 5;
+        }
+        big_num_mul(num, factor);
+    }
+}
+
+static void big_num_shift_left(big_num_t* num, int bits)
+{
+    int limbs = bits / 32;
+    int i;
+
+    bits %= 32;
+    if(num->len + limbs + 1 > BIG_NUM_MAX_LIMBS)
+    {
+        return; // (not reached for numbers within the range checked in decimal_to_double_bits())
+    }
+    if(bits)
+    {
+        num->limbs[num->len] = 0;
+        for(i = num->len; i > 0; i--)
+        {
+            num->limbs[i] = (num->limbs[i] << bits) | (num->limbs[i - 1] >> (32 - bits));
+        }
+        num->limbs[0] <<= bits;
+        num->len += num->limbs[num->len] ? 1 : 0;
+    }
+    if(limbs)
+    {
+        for(i = num->len - 1; i >= 0; i--)
+        {
+            num->limbs[i + limbs] = num->limbs[i];
+        }
+        for(i = 0; i < limbs; i++)
+        {
+            num->limbs[i] = 0;
+        }
+        num->len += limbs;
+    }
+}
+
+static int count_json_members(const char* input, int pos, int input_len)
+{
+    // number of members of an object / list (by counting commas at its level)
+    char closing = (input[pos] == '{') ? '}' : ']';
+    int depth = 0;
+    int count = 0;
+    int has_value = 0;
+
+    for(pos++; pos < input_len; pos++)
+    {
+        switch(input[pos])
+        {
+        case '\"':
+            pos = skip_json_string(input, pos, input_len);
+            if(pos < 0)
+            {
+                return -1;
+            }
+            pos--;
+            has_value = 1;
+            break;
+
+        case '{':
+        case '[':
+            depth++;
+            has_value = 1;
+            break;
+
+        case '}':
+        case ']':
+            if(depth-- == 0)
+            {
+                return (input[pos] == closing) ? count + has_value : -1;
+            }
+            break;
+
+        case ',':
+            count += (depth == 0);
+            break;
+
+        case ' ':
+        case '\n':
+        case '\r':
+        case '\t':
+            break;
+
+        default:
+            has_value = 1;
+            break;
+        }
+    }
+    return -1;
+}
+
+static int skip_json_string(const char* input, int pos, int input_len)
+{
+    // (returns position just past the closing quote, or -1)
+    for(pos++; pos < input_len; pos++)
+    {
+        if(input[pos] == '\\')
+        {
+            pos++;
+        }
+        else if(input[pos] == '\"')
+        {
+            return pos + 1;
+        }
+    }
+    return -1;
+}
+
+static char* msgpack_reserve(msgpack_writer_t* writer, int input_pos, int len)
+{
+    // space for len bytes of output (if converting in place, input from input_pos can't be overwritten)
+    char* out = writer->out;
+    if(writer->out_end - out < len || (writer->in_place && writer->input + input_pos - out < len))
+    {
+        return 0;
+    }
+    writer->out += len;
+    return out;
+}
+
+static int msgpack_header_len(int type, uint32_t len)
+{
+    if(len < ((type == msgpack_str) ? 32u : 16u))
+    {
+        return 1;
+    }
+    if(len <= 0xff && type == msgpack_str)
+    {
+        return 2;
+    }
+    return (len <= 0xffff) ? 3 : 5;
+}
+
+static char* msgpack_put_header(char* to, int type, int header_len, uint32_t len)
+{
+    if(header_len == 1)
+    {
+        *to++ = (char)(msgpack_headers[type][0] | len);
+        return to;
+    }
+    *to++ = (char)msgpack_headers[type][(header_len == 2) ? 1 : (header_len == 3) ? 2 : 3];
+    return store_be(to, len, header_len - 1);
+}
+
+static int msgpack_put_int(msgpack_writer_t* writer, int input_pos, int negative, uint64_t magnitude)
+{
+    // the smallest of (positive / negative) fixint, uint8..64 or int8..64
+    int64_t value = (int64_t)(0 - magnitude);
+    int num_of_bytes = 0;
+    unsigned char type;
+    char* out;
+
+    if(!negative || !magnitude)
+    {
+        type = (magnitude <= 0x7f) ? (unsigned char)magnitude : 0xcc;
+        num_of_bytes = (magnitude <= 0x7f) ? 0 : (magnitude <= 0xff) ? 1 : (magnitude <= 0xffff) ? 2 :
+                       (magnitude <= 0xffffffffULL) ? 4 : 8;
+    }
+    else
+    {
+        type = (value >= -32) ? (unsigned char)value : 0xd0;
+        num_of_bytes = (value >= -32) ? 0 : (value >= -128) ? 1 : (value >= -32768) ? 2 :
+                       (value >= -2147483647LL - 1) ? 4 : 8;
+    }
+    if(num_of_bytes)
+    {
+        type += (unsigned char)highest_bit(num_of_bytes); // (e.g. 0xcc + 2 for uint32)
+    }
+
+    out = msgpack_reserve(writer, input_pos, 1 + num_of_bytes);
+    if(!out)
+    {
+        return 0;
+    }
+    *out = (char)type;
+    store_be(out + 1, negative ? (uint64_t)value : magnitude, num_of_bytes); // (two's complement if negative)
+    return 1;
+}
+
+static char* store_be(char* to, uint64_t value, int num_of_bytes)
+{
+    while(num_of_bytes-- > 0)
+    {
+        *to++ = (char)(value >> (8 * num_of_bytes));
+    }
+    return to;
+}
+
+static uint64_t load_be(const unsigned char* from, int num_of_bytes)
+{
+    uint64_t value = 0;
+    while(num_of_bytes-- > 0)
+    {
+        value = (value << 8) | *from++;
+    }
+    return value;
+}
+
+static void capture_request(json_rpc_capture_t* capture, const char* request, int request_len)
+{
+    uint64_t timestamp;
+    int record_len = JSON_RPC_CAPTURE_RECORD_HEADER_LEN + request_len;
+    char* full = 0;
+    int full_len = 0;
+    char* to;
+
+    capture_lock(capture);
+    timestamp = capture->clock ? capture->clock() : 0; // (under the lock: timestamps of records don't go back)
+    if(capture->buffer_len - capture->used < record_len && capture->spare && capture->used)
+    {
+        full = capture->buffer; // (swapped with the spare half, and flushed without the lock)
+        full_len = capture->used;
+        capture->buffer = capture->spare;
+        capture->spare = 0;
+        capture->used = 0;
+    }
+    if(capture->buffer_len - capture->used < record_len)
+    {
+        capture->dropped++;
+    }
+    else
+    {
+        to = store_be(capture->buffer + capture->used, timestamp, 8);
+        to = store_be(to, (uint64_t)request_len, 4);
+        move_bytes(to, request, request_len);
+        capture->used += record_len;
+    }
+    RELEASE_STORE(&capture->lock, 0);
+    if(full)
+    {
+        capture_flush_full(capture, full, full_len);
+    }
+}
+
+static void capture_lock(json_rpc_capture_t* capture)
+{
+    while(!TRY_LOCK(&capture->lock))
+    {
+        CPU_RELAX();
+    }
+}
+
+static void capture_flush_full(json_rpc_capture_t* capture, char* full, int full_len)
+{
+    // (only one half is flushed at a time, so the log stays in order)
+    capture->flush(full, full_len, capture->flush_arg);
+    capture_lock(capture);
+    capture->spare = full;
+    RELEASE_STORE(&capture->lock, 0);
+}
+
+static json_rpc_instance_t* registry_enter(json_rpc_registry_t* registry, json_rpc_registry_reader_t* reader)
+{
+    // request is marked active (in the epoch it saw) before current handlers are taken: publisher waits
+    // for it unless it saw the new epoch, and then it takes the new handlers (published before the epoch)
+    SEQ_CST_STORE(&reader->active, SEQ_CST_LOAD(&registry->epoch) * 2 + 1);
+    return SEQ_CST_LOAD(&registry->current);
+}
+
+static void registry_lock(json_rpc_registry_t* registry)
+{
+    while(!TRY_LOCK(&registry->lock))
+    {
+        CPU_RELAX();
+    }
+}
+
+static json_rpc_instance_t* registry_publish(json_rpc_registry_t* registry, json_rpc_instance_t* handlers,
+                                             const json_rpc_registry_reader_t* not_waited_for)
+{
+    json_rpc_instance_t* previous;
+    uint32_t epoch;
+
+    registry_lock(registry);
+    previous = SEQ_CST_EXCHANGE(&registry->current, handlers);
+    epoch = SEQ_CST_FETCH_ADD(&registry->epoch, 1) + 1;
+
+    // requests that started before the new epoch might use previous handlers: wait until they're done
+    // (the lock is not held while waiting, so that e.g. a handler exporting its trace isn't blocked)
+    while(registry_has_readers_before(registry, epoch, not_waited_for))
+    {
+        RELEASE_STORE(&registry->lock, 0);
+        CPU_RELAX();
+        registry_lock(registry);
+    }
+    RELEASE_STORE(&registry->lock, 0);
+    return previous;
+}
+
+static int registry_has_readers_before(json_rpc_registry_t* registry, uint32_t epoch,
+                                       const json_rpc_registry_reader_t* not_waited_for)
+{
+    // (each instance marks its requests in its own cache line, so requests don't contend with each other)
+    json_rpc_registry_reader_t* reader;
+    uint32_t active;
+
+    for(reader = registry->readers; reader; reader = reader->next)
+    {
+        active = SEQ_CST_LOAD(&reader->active);
+        if(active != 0 && active != epoch * 2 + 1 && reader != not_waited_for)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#if !defined(__GNUC__)
+static json_rpc_instance_t* exchange_ptr(json_rpc_instance_t** ptr, json_rpc_instance_t* value)
+{
+    json_rpc_instance_t* previous = *ptr;
+    *ptr = value;
+    return previous;
+}
+#endif
+
+static int extract_params(const json_rpc_handler_t* handler, rpc_request_info_t* info, json_rpc_param_t* params)
+{
+    // extracts all params described by the schema: positional ones in one pass over the params
+    // list, and named ones in one pass over all members (at any depth, as find_member() does)
+    const json_rpc_param_spec_t* schema = handler->params_schema;
+    const char* input = info->data->request + info->params_start;
+    int input_len = info->params_len;
+    json_token_info_t token;
+    int num_of_named = 0;
+    int num_of_found = 0;
+    int curr_pos = 0;
+    int i;
+
+    for(i = 0; i < handler->num_of_params; i++)
+    {
+        params[i].value.start = 0;
+        params[i].value.len = 0;
+        params[i].value.has_escapes = 0;
+        params[i].int_value = 0;
+        params[i].int64_value = 0;
+        params[i].present = 0;
+        if(schema[i].name)
+        {
+            num_of_named++;
+        }
+    }
+
+    if(num_of_named < handler->num_of_params)
+    {
+        reset_token_info(&token);
+        token.values_len = input_len;
+        if(json_next_member_is_object_or_list(input, &token))
+        {
+            curr_pos = token.values_start + 1; // move past the list begin
+        }
+        for(i = 0; i < handler->num_of_params && take_step(&info->steps_left); i++)
+        {
+            curr_pos = json_find_next_member(curr_pos, input, input_len, &token);
+            if(!token.values_len)
+            {
+                break;
+            }
+            if(!schema[i].name && !set_param(&params[i], &schema[i], input, &token))
+            {
+                return 0;
+            }
+        }
+    }
+
+    curr_pos = 0;
+    while(num_of_found < num_of_named && take_step(&info->steps_left))
+    {
+        curr_pos = json_find_next_member(curr_pos, input, input_len, &token);
+        if(!token.values_len)
+        {
+            break;
+        }
+        for(i = 0; token.name_len > 0 && i < handler->num_of_params; i++)
+        {
+            if(schema[i].name && !params[i].present &&
+               str_are_equal(input + token.name_start, token.name_len, schema[i].name))
+            {
+                if(!set_param(&params[i], &schema[i], input, &token))
                 {
-                    if(!in_array)
-                    {
-                        values_end = curr_pos;
-                        break;
-                    }
+                    return 0;
                 }
+                num_of_found++;
+                break;
             }
-            continue;
         }
-
-        if(values_end > 0 ||
-          ( curr == ',' && !in_object && !in_array && !in_quotes ))
+        if(json_next_member_is_object_or_list(input, &token))
         {
-             // in_object or in_array will have negative values if a whole object and / or array
-             // was extracted, so adjust for this
-             values_end = curr_pos + in_object + in_array;
-             curr_pos++;
-             break;
+            curr_pos = token.values_start + 1; // move past objects/list boundaries
         }
-        curr_pos++;
     }
 
-    if(input[info->values_start] == '\"' && input[values_end-1] == '\"')
-    {
-        info->values_start++;
-        values_end--;
-    }
-    else
+    for(i = 0; i < handler->num_of_params; i++)
     {
-        info->values_start = skip_all_of(input, info->values_start, " \t\n\r", 0);
-        values_end = skip_all_of(input, values_end, " \t\n\r", 1);
+        if(!params[i].present && (schema[i].flags & json_rpc_param_required))
+        {
+            return 0;
+        }
     }
-
-    info->values_len = (values_end >= info->values_start) ? values_end - info->values_start : 0;
-    return curr_pos;
+    return 1;
 }
 
-static int str_len(const char* str)
+static int set_param(json_rpc_param_t* param, const json_rpc_param_spec_t* spec, const char* input,
+                     const json_token_info_t* token)
 {
-    // yes yes, the unsafe str_len.. hopefully we'll use it wisely ;)
-    int i = 0;
-    while(*str++)
-    {
-        i++;
-    }
-    return i;
-}
+    const char* value = input + token->values_start;
+    int is_str = token->values_start > 0 && value[-1] == '\"' && value[token->values_len] == '\"';
 
-static char* append_str(char* to, const char* from, int len/* = -1*/)
-{
-    if(len > 0)
+    param->value.start = value;
+    param->value.len = token->values_len;
+    param->value.has_escapes = token->values_flags & json_value_has_escapes;
+    switch(spec->type)
     {
-        while(len--)
+    case json_rpc_param_int:
+        if(is_str || !convert_to_int(value, token->values_len, &param->int_value))
         {
-            *to++ = *from++;
+            return 0;
         }
-    }
-    else
-    {
-        while(*from)
+        break;
+
+    case json_rpc_param_int64:
+        if(is_str || !convert_to_int64(value, token->values_len, &param->int64_value))
         {
-            *to++ = *from++;
+            return 0;
         }
+        break;
+
+    case json_rpc_param_bool:
+        if(!is_str && str_are_equal(value, token->values_len, "true"))
+        {
+            param->int_value = 1;
+        }
+        else if(is_str || !str_are_equal(value, token->values_len, "false"))
+        {
+            return 0;
+        }
+        break;
+
+    case json_rpc_param_str:
+        if(!is_str)
+        {
+            return 0;
+        }
+        break;
     }
-    *to = 0;
-    return to;
+    param->present = 1;
+    return 1;
 }
 
-static int str_are_equal(const char* first, const char* second_zero_ended)
+static int bytes_are_equal(const char* first, const char* second, int len)
 {
-    int are_equal = 0;
-    while (*second_zero_ended != 0   &&  // not the end of string?
-           *first != 0  &&               // nor end of str
-           *first == *second_zero_ended) // until are equal
+    while(len-- > 0)
     {
-        first++;
-        second_zero_ended++;
+        if(*first++ != *second++)
+        {
+            return 0;
+        }
     }
+    return 1;
+}
 
-    // here, if we're at the end of second = they do match
-    if (*second_zero_ended == 0)
+static uint64_t hash_of(const char* data, int len)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL; // FNV-1a
+    while(len-- > 0)
     {
-        are_equal = 1;
+        hash ^= (unsigned char)*data++;
+        hash *= 0x100000001b3ULL;
     }
-    return are_equal;
+    return hash;
 }
 
-static int str_are_equal(const char* first, int first_len, const char* second_zero_ended)
+static int create_cache_key(const char* fcn_name, rpc_request_info_t* info, char* key, int max_key_len)
 {
-    int are_equal = 0;
-    while (*second_zero_ended != 0   &&  // not the end of string?
-           *first != 0  &&    // nor end of str
-           *first == *second_zero_ended) // until are equal
+    // key: method name, 0, params without whitespace (outside strings)
+    const char* params = info->data->request + info->params_start;
+    int key_len = str_len(fcn_name) + 1;
+    int in_quotes = 0;
+    int i;
+
+    if(key_len > max_key_len)
     {
-        first++;
-        second_zero_ended++;
-        first_len--;
+        return -1;
     }
+    append_str(key, fcn_name);
 
-    // here, if we're at the end of first and second they do match at least at first_len characters.
-    if (*second_zero_ended == 0 && first_len == 0)
+    for(i = 0; i < info->params_len; i++)
     {
-        are_equal = 1;
+        if(!in_quotes && (params[i] == ' ' || params[i] == '\n' || params[i] == '\r' || params[i] == '\t'))
+        {
+            continue;
+        }
+        if(key_len >= max_key_len)
+        {
+            return -1;
+        }
+        key[key_len++] = params[i];
+        if(params[i] == '\"')
+        {
+            in_quotes = !in_quotes;
+        }
+        else if(params[i] == '\\' && in_quotes && i + 1 < info->params_len)
+        {
+            if(key_len >= max_key_len)
+            {
+                return -1;
+            }
+            key[key_len++] = params[++i]; // (escaped character)
+        }
     }
-    return are_equal;
+    return key_len;
 }
 
-static int int_val(char symbol, int* result)
+static int cache_lookup_or_claim(json_rpc_cache_t* cache, const char* key, int key_len, uint64_t hash,
+                                 rpc_request_info_t* info, json_rpc_cache_entry_t** claimed_entry,
+                                 uint32_t* claimed_seq)
 {
-    int value_ok = 1;
-    int correct_by = 0;
+    // returns 1 if the result was taken from the cache, otherwise handler should be called
+    // (and its result stored in the claimed entry, if any)
+    int already_cached = 0;
+    int attempts = 2;
+    uint32_t stale_seq;
 
-    if ((symbol >= '0') && (symbol <= '9'))
-    {
-        correct_by = '0';
-    }
-    else if ((symbol >= 'A') && (symbol <= 'F'))
-    {
-        correct_by = ('A' - 10);
-    }
-    else if ((symbol >= 'a') && (symbol <= 'f'))
-    {
-        correct_by = ('a' - 10);
-    }
-    else
+    *claimed_entry = 0;
+    while(attempts--)
     {
-        value_ok = 0;
+        if(cache_lookup(cache, key, key_len, hash, info, &stale_seq))
+        {
+            return 1;
+        }
+        *claimed_entry = cache_claim(cache, key, key_len, hash, stale_seq, &already_cached, claimed_seq);
+        if(!already_cached)
+        {
+            break;
+        }
     }
-
-    *result = symbol - correct_by;
-    return value_ok;
+    return 0;
 }
 
-static int convert_to_int(const char* start, int length, int* result)
+static int cache_lookup(json_rpc_cache_t* cache, const char* key, int key_len, uint64_t hash, rpc_request_info_t* info,
+                        uint32_t* stale_seq)
 {
-    int extracted_ok = 1;
-    int base = 10;
-    int value = 0;
-    int sign = 1;
-    int val_start = 0;
-    int i = 0;
+    // if a pending result was waited for in vain, its entry sequence number is returned in stale_seq
+    json_rpc_cache_entry_t* set = &cache->entries[(hash % cache->num_of_sets) * 4];
+    json_rpc_cache_entry_t* entry;
+    char* response_end = 0;
+    char* buf;
+    uint32_t seq;
+    int result_len;
+    int spins = JSON_RPC_CACHE_WAIT_SPINS;
+    int i;
 
-    if(length > 0 && start[0] == '-')
+    *stale_seq = 0;
+    if(info->data->response && info->data->response_len)
     {
-        sign = -1;
-        val_start++;
+        response_end = info->data->response + str_len(info->data->response);
     }
 
-    // find base: 0x: hex(16), 0:octal(8)
-    if(length > val_start+2 &&
-       start[val_start] == '0')
+    for(i = 0; i < 4; i++)
     {
-        if(start[val_start+1] == 'x')
+        // entries are read without locking: if an entry was changed while it was read (i.e. if its
+        // sequence number changed or it was odd), what was read is discarded
+        entry = &set[i];
+        seq = ACQUIRE_LOAD(&entry->seq);
+        if((seq & 1) || RELAXED_LOAD(&entry->hash) != hash || RELAXED_LOAD(&entry->key_len) != key_len)
         {
-            base = 16;
-            val_start += 2;
+            continue;
         }
-        else
+        result_len = RELAXED_LOAD(&entry->result_len);
+        if(result_len < 0 || key_len + result_len > JSON_RPC_CACHE_DATA_SIZE ||
+           !bytes_are_equal(entry->data, key, key_len))
         {
-            base = 8;
-            val_start += 1;
+            continue;
         }
-    }
 
-    *result = 0;
-    for(i = val_start; i < length; i++)
-    {
-        if(i > val_start)
+        if(!result_len)
         {
-            *result *= base;
+            // identical call is in progress: wait until its entry changes, then look again
+            // (with a clock: until the result is stale, otherwise JSON_RPC_CACHE_WAIT_SPINS)
+            while(ACQUIRE_LOAD(&entry->seq) == seq && spins > 0)
+            {
+                CPU_RELAX();
+                spins--;
+                if(cache->clock && !(spins & 1023))
+                {
+                    spins = cache->clock() - RELAXED_LOAD(&entry->claimed_at) < cache->pending_timeout ? 1024 : 0;
+                }
+            }
+            if(spins <= 0)
+            {
+                *stale_seq = seq; // (its entry is taken over if stale, otherwise handler is called uncached)
+                return 0;
+            }
+            i = -1;
+            continue;
         }
 
-        if(!int_val(start[i], &value) ||
-           value > base)
+        buf = json_rpc_result_begin(info);
+        if(buf)
         {
-            extracted_ok = 0;
-            break;
+            if(info->data->response_len - (int)(buf - info->data->response) < result_len + 32 + info->id_len)
+            {
+                *response_end = 0; // won't fit: let the handler deal with it
+                return 0;
+            }
+            buf = append_str(buf, entry->data + key_len, result_len);
+        }
+
+        ACQUIRE_FENCE();
+        if(RELAXED_LOAD(&entry->seq) != seq)
+        {
+            if(response_end)
+            {
+                *response_end = 0;
+            }
+            i = -1; // (look again)
+            continue;
+        }
+
+        json_rpc_result_end(buf, info);
+        if(!RELAXED_LOAD(&entry->referenced))
+        {
+            RELAXED_STORE(&entry->referenced, 1);
         }
-        *result += value;
+        return 1;
     }
-    *result *= sign;
-    return extracted_ok;
+    return 0;
 }
 
-static int name_to_id(const char* name, json_rpc_instance* table)
+static json_rpc_cache_entry_t* cache_claim(json_rpc_cache_t* cache, const char* key, int key_len, uint64_t hash,
+                                           uint32_t stale_seq, int* already_cached, uint32_t* claimed_seq)
 {
-    const char* curr_name = name;
-    const char* curr_item;
+    // adds an entry with pending result (so that identical calls wait for it) or takes over a stale one,
+    // returns 0 if there is no entry to evict (or if the call is already cached / in progress)
+    json_rpc_cache_entry_t* set = &cache->entries[(hash % cache->num_of_sets) * 4];
+    json_rpc_cache_entry_t* entry = 0;
+    uint32_t seq;
     int i;
-    for (i = 0; i < table->num_of_handlers; i++)
-    {
-        curr_name = name;
-        while(*curr_name == '\"')
-        {
-            curr_name++; // skip opening quotes
-        }
 
-        curr_item = table->handlers[i].fcn_name;
+    *already_cached = 0;
+    if(key_len >= JSON_RPC_CACHE_DATA_SIZE)
+    {
+        return 0;
+    }
 
-        while (*curr_name != 0   &&  // not the end of string?
-               *curr_name != '\"' && // end of word marked by quote
-               *curr_item != 0  &&   // nor end of handler function name
-               *curr_name == *curr_item) // until are equal
+    cache_lock(cache);
+    for(i = 0; i < 4; i++)
+    {
+        if(set[i].key_len == key_len && set[i].hash == hash && bytes_are_equal(set[i].data, key, key_len))
         {
-            curr_name++;
-            curr_item++;
+            if(cache_is_stale(cache, &set[i], stale_seq))
+            {
+                entry = &set[i]; // (its handler did not complete: this call becomes the owner)
+                break;
+            }
+            RELEASE_STORE(&cache->writer_lock, 0); // (added by another thread since it was looked-up)
+            *already_cached = 1;
+            return 0;
         }
+    }
 
-        // here, if we're at the end of either curr_: we've found it!
-        if (*curr_item == 0 && (*curr_name == 0 || *curr_name == '\"'))
+    // 'clock': find an entry that is not used, or was not referenced since the last pass
+    // (entries with pending results are not evicted, unless they are stale)
+    for(i = 0; i < 8 && !entry; i++)
+    {
+        if(!set[i & 3].key_len || (set[i & 3].result_len > 0 && !RELAXED_LOAD(&set[i & 3].referenced)) ||
+           cache_is_stale(cache, &set[i & 3], 0))
         {
+            entry = &set[i & 3];
             break;
         }
+        RELAXED_STORE(&set[i & 3].referenced, 0);
     }
-    return i == table->num_of_handlers ? -1 : i; // if not found, return -1
+
+    if(entry)
+    {
+        seq = entry->seq;
+        RELAXED_STORE(&entry->seq, seq + 1); // odd: being written
+        RELEASE_FENCE();
+        RELAXED_STORE(&entry->hash, hash);
+        RELAXED_STORE(&entry->key_len, (int16_t)key_len);
+        RELAXED_STORE(&entry->result_len, (int16_t)0);
+        RELAXED_STORE(&entry->claimed_at, cache->clock ? cache->clock() : 0);
+        append_str(entry->data, key, key_len);
+        RELAXED_STORE(&entry->referenced, 1);
+        RELEASE_STORE(&entry->seq, seq + 2);
+        *claimed_seq = seq + 2;
+    }
+    RELEASE_STORE(&cache->writer_lock, 0);
+    return entry;
 }
 
-static int get_fcn_id(json_rpc_instance_t* self, const char* input, json_token_info_t* info)
+static int cache_is_stale(json_rpc_cache_t* cache, json_rpc_cache_entry_t* entry, uint32_t stale_seq)
 {
-    const char* name = &input[info->values_start];
-    return name_to_id(name, self);
+    // (called with writer lock held) pending result is stale if it was claimed more than the timeout ago
+    // or, without a clock, if it did not change while an identical call waited for it
+    if(!entry->key_len || entry->result_len)
+    {
+        return 0;
+    }
+    if(cache->clock)
+    {
+        return cache->clock() - entry->claimed_at >= cache->pending_timeout;
+    }
+    return stale_seq && entry->seq == stale_seq;
 }
 
-static int get_obj_id(const char* input, json_token_info_t* info)
+static void cache_complete(json_rpc_cache_t* cache, json_rpc_cache_entry_t* entry, uint32_t claimed_seq,
+                           int key_len, uint64_t hash, const char* result, int result_len)
 {
-    json_rpc_instance table;
-    table.handlers = (json_rpc_handler_t*)obj_names;
-    table.num_of_handlers = num_of_obj_names;
-    const char* name = &input[info->name_start];
-    return name_to_id(name, &table);
+    // stores result in the claimed entry or, if there is no result to cache, releases the entry
+    // (unless the entry was taken over by another call in the meantime)
+    uint32_t seq;
+
+    cache_lock(cache);
+    if(entry->seq == claimed_seq && entry->key_len == key_len && entry->hash == hash &&
+       entry->result_len == 0) // (cache could be cleared)
+    {
+        seq = entry->seq;
+        RELAXED_STORE(&entry->seq, seq + 1);
+        RELEASE_FENCE();
+        if(result && result_len > 0 && key_len + result_len <= JSON_RPC_CACHE_DATA_SIZE)
+        {
+            append_str(entry->data + key_len, result, result_len);
+            RELAXED_STORE(&entry->result_len, (int16_t)result_len);
+        }
+        else
+        {
+            RELAXED_STORE(&entry->key_len, (int16_t)0);
+        }
+        RELEASE_STORE(&entry->seq, seq + 2);
+    }
+    RELEASE_STORE(&cache->writer_lock, 0);
 }
 
-static void reset_token_info(json_token_info_t* info)
+static void cache_lock(json_rpc_cache_t* cache)
 {
-    info->name_start = 0;
-    info->name_len = 0;
-    info->values_start = 0;
-    info->values_len = 0;
+    while(!TRY_LOCK(&cache->writer_lock)) // (only held while an entry is copied)
+    {
+        CPU_RELAX();
+    }
 }
 
-static int skip_all_of(const char* input, int start_at, const char* values, char reversed)
+#ifdef JSON_RPC_TINY_TRACE
+static void trace_event(json_rpc_instance_t* self, int event, int fcn_id)
 {
-    int size = str_len(values);
-    int i = 0;
-    char found = 0;
-    do
+    json_rpc_trace_t* trace = self->trace;
+    json_rpc_trace_event_t* next = &trace->events[trace->head & trace->mask];
+
+    RELEASE_FENCE(); // (so that an exporter which sees the event overwritten also sees the head it was written at)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    next->timestamp = __builtin_ia32_rdtsc();
+#else
+    next->timestamp = self->clock ? self->clock() : 0;
+#endif
+    if(event == json_rpc_trace_parse_start)
     {
-        for(i = 0; i < size; i++)
-        {
-            found = 0;
-            if(input[start_at] == values[i])
-            {
-                if(reversed)
-                {
-                    --start_at;
-                    if(start_at < 0)
-                    {
-                        return start_at;
-                    }
-                }
-                else
-                {
-                    ++start_at;
-                }
-                found = 1;
-                break;
-            }
-        }
+        trace->request_no++;
     }
-    while(found);
-    return start_at;
+    next->request_no = trace->request_no;
+    next->fcn_id = (int16_t)fcn_id;
+    next->event = (uint16_t)event;
+    RELEASE_STORE(&trace->head, trace->head + 1); // (publish the event)
 }
+#endif
@@ -33,6 +33,58 @@
 /* Exported defines ------------------------------------------------------------*/
 
 #include <stdint.h>
+
+#define JSON_FORMAT_INT_MAX_LEN     20  /* max chars written by json_format_int() (e.g. "-9223372036854775808") */
+#define JSON_FORMAT_DOUBLE_MAX_LEN  25  /* max chars written by json_format_double() (e.g. "-0.0000012345678901234567") */
+
+#ifndef JSON_RPC_LATENCY_BUCKETS
+#define JSON_RPC_LATENCY_BUCKETS    128 /* buckets of latency histograms (4 per power of 2, so ~2^33 ticks max) */
+#endif
+
+#ifndef JSON_RPC_CACHE_DATA_SIZE
+#define JSON_RPC_CACHE_DATA_SIZE    228 /* space for the key (method name and params) and result in each cache entry */
+#endif
+
+#ifndef JSON_RPC_MAX_SCHEMA_PARAMS
+#define JSON_RPC_MAX_SCHEMA_PARAMS  8   /* max number of params that can be described by a handler's params schema */
+#endif
+
+#ifndef JSON_RPC_CACHE_WAIT_SPINS
+#define JSON_RPC_CACHE_WAIT_SPINS   (1 << 20) /* how long to wait for a result of identical call (then call handler) */
+#endif
+
+#ifndef JSON_PATH_MAX_SEGMENTS
+#define JSON_PATH_MAX_SEGMENTS      16  /* max number of segments (member names / positions in lists) of a path */
+#endif
+
+#ifndef JSON_PATH_MAX_NAMES_LEN
+#define JSON_PATH_MAX_NAMES_LEN     128 /* space for (decoded) member names of a path */
+#endif
+
+#ifndef JSON_PATH_NODE_NAME_LEN
+#define JSON_PATH_NODE_NAME_LEN     24  /* max length of member names in a set of paths (see json_path_set_add()) */
+#endif
+
+#ifndef JSON_BUDGET_MAX_DEPTH
+#define JSON_BUDGET_MAX_DEPTH       64  /* members are counted (see json_check_budget()) for objects nested up to this depth */
+#endif
+
+#define JSON_RPC_CAPTURE_MAGIC      "JRPCCAP1" /* first bytes of a capture log (see json_rpc_capture_init()) */
+#define JSON_RPC_CAPTURE_HEADER_LEN 16  /* magic and ticks per second (uint64) */
+#define JSON_RPC_CAPTURE_RECORD_HEADER_LEN 12 /* timestamp (uint64) and length of the request (uint32) */
+
+#ifndef JSON_RPC_MSGPACK_MAX_DEPTH
+#define JSON_RPC_MSGPACK_MAX_DEPTH  32  /* max nesting of MessagePack maps / arrays (see json_from_msgpack()) */
+#endif
+
+// objects shared between threads (e.g. caches, registries, limits, queues) are updated with GCC / Clang
+// atomic builtins: other compilers can only build the library with JSON_RPC_TINY_SINGLE_THREADED defined
+#if defined(__GNUC__)
+#define JSON_RPC_CACHE_ALIGNED      __attribute__((aligned(64)))
+#else
+#define JSON_RPC_CACHE_ALIGNED
+#endif
+
 /* Exported types ------------------------------------------------------------*/
 
 
@@ -50,6 +102,66 @@ typedef struct json_rpc_data
 } json_rpc_data_t;
 
 
+/**
+ * @brief Struct describing a string value within the original input (without copying it).
+ *        Escape sequences (if any) are left in place, and the string can be decoded if / when
+ *        needed using json_str_view_decode(). Plain strings (has_escapes == 0) can be used as they are.
+ */
+typedef struct json_str_view
+{
+    const char* start;
+    int len;
+    int has_escapes;
+} json_str_view_t;
+
+
+/**
+ * @brief Types of params that can be described by params schema.
+ */
+enum json_rpc_param_types
+{
+    json_rpc_param_any = 0,     /* any JSON value (e.g. an object or a list) */
+    json_rpc_param_int,
+    json_rpc_param_bool,
+    json_rpc_param_str,
+    json_rpc_param_int64        /* integer that doesn't have to fit in int */
+};
+
+
+/**
+ * @brief Flags of params described by params schema.
+ */
+enum json_rpc_param_flags
+{
+    json_rpc_param_required = 1
+};
+
+
+/**
+ * @brief Description of a param (an item of params schema, see json_rpc_register_handler()).
+ *        Params with a name are looked-up by their name, params without it - by their position
+ *        in the schema (i.e. zero-based position within the params list).
+ */
+typedef struct json_rpc_param_spec
+{
+    const char* name;
+    uint16_t type;          /* one of json_rpc_param_types */
+    uint16_t flags;         /* combination of json_rpc_param_flags */
+} json_rpc_param_spec_t;
+
+
+/**
+ * @brief Value of a param, extracted (and converted to its type) before the handler is called.
+ */
+typedef struct json_rpc_param
+{
+    json_str_view_t value;  /* value as it is in the request (for strings: without quotes) */
+    int int_value;          /* converted value of json_rpc_param_int and json_rpc_param_bool params */
+    int64_t int64_value;    /* converted value of json_rpc_param_int64 params */
+    int present;            /* (0 if an optional param was not in the request) */
+} json_rpc_param_t;
+
+
 /**
  * @brief Structure containing all information about the request.
  *        Pointer to such a structure will be passed to each handler, so that
@@ -63,6 +175,11 @@ typedef struct rpc_request_info
     int id_start;
     int id_len;
     unsigned int info_flags;
+    int error;          /* error response created for the request (one of json_rpc_20_errors) or -1 */
+    int result_start;   /* offset of the result value created for the request within the response (or -1) */
+    int result_len;
+    const json_rpc_param_t* params; /* params extracted as described by the params schema (in its order) */
+    int steps_left;     /* members that extraction of params can still visit (or -1 if not limited) */
     json_rpc_data_t* data;
 } rpc_request_info_t;
 
@@ -89,9 +206,275 @@ typedef struct json_rpc_handler
 {
     json_rpc_handler_fcn handler;
     const char* fcn_name;
+    unsigned int flags;     /* see json_rpc_handler_flags */
+    const json_rpc_param_spec_t* params_schema;
+    int num_of_params;
+    struct json_rpc_limit* limit;   /* (see json_rpc_set_limit()) */
 } json_rpc_handler_t;
 
 
+/**
+ * @brief Flags that can be set for handlers when they are registered.
+ */
+enum json_rpc_handler_flags
+{
+    json_rpc_handler_cacheable = 1,     /* result depends on params only: it can be cached (see json_rpc_enable_cache()) */
+    json_rpc_handler_priority_high = 2, /* e.g. control / health methods (see json_rpc_schedule()) */
+    json_rpc_handler_priority_low = 4   /* e.g. bulk data methods */
+};
+
+
+/**
+ * @brief Priority classes of requests (taken from flags of their handlers).
+ */
+enum json_rpc_priorities
+{
+    json_rpc_priority_high = 0,
+    json_rpc_priority_normal,
+    json_rpc_priority_low,
+    json_rpc_num_of_priorities
+};
+
+
+/**
+ * @brief Enumeration to allow selecting JSON-RPC2.0 error codes.
+ */
+enum json_rpc_20_errors
+{
+    json_rpc_err_parse_error = 0,       /* An error occurred on the server while parsing the JSON text */
+    json_rpc_err_invalid_request,       /* The JSON sent is not a valid Request object */
+    json_rpc_err_method_not_found,      /* The method does not exist / is not available */
+    json_rpc_err_invalid_params,        /* Invalid method parameter(s) */
+    json_rpc_err_internal_error,        /* Internal JSON-RPC error */
+    json_rpc_err_server_busy,           /* (-32000) Method's limit of calls in progress or rate limit was reached */
+    json_rpc_num_of_errors              /* (number of errors above, custom errors are counted as this one) */
+};
+
+
+/**
+ * @brief Definition of a clock function (used to measure time for stats).
+ *        It should return current time in ticks of any (but monotonic) clock, e.g. in ns.
+ */
+typedef uint64_t (*json_rpc_clock_fcn)(void);
+
+
+/**
+ * @brief Structure defining limits of calls to a method (see json_rpc_set_limit()). Calls over
+ *        the limit are responded to with json_rpc_err_server_busy error (without calling the handler).
+ *        The same limit can be used by many instances (e.g. in different threads), counters are atomic.
+ */
+typedef struct JSON_RPC_CACHE_ALIGNED json_rpc_limit
+{
+    uint32_t max_in_flight;     /* max number of calls in progress at the same time (0: no limit) */
+    uint32_t in_flight;
+    uint64_t interval;          /* rate limit: min ticks between calls on average (0: no limit) */
+    uint64_t burst_tolerance;   /* how much earlier (in ticks) calls can be made in bursts */
+    uint64_t next_call_time;    /* ('theoretical arrival time' of the next call) */
+    json_rpc_clock_fcn clock;
+} json_rpc_limit_t;
+
+
+/**
+ * @brief Structure holding stats (counters) for a method (handler).
+ *        Each rpc instance updates its own table of stats (so if instances are used from different
+ *        threads, there is no contention), aligned to the cache line so that tables of different
+ *        instances don't share cache lines either. Stats can be snapshot / merged from different
+ *        instances using json_rpc_stats_merge().
+ */
+typedef struct JSON_RPC_CACHE_ALIGNED json_rpc_method_stats
+{
+    uint64_t calls;
+    uint64_t errors[json_rpc_num_of_errors + 1]; /* number of error responses by json_rpc_20_errors code */
+    uint64_t parse_time;                         /* total time (ticks) spent parsing requests */
+    uint64_t handler_time;                       /* total time (ticks) spent in the handler */
+    uint32_t latency[JSON_RPC_LATENCY_BUCKETS];  /* histogram of (parse + handler) time (see json_rpc_latency_bucket()) */
+} json_rpc_method_stats_t;
+
+
+/**
+ * @brief Trace events, emitted by json_rpc_handle_request() (only if built with JSON_RPC_TINY_TRACE defined).
+ */
+enum json_rpc_trace_events
+{
+    json_rpc_trace_parse_start = 0,     /* parsing of the next request (or next request of a batch) started */
+    json_rpc_trace_parse_end,           /* request parsed */
+    json_rpc_trace_dispatch,            /* request dispatched (fcn_id is known, or -1 if not dispatched) */
+    json_rpc_trace_handler_start,
+    json_rpc_trace_handler_end,
+    json_rpc_trace_response_written     /* whole response (e.g. for all requests of a batch) written */
+};
+
+
+/**
+ * @brief Structure of a trace event.
+ */
+typedef struct json_rpc_trace_event
+{
+    uint64_t timestamp;     /* CPU time-stamp counter (if available) or time from the instance clock */
+    uint32_t request_no;    /* number of the request (within the trace), to correlate events */
+    int16_t fcn_id;         /* index of the handler (or -1) */
+    uint16_t event;         /* one of json_rpc_trace_events */
+} json_rpc_trace_event_t;
+
+
+/**
+ * @brief Structure of the trace: a ring buffer of recent events of an rpc instance.
+ *        It is written by the thread using the instance only (so it doesn't need locking), but can be
+ *        exported by any other thread (see json_rpc_trace_export()), at which point it contains last events.
+ */
+typedef struct json_rpc_trace
+{
+    json_rpc_trace_event_t* events;
+    uint32_t mask;          /* (number of events - 1), number of events is a power of 2 */
+    uint32_t request_no;
+    uint64_t head;          /* number of events written so far */
+} json_rpc_trace_t;
+
+
+/**
+ * @brief Structure of a response cache entry.
+ */
+typedef struct JSON_RPC_CACHE_ALIGNED json_rpc_cache_entry
+{
+    uint32_t seq;           /* odd while the entry is being written */
+    uint32_t referenced;    /* set when entry is used (cleared by the 'clock' looking for entries to evict) */
+    uint64_t hash;
+    uint64_t claimed_at;    /* time (of the cache clock) when the pending result was claimed */
+    int16_t key_len;        /* (0 if entry is not used) */
+    int16_t result_len;     /* (0 while result is pending: handler is called for the first of identical calls) */
+    char data[JSON_RPC_CACHE_DATA_SIZE]; /* key (method name, 0, params without whitespace) followed by the result */
+} json_rpc_cache_entry_t;
+
+
+/**
+ * @brief Structure of a response cache: results of calls to cacheable methods, keyed by
+ *        method name and params. Cache is bounded (uses a pre-allocated table of entries)
+ *        and can be shared by rpc instances used from different threads: it is looked-up without
+ *        locking, and entries (4-way set-associative) are replaced using 'clock' algorithm.
+ *        Identical calls in-flight at the same time are coalesced: handler is called only for the
+ *        first one, others wait for its result (and respond with it, using their own id).
+ *        A pending result that is not delivered in time (e.g. its handler threw) is stale: the next
+ *        identical call takes its entry over (see json_rpc_cache_set_timeout()).
+ */
+typedef struct json_rpc_cache
+{
+    json_rpc_cache_entry_t* entries;
+    uint32_t num_of_sets;
+    uint32_t writer_lock;
+    json_rpc_clock_fcn clock;
+    uint64_t pending_timeout;
+} json_rpc_cache_t;
+
+
+/**
+ * @brief State of an rpc instance using a registry (in its own cache line, so that instances used by
+ *        different threads don't write to the same one for each request).
+ */
+typedef struct JSON_RPC_CACHE_ALIGNED json_rpc_registry_reader
+{
+    uint32_t active;                        /* epoch * 2 + 1 while a request is in progress (0 otherwise) */
+    struct json_rpc_registry_reader* next;  /* next instance using the same registry */
+} json_rpc_registry_reader_t;
+
+
+/**
+ * @brief Structure allowing to replace handlers of running rpc instances (e.g. from a different thread,
+ *        without stopping them). Handlers are taken from an instance (with handlers registered as usual)
+ *        that is published atomically. Previously published instance is returned when no request
+ *        uses its handlers any more, so its storage can be reused (RCU-like).
+ */
+typedef struct JSON_RPC_CACHE_ALIGNED json_rpc_registry
+{
+    struct json_rpc_instance* current;      /* instance with handlers used for new requests */
+    uint32_t epoch;                         /* incremented when handlers are published */
+    uint32_t lock;                          /* (held to add / remove readers, to publish and to export traces) */
+    json_rpc_registry_reader_t* readers;    /* instances using the registry */
+} json_rpc_registry_t;
+
+
+/**
+ * @brief Slot of a queue of requests (see json_rpc_scheduler_init()).
+ */
+typedef struct json_rpc_queue_slot
+{
+    uint32_t seq;
+    json_rpc_data_t* request;
+} json_rpc_queue_slot_t;
+
+
+/**
+ * @brief Bounded queue of requests, that can be used by many producers and consumers (without locking).
+ */
+typedef struct json_rpc_queue
+{
+    json_rpc_queue_slot_t* slots;
+    uint32_t mask;                      /* (number of slots - 1) */
+    JSON_RPC_CACHE_ALIGNED uint32_t head;
+    JSON_RPC_CACHE_ALIGNED uint32_t tail;
+} json_rpc_queue_t;
+
+
+/**
+ * @brief Structure of a scheduler of requests: requests are queued by their priority, and are taken
+ *        from the queue of the highest priority, unless a queue of lower priority was passed over
+ *        max_bypass times (so that requests of lower priorities are not starved).
+ */
+typedef struct json_rpc_scheduler
+{
+    json_rpc_queue_t queues[json_rpc_num_of_priorities];
+    uint32_t bypassed[json_rpc_num_of_priorities];
+    uint32_t max_bypass;
+} json_rpc_scheduler_t;
+
+
+/**
+ * @brief Limits of work done to parse a request, so that crafted (deeply nested or huge) requests
+ *        can't make it expensive (see json_rpc_set_parse_budget()). Zero means: not limited.
+ */
+typedef struct json_parse_budget
+{
+    int max_depth;      /* nesting of objects and lists */
+    int max_members;    /* members of any object or list */
+    int max_bytes;      /* length of the request */
+    int max_steps;      /* members visited while extracting params (by all extractions for a request) */
+} json_parse_budget_t;
+
+
+/**
+ * @brief Results of json_check_budget().
+ */
+enum json_budget_results
+{
+    json_budget_ok = 0,
+    json_budget_depth_exceeded,
+    json_budget_members_exceeded,
+    json_budget_bytes_exceeded
+};
+
+
+/**
+ * @brief Type of a function called with captured data (e.g. to write it to a file).
+ */
+typedef void (*json_rpc_capture_flush_fcn)(const char* data, int len, void* arg);
+
+
+/**
+ * @brief Structure of a capture of requests (see json_rpc_capture_init()).
+ */
+typedef struct json_rpc_capture
+{
+    char* buffer;           /* buffer (half of it, if there's a flush function) being filled */
+    char* spare;            /* the other half (NULL while it is being flushed) */
+    int buffer_len;
+    int used;
+    json_rpc_clock_fcn clock;
+    json_rpc_capture_flush_fcn flush;
+    void* flush_arg;
+    uint64_t dropped;       /* number of requests that didn't fit (if there's no flush function) */
+    uint32_t lock;
+} json_rpc_capture_t;
+
+
 /**
  * @brief Struct defining and instance of the JSON-RPC handling entity.
  *        Number of different entities can be used (also from different threads),
@@ -102,34 +485,120 @@ typedef struct json_rpc_instance
     json_rpc_handler_t* handlers;
     int num_of_handlers;
     int max_num_of_handlers;
+    unsigned int options;
+    json_rpc_method_stats_t* stats;
+    int num_of_stats;
+    json_rpc_clock_fcn clock;
+    json_rpc_trace_t* trace;
+    json_rpc_cache_t* cache;
+    json_rpc_registry_t* registry;
+    json_rpc_capture_t* capture;
+    const json_parse_budget_t* budget;
+    json_rpc_registry_reader_t registry_reader;
 } json_rpc_instance_t;
 
 
+/**
+ * @brief Options that can be set for the JSON-RPC instance (see json_rpc_set_options()).
+ */
+enum json_rpc_options
+{
+    json_rpc_option_strict_parsing = 1, /* requests are fully validated (JSON grammar and UTF-8) before
+                                           being handled, and rejected with 'Parse error' if not valid */
+    json_rpc_option_reorder_batch = 2   /* requests in a batch are handled in order of their priority
+                                           (so responses in the batch response are in that order) */
+};
+
+
 /**
  * @brief Struct containing information about json token (json object).
  *        It is used to aid extraction / parsing of json objects.
  */
 typedef struct json_token_info
 {
-    int16_t name_start;
-    int16_t name_len;
-    int16_t values_start;
-    int16_t values_len;
+    int name_start;
+    int name_len;
+    int values_start;
+    int values_len;
+    int values_flags; /* see json_value_flags */
 } json_token_info_t;
 
+
 /**
- * @brief Enumeration to allow selecting JSON-RPC2.0 error codes.
+ * @brief Segment of a path (see json_path_compile()).
  */
-enum json_rpc_20_errors
+typedef struct json_path_segment
 {
-    json_rpc_err_parse_error = 0,       /* An error occurred on the server while parsing the JSON text */
-    json_rpc_err_invalid_request,       /* The JSON sent is not a valid Request object */
-    json_rpc_err_method_not_found,      /* The method does not exist / is not available */
-    json_rpc_err_invalid_params,        /* Invalid method parameter(s) */
-    json_rpc_err_internal_error,        /* Internal JSON-RPC error */
+    int name_start;         /* offset of the member name within json_path_t::names */
+    int name_len;
+    int index;              /* position within a list (or -1 if the segment is not a number) */
+} json_path_segment_t;
+
+
+/**
+ * @brief Compiled path to a (nested) value. It doesn't refer to the string it was compiled from,
+ *        so it can be compiled once and used for many requests.
+ */
+typedef struct json_path
+{
+    json_path_segment_t segments[JSON_PATH_MAX_SEGMENTS];
+    int num_of_segments;
+    char names[JSON_PATH_MAX_NAMES_LEN];
+} json_path_t;
+
+
+/**
+ * @brief Node of a set of paths (paths are kept as a tree: paths with common beginning share nodes).
+ */
+typedef struct json_path_node
+{
+    char name[JSON_PATH_NODE_NAME_LEN];
+    int name_len;
+    int index;              /* position within a list (or -1 if the segment is not a number) */
+    int first_child;        /* (or -1) */
+    int next_sibling;       /* (or -1) */
+    int slot;               /* slot of the path that ends at this node (or -1) */
+} json_path_node_t;
+
+
+/**
+ * @brief Set of paths, compiled once (see json_path_set_init()), to extract values of all of them in one pass.
+ */
+typedef struct json_path_set
+{
+    json_path_node_t* nodes; /* (nodes[0] is the root) */
+    int num_of_nodes;
+    int max_num_of_nodes;
+    int num_of_paths;
+} json_path_set_t;
+
+
+/**
+ * @brief Flags describing a value found during parsing (json_token_info_t::values_flags).
+ */
+enum json_value_flags
+{
+    json_value_has_escapes = 1          /* (string) value contains escape sequences (e.g. \" or \u00e9) */
 };
 
 
+/**
+ * @brief Struct holding the state of a JSON writer. It is used to create (structured)
+ *        JSON values directly in the output buffer (e.g. the response buffer),
+ *        taking care of separators and of the space available.
+ */
+typedef struct json_writer
+{
+    char* cursor;          /* where the next value will be written (or NULL if nothing is to be written) */
+    char* end;             /* end of the space available for writing */
+    char* start;           /* where the writing has begun */
+    uint64_t has_members;  /* bit per nesting level: set if the current object / list has members already */
+    int depth;
+    int after_key;
+    int overflow;          /* set if there was not enough space (or nesting was deeper than 63 levels) */
+} json_writer_t;
+
+
 /* Exported functions ------------------------------------------------------- */
 
 /* RPC specific functions ---------------------------------------------- */
@@ -152,6 +621,295 @@ void json_rpc_init(json_rpc_instance_t* self, json_rpc_handler_t* table_for_hand
 void json_rpc_register_handler(json_rpc_instance_t* self, const char* fcn_name, json_rpc_handler_fcn handler);
 
 
+/**
+ * @brief Registers a new handler, setting its flags.
+ * @param self pointer to the json_rpc_instance_t object.
+ * @param fcn_name name of the function (as it appears in RCP request).
+ * @param handler pointer to the function handler (function of json_rpc_handler_fcn type).
+ * @param flags combination (bitwise-or) of json_rpc_handler_flags.
+ */
+void json_rpc_register_handler(json_rpc_instance_t* self, const char* fcn_name, json_rpc_handler_fcn handler,
+                               unsigned int flags);
+
+
+/**
+ * @brief Registers a new handler with a params schema. Before the handler is called, params are
+ *        validated and extracted (in one pass) as described by the schema, and the handler can
+ *        find them in info->params (in the order of the schema). If a required param is missing or
+ *        can't be converted to its type, json_rpc_err_invalid_params error is responded without
+ *        calling the handler.
+ * @param self pointer to the json_rpc_instance_t object.
+ * @param fcn_name name of the function (as it appears in RCP request).
+ * @param handler pointer to the function handler (function of json_rpc_handler_fcn type).
+ * @param flags combination (bitwise-or) of json_rpc_handler_flags.
+ * @param params_schema pointer to a table describing params (it is not copied, so it should remain valid).
+ * @param num_of_params number of items in above table (up to JSON_RPC_MAX_SCHEMA_PARAMS).
+ */
+void json_rpc_register_handler(json_rpc_instance_t* self, const char* fcn_name, json_rpc_handler_fcn handler,
+                               unsigned int flags, const json_rpc_param_spec_t* params_schema, int num_of_params);
+
+
+/**
+ * @brief Initialises response cache.
+ * @param cache pointer to the json_rpc_cache_t object.
+ * @param storage_for_entries pointer to an allocated table of cache entries.
+ * @param max_num_of_entries number of items above table can hold (only a multiple of 4 is used).
+ */
+void json_rpc_cache_init(json_rpc_cache_t* cache, json_rpc_cache_entry_t* storage_for_entries, int max_num_of_entries);
+
+
+/**
+ * @brief Sets how long a pending result is waited for. Without a clock (the default), a pending result
+ *        is stale when an identical call waited JSON_RPC_CACHE_WAIT_SPINS for it in vain; with a clock,
+ *        when it was claimed more than pending_timeout ago (and then its entry can also be evicted).
+ * @param cache pointer to the json_rpc_cache_t object.
+ * @param clock function returning current time (or NULL to use the spin count).
+ * @param pending_timeout time (in ticks of above clock) after which a pending result is stale.
+ */
+void json_rpc_cache_set_timeout(json_rpc_cache_t* cache, json_rpc_clock_fcn clock, uint64_t pending_timeout);
+
+
+/**
+ * @brief Removes all entries from the response cache. It should not be called while the cache
+ *        is used by rpc instances.
+ */
+void json_rpc_cache_clear(json_rpc_cache_t* cache);
+
+
+/**
+ * @brief Enables response cache for the rpc instance: results of calls to methods registered
+ *        as json_rpc_handler_cacheable (that fit in the cache entry) are cached, and calls with the same
+ *        params (regardless of whitespace) are responded to using cached results (with their own id),
+ *        without calling the handler at all. The same cache can be used by many instances.
+ * @param self pointer to the json_rpc_instance_t object.
+ * @param cache pointer to the initialised cache (or NULL to disable caching).
+ */
+void json_rpc_enable_cache(json_rpc_instance_t* self, json_rpc_cache_t* cache);
+
+
+/**
+ * @brief Initialises handler registry.
+ * @param registry pointer to the json_rpc_registry_t object.
+ * @param handlers pointer to the (initialised) instance with handlers to be used at first.
+ */
+void json_rpc_registry_init(json_rpc_registry_t* registry, json_rpc_instance_t* handlers);
+
+
+/**
+ * @brief Makes the rpc instance use handlers published in the registry (instead of its own).
+ *        The same registry can be used by many instances (e.g. one per thread). Note that stats
+ *        (if enabled) are kept by position of handlers, so they should be reset when handlers are published.
+ * @param self pointer to the json_rpc_instance_t object.
+ * @param registry pointer to the initialised registry (or NULL to use own handlers).
+ */
+void json_rpc_enable_registry(json_rpc_instance_t* self, json_rpc_registry_t* registry);
+
+
+/**
+ * @brief Publishes new handlers: requests that start after this call will use them. Requests that
+ *        are in progress complete with previous handlers, and the call waits for them (only one thread
+ *        should publish at a time). Handlers of the published instance should not be changed.
+ *        It must not be called from a handler of an instance using the registry (it would wait for the
+ *        request of that handler): use json_rpc_registry_publish_in_handler() there.
+ * @param registry pointer to the json_rpc_registry_t object.
+ * @param handlers pointer to the instance with handlers to be used.
+ * @returns instance with handlers used before, that is no longer used (so it can be changed and re-published).
+ */
+json_rpc_instance_t* json_rpc_registry_publish(json_rpc_registry_t* registry, json_rpc_instance_t* handlers);
+
+
+/**
+ * @brief Publishes new handlers from a handler (e.g. of a 'reload' method) of an instance using the registry,
+ *        as json_rpc_registry_publish(), but without waiting for the request of the calling handler.
+ * @param self pointer to the json_rpc_instance_t object that called the handler.
+ * @param handlers pointer to the instance with handlers to be used.
+ * @returns instance with handlers used before: it is still used by the calling request, so it can be
+ *          changed only after the handler returns.
+ */
+json_rpc_instance_t* json_rpc_registry_publish_in_handler(json_rpc_instance_t* self, json_rpc_instance_t* handlers);
+
+
+/**
+ * @brief Initialises limits of calls to a method.
+ * @param limit pointer to the json_rpc_limit_t object.
+ * @param max_in_flight max number of calls in progress at the same time (0: no limit).
+ * @param calls_per_second rate limit (0: no limit).
+ * @param burst number of calls that can be made at once (above the rate limit), at least 1.
+ * @param clock function returning current time (for rate limit).
+ * @param ticks_per_second resolution of above clock.
+ */
+void json_rpc_limit_init(json_rpc_limit_t* limit, uint32_t max_in_flight, uint32_t calls_per_second, uint32_t burst,
+                         json_rpc_clock_fcn clock, uint64_t ticks_per_second);
+
+
+/**
+ * @brief Sets limits of calls to a registered method.
+ * @param self pointer to the json_rpc_instance_t object.
+ * @param fcn_name name of the (registered) function.
+ * @param limit pointer to the initialised limit (or NULL to remove limits).
+ * @returns 1 if the function was found, 0 otherwise.
+ */
+int json_rpc_set_limit(json_rpc_instance_t* self, const char* fcn_name, json_rpc_limit_t* limit);
+
+
+/**
+ * @brief Initialises a scheduler of requests.
+ * @param scheduler pointer to the json_rpc_scheduler_t object.
+ * @param storage_for_slots pointer to an allocated table of (json_rpc_num_of_priorities * slots_per_priority) slots.
+ * @param slots_per_priority max number of queued requests of each priority (a power of 2).
+ * @param max_bypass how many times requests of a priority can be passed over by requests of higher priorities.
+ * @returns 1 if initialised, 0 if slots_per_priority is not a power of 2.
+ */
+int json_rpc_scheduler_init(json_rpc_scheduler_t* scheduler, json_rpc_queue_slot_t* storage_for_slots,
+                            int slots_per_priority, int max_bypass);
+
+
+/**
+ * @brief Queues a request (to be handled later, e.g. by a different thread). Its priority is taken from
+ *        flags of the handler(s) of its method(s) (for a batch - the lowest one), so that e.g. control
+ *        and health requests are not queued behind bulk requests.
+ * @param scheduler pointer to the json_rpc_scheduler_t object.
+ * @param self pointer to the json_rpc_instance_t object with handlers.
+ * @param request_data pointer to the request (it is not copied, so it should remain valid until handled).
+ * @returns 1 if the request was queued, 0 if the queue (of its priority) was full.
+ */
+int json_rpc_schedule(json_rpc_scheduler_t* scheduler, json_rpc_instance_t* self, json_rpc_data_t* request_data);
+
+
+/**
+ * @brief Takes the next request to be handled from the scheduler.
+ * @param scheduler pointer to the json_rpc_scheduler_t object.
+ * @returns pointer to the request data (to be passed to json_rpc_handle_request()), or NULL if no
+ *          request is queued.
+ */
+json_rpc_data_t* json_rpc_scheduler_next(json_rpc_scheduler_t* scheduler);
+
+
+/**
+ * @brief Initialises a capture of requests. Requests are recorded (as they are, with their timestamps)
+ *        into a compact binary log: a header (JSON_RPC_CAPTURE_MAGIC and ticks per second) followed by
+ *        records (timestamp, length and the request), with numbers in big-endian byte order.
+ *        The log is collected in the buffer, and passed to the flush function when the buffer is full
+ *        (or when json_rpc_capture_flush() is called), e.g. to be written to a file. With a flush function
+ *        the buffer is split in two halves: one is filled while the other is flushed (without holding
+ *        the lock), and requests that don't fit in the half are dropped.
+ * @param capture pointer to the json_rpc_capture_t object.
+ * @param buffer buffer for the log (at least JSON_RPC_CAPTURE_HEADER_LEN).
+ * @param buffer_len size of the buffer.
+ * @param clock function returning timestamps.
+ * @param ticks_per_second number of clock ticks per second (recorded in the header).
+ * @param flush function called with the collected log (if NULL, requests that don't fit are dropped).
+ * @param flush_arg argument passed to the flush function.
+ */
+void json_rpc_capture_init(json_rpc_capture_t* capture, char* buffer, int buffer_len, json_rpc_clock_fcn clock,
+                           uint64_t ticks_per_second, json_rpc_capture_flush_fcn flush, void* flush_arg);
+
+
+/**
+ * @brief Enables capture of requests handled by an instance (the capture can be shared by instances).
+ * @param self pointer to the json_rpc_instance_t object.
+ * @param capture pointer to the initialised capture (or NULL to disable capturing).
+ */
+void json_rpc_enable_capture(json_rpc_instance_t* self, json_rpc_capture_t* capture);
+
+
+/**
+ * @brief Passes the log collected so far to the flush function (if there is any).
+ * @param capture pointer to the json_rpc_capture_t object.
+ */
+void json_rpc_capture_flush(json_rpc_capture_t* capture);
+
+
+/**
+ * @brief Checks the header of a capture log.
+ * @param log pointer to the log.
+ * @param log_len length of the log.
+ * @param ticks_per_second (out) number of clock ticks per second of timestamps.
+ * @returns position of the first record, or -1 if it is not a capture log.
+ */
+int64_t json_rpc_capture_open(const char* log, int64_t log_len, uint64_t* ticks_per_second);
+
+
+/**
+ * @brief Reads a record of a capture log.
+ * @param log pointer to the log.
+ * @param log_len length of the log.
+ * @param pos position of the record (e.g. returned by json_rpc_capture_open() or by previous call).
+ * @param timestamp (out) timestamp of the request.
+ * @param request (out) pointer to the request (within the log).
+ * @param request_len (out) length of the request.
+ * @returns position of the next record, or -1 if there are no more (complete) records.
+ */
+int64_t json_rpc_capture_next(const char* log, int64_t log_len, int64_t pos,
+                              uint64_t* timestamp, const char** request, int* request_len);
+
+
+/**
+ * @brief Sets options for the rpc instance.
+ * @param self pointer to the json_rpc_instance_t object.
+ * @param options combination (bitwise-or) of json_rpc_options (all options are off after json_rpc_init()).
+ */
+void json_rpc_set_options(json_rpc_instance_t* self, unsigned int options);
+
+
+/**
+ * @brief Sets limits of work done to parse requests: requests that are too long, or nested too deep,
+ *        or have too many members, are rejected with 'Invalid Request' (in one pass, before anything else
+ *        is done), and extraction of params fails when the limit of steps is reached.
+ *        As nesting is limited, extraction of a param takes time that is linear in the length of the request.
+ * @param self pointer to the json_rpc_instance_t object.
+ * @param budget pointer to limits (they are not copied, so they can be changed later), or NULL for no limits.
+ */
+void json_rpc_set_parse_budget(json_rpc_instance_t* self, const json_parse_budget_t* budget);
+
+
+/**
+ * @brief Enables collection of stats for the rpc instance.
+ * @param self pointer to the json_rpc_instance_t object.
+ * @param table_for_stats pointer to an allocated table that will hold stats for this instance: stats of
+ *        a method are at the same position as its handler, and the last item holds stats for requests
+ *        that were not dispatched to any handler (i.e. invalid requests and methods not found),
+ *        so the table should have max_num_of_handlers + 1 items. Table is zeroed when stats are enabled.
+ * @param num_of_stats number of items above table can hold.
+ * @param clock clock function to measure time (or NULL: then only calls and errors are counted).
+ */
+void json_rpc_enable_stats(json_rpc_instance_t* self, json_rpc_method_stats_t* table_for_stats, int num_of_stats,
+                           json_rpc_clock_fcn clock);
+
+
+/**
+ * @brief Enables tracing of requests handled by the rpc instance. Events are recorded
+ *        only if the library is built with JSON_RPC_TINY_TRACE defined (otherwise tracing
+ *        is compiled-out and has no cost at all).
+ * @param self pointer to the json_rpc_instance_t object.
+ * @param trace pointer to the trace object to be initialised (or NULL to disable tracing).
+ * @param storage_for_events pointer to an allocated table for the ring buffer of events.
+ * @param max_num_of_events number of items above table can hold (only the highest power of 2
+ *        not greater than it is used).
+ */
+void json_rpc_enable_trace(json_rpc_instance_t* self, json_rpc_trace_t* trace,
+                           json_rpc_trace_event_t* storage_for_events, int max_num_of_events);
+
+
+/**
+ * @brief Function to export events recorded in the trace of the rpc instance in Chrome trace
+ *        event format (as used by chrome://tracing and Perfetto). Each request is shown as 'parse'
+ *        and handler (method name) slices, dispatch and response are shown as instant events.
+ *        Events are written as items of a list, so events of a number of instances can be exported
+ *        to the same file, e.g. (for a complete trace file):
+ *            json_writer_init(&w, buf, buf_len); json_writer_begin_array(&w);
+ *            json_rpc_trace_export(&rpc1, &w, ticks_per_us, 1); json_rpc_trace_export(&rpc2, &w, ticks_per_us, 2);
+ *            json_writer_end_array(&w);
+ *        Handler names are taken from the handlers in use (published in the registry, if it is enabled).
+ *        It can be called also from handlers (e.g. of an instance using the same registry).
+ * @param self pointer to the json_rpc_instance_t object (with tracing enabled).
+ * @param writer JSON writer (in a list) to write events to.
+ * @param ticks_per_us number of timestamp ticks per microsecond (timestamps are exported in microseconds).
+ * @param thread_id thread id to be reported for the events of this instance.
+ */
+void json_rpc_trace_export(json_rpc_instance_t* self, json_writer_t* writer, double ticks_per_us, int thread_id);
+
+
 /**
  * @brief Method to handle RPC request. As a result, one of the registered handlers might be executed
  *        (if the function name from RFC request matches name for which a handler was registered).
@@ -159,12 +917,25 @@ void json_rpc_register_handler(json_rpc_instance_t* self, const char* fcn_name,
  * @param request_data pointer to a structure holding information about the request string,
  *        information where the resulting response is to be stored (if any), and additional information
  *        to be passed to the handler (see json_rpc_data_t for more info).
+ *        Requests encoded as MessagePack (detected from the first byte, see json_is_msgpack()) are
+ *        converted to JSON at the end of the response buffer, handled as usual (handlers are the same),
+ *        and the response is converted to MessagePack. The response buffer needs space for both
+ *        the request and the response (as JSON) in such case.
  * @return Pointer to buffer containing the response (the same buffer as passed in request_data).
  *         If the request was a notification only, this buffer will be empty.
+ *         (See json_rpc_response_len() on how to get the length of the response).
  */
 char* json_rpc_handle_request(json_rpc_instance_t* self, json_rpc_data_t* request_data);
 
 
+/**
+ * @brief Returns length of the response written by json_rpc_handle_request(), i.e. length of the
+ *        (null-terminated) JSON response, or of the MessagePack response (which is not null-terminated).
+ * @param request_data pointer to a structure holding information about the request and response.
+ */
+int json_rpc_response_len(const json_rpc_data_t* request_data);
+
+
 /**
  * @brief Function to create an RPC response. It is designed to be used
  *        in the handler to create RCP response (in the response buffer).
@@ -201,6 +972,51 @@ char* json_rpc_create_error(int err_code, rpc_request_info_t* info);
 char* json_rpc_create_error(const char* err_msg, rpc_request_info_t* info);
 
 
+/**
+ * @brief Function to begin creating an RPC result directly in the response buffer.
+ *        It writes everything that precedes the result value and returns a cursor at which
+ *        the handler can write the value itself (e.g. using json_format_* functions), so that
+ *        the result doesn't have to be formatted in a temporary buffer first and copied.
+ *        The result has to be completed using json_rpc_result_end().
+ * @param info pointer to the rpc_request_info_t structure that was passed to the handler.
+ * @returns cursor within the response buffer, or NULL if no response is to be created
+ *          (i.e. for notifications or if there is no response buffer).
+ */
+char* json_rpc_result_begin(rpc_request_info_t* info);
+
+
+/**
+ * @brief Function to complete the result started using json_rpc_result_begin().
+ * @param cursor position just past the last character of the result value written
+ *        (or NULL, as returned by json_rpc_result_begin() for notifications).
+ * @param info pointer to the rpc_request_info_t structure that was passed to the handler.
+ * @returns pointer to the response buffer (as json_rpc_create_result() does).
+ */
+char* json_rpc_result_end(char* cursor, rpc_request_info_t* info);
+
+
+/**
+ * @brief Function to begin creating a (structured) RPC result using JSON writer (see json_writer_*
+ *        functions), that writes the result directly in the response buffer. The result has to be
+ *        completed using json_rpc_writer_end(). For notifications writer functions will do nothing,
+ *        so handlers can be implemented the same way for requests and notifications.
+ * @param writer pointer to the json_writer_t object to be initialised.
+ * @param info pointer to the rpc_request_info_t structure that was passed to the handler.
+ */
+void json_rpc_writer_begin(json_writer_t* writer, rpc_request_info_t* info);
+
+
+/**
+ * @brief Function to complete the result created using json_rpc_writer_begin().
+ *        If the result didn't fit in the response buffer, it is replaced with
+ *        the 'Internal error' error response.
+ * @param writer pointer to the json_writer_t object used to write the result.
+ * @param info pointer to the rpc_request_info_t structure that was passed to the handler.
+ * @returns pointer to the response buffer (as json_rpc_create_result() does).
+ */
+char* json_rpc_writer_end(json_writer_t* writer, rpc_request_info_t* info);
+
+
 /* Functions to aid extraction of RPC call parameters (by name or order) */
 
 /**
@@ -257,6 +1073,94 @@ const char* rpc_extract_param_str(int member_no_zero_based, int* str_length, rpc
 int rpc_extract_param_int(int member_no_zero_based, int* result, rpc_request_info_t* info);
 
 
+/**
+ * @brief Function to extract value of a named parameter as a string view, i.e. as a string
+ *        within the original request buffer, with information whether it contains escape sequences.
+ *        (See json_str_view_decode() on how to get the decoded string).
+ * @param param_name null-terminated name of the named parameter to extract.
+ * @param view (out) pointer to the json_str_view_t object to be updated if param is found.
+ * @param info pointer to the rpc_request_info_t structure that was passed to the handler.
+ * @returns non-zero if parameter was found, zero-otherwise.
+ */
+int rpc_extract_param_view(const char* param_name, json_str_view_t* view, rpc_request_info_t* info);
+
+
+/**
+ * @brief Function to extract value of a parameter (given its position) as a string view.
+ * @param member_no_zero_based zero-based member number.
+ * @param view (out) pointer to the json_str_view_t object to be updated if param is found.
+ * @param info pointer to the rpc_request_info_t structure that was passed to the handler.
+ * @returns non-zero if parameter was found, zero-otherwise.
+ */
+int rpc_extract_param_view(int member_no_zero_based, json_str_view_t* view, rpc_request_info_t* info);
+
+
+/**
+ * @brief Functions to extract value of a nested parameter given its path (see json_path_compile()),
+ *        e.g. "/filter/range/3/min" or "filter.range[3].min". Path is relative to params, but if params
+ *        are a list and the path starts with a name, it is looked up in the first member of the list
+ *        (as params are often passed as [{...}]). Paths given as strings are compiled for each call,
+ *        so in handlers called often use paths compiled once.
+ * @param path path to the parameter (null-terminated string or compiled path).
+ * @param str_length / result / view (out) as for rpc_extract_param_str() / rpc_extract_param_int() /
+ *        rpc_extract_param_view().
+ * @param info pointer to the rpc_request_info_t structure that was passed to the handler.
+ * @returns pointer to the value (or NULL) / non-zero if value was found (and converted).
+ */
+const char* rpc_extract_param_path(const char* path, int* str_length, rpc_request_info_t* info);
+const char* rpc_extract_param_path(const json_path_t* path, int* str_length, rpc_request_info_t* info);
+int rpc_extract_param_path_int(const char* path, int* result, rpc_request_info_t* info);
+int rpc_extract_param_path_int(const json_path_t* path, int* result, rpc_request_info_t* info);
+int rpc_extract_param_path_view(const json_path_t* path, json_str_view_t* view, rpc_request_info_t* info);
+
+
+/**
+ * @brief Function to extract values of all paths of a set (see json_extract_paths()) from params
+ *        (looked up in the first member of the list if params are a list and no path starts with a number).
+ * @param set pointer to the set of paths.
+ * @param slots (out) table of views (a slot for each path, as returned by json_path_set_add()).
+ * @param info pointer to the rpc_request_info_t structure that was passed to the handler.
+ * @returns number of values found.
+ */
+int rpc_extract_param_paths(const json_path_set_t* set, json_str_view_t* slots, rpc_request_info_t* info);
+
+
+/* Functions to aid processing of stats ---------------------------------------------- */
+
+/**
+ * @brief Function to merge (add) stats. It can be used from a different thread than the one
+ *        updating stats that are read, so it can be used to snapshot / aggregate stats of instances
+ *        used in different threads.
+ * @param into pointer to the table of stats to be updated.
+ * @param from pointer to the table of stats to be added.
+ * @param num_of_stats number of items in both tables.
+ */
+void json_rpc_stats_merge(json_rpc_method_stats_t* into, const json_rpc_method_stats_t* from, int num_of_stats);
+
+
+/**
+ * @brief Function to take a snapshot (copy) of stats (see json_rpc_stats_merge()).
+ */
+void json_rpc_stats_snapshot(json_rpc_method_stats_t* into, const json_rpc_method_stats_t* from, int num_of_stats);
+
+
+/**
+ * @brief Function to find latency (in ticks) below which given part of calls completed.
+ * @param stats pointer to stats of a method.
+ * @param per_mille part of calls (e.g. 500 for median, 990 for 99th percentile).
+ * @returns lower bound of the histogram bucket containing this percentile (or 0 if there are no calls).
+ */
+uint64_t json_rpc_stats_percentile(const json_rpc_method_stats_t* stats, int per_mille);
+
+
+/**
+ * @brief Functions to convert time (ticks) to the latency histogram bucket number (and back):
+ *        there are 4 buckets per each power of 2 (so buckets are accurate to within 25%).
+ */
+int json_rpc_latency_bucket(uint64_t ticks);
+uint64_t json_rpc_latency_bucket_min(int bucket);
+
+
 /* generic JSON extraction functions ---------------------------------------------- */
 
 /**
@@ -351,6 +1255,127 @@ int json_extract_member_int(const char* member_name, int* result, const char* in
  */
 int json_extract_member_int(int member_no_zero_based, int* result, const char* input, int input_len);
 
+/**
+ * @brief Function to extract the member of a given name as a string view (see json_str_view_t).
+ *        Object/list boundaries are crossed during the search (i.e. the whole JSON is inspected).
+ * @param member_name zero-terminated name of the member to find.
+ * @param view (out) pointer to the json_str_view_t object to be updated if member is found.
+ * @param input Input string.
+ * @param input_len length of the input.
+ * @returns non-zero if member was found, zero-otherwise.
+ */
+int json_extract_member_view(const char* member_name, json_str_view_t* view, const char* input, int input_len);
+
+
+/**
+ * @brief Function to extract the member of a given number as a string view (see json_str_view_t).
+ * @param member_no_zero_based zero-based number of the member to find in current object / list.
+ * @param view (out) pointer to the json_str_view_t object to be updated if member is found.
+ * @param input Input string.
+ * @param input_len length of the input.
+ * @returns non-zero if member was found, zero-otherwise.
+ */
+int json_extract_member_view(int member_no_zero_based, json_str_view_t* view, const char* input, int input_len);
+
+
+/**
+ * @brief Function to get the decoded string of a string view. If the string has no escape sequences
+ *        it is not copied (pointer to the original string is returned), otherwise it is decoded
+ *        (including \uXXXX sequences and surrogate pairs, which are converted to UTF-8) into the storage.
+ * @param view pointer to the string view.
+ * @param storage buffer for the decoded string (only used if string contains escape sequences).
+ * @param storage_len size of the storage (decoded string is never longer than the original).
+ * @param decoded_len (out) length of the decoded string.
+ * @returns pointer to the decoded string (not null-terminated), or NULL if it could not be
+ *          decoded (i.e. invalid escape sequence or not enough storage).
+ */
+const char* json_str_view_decode(const json_str_view_t* view, char* storage, int storage_len, int* decoded_len);
+
+
+/**
+ * @brief Function to compile a path to a nested value: either a JSON Pointer (RFC 6901), i.e. "/filter/range/3/min"
+ *        (with ~0 for '~' and ~1 for '/' in names), or a dotted path, i.e. "filter.range[3].min" (or "filter.range.3.min").
+ *        Segments that are numbers select a position when the value is a list (or a member with that name
+ *        when it is an object). An empty path selects the whole input.
+ * @param path (out) pointer to the json_path_t object.
+ * @param path_str null-terminated path.
+ * @returns non-zero if compiled, zero if path is not valid or too long (see JSON_PATH_MAX_SEGMENTS / _NAMES_LEN).
+ */
+int json_path_compile(json_path_t* path, const char* path_str);
+
+
+/**
+ * @brief Functions to extract a nested value given its compiled path. The input is walked once, from its
+ *        beginning to the value: only members on the path are looked into, others are skipped as a whole.
+ *        Names are compared with member names as they are in the input (escape sequences are not decoded).
+ * @param path pointer to the compiled path.
+ * @param str_length / view (out) length of the value (for strings: without quotes) / view of the value.
+ * @param input Input string.
+ * @param input_len length of the input.
+ * @returns pointer to the value (or NULL) / non-zero if value was found.
+ */
+const char* json_extract_path_str(const json_path_t* path, int* str_length, const char* input, int input_len);
+int json_extract_path_view(const json_path_t* path, json_str_view_t* view, const char* input, int input_len);
+
+
+/**
+ * @brief Function to initialise a set of paths (e.g. once at startup, for a handler that extracts many values).
+ * @param set pointer to the json_path_set_t object.
+ * @param storage_for_nodes table for nodes: a node for each segment of each path (nodes of common
+ *        beginnings of paths are shared).
+ * @param max_num_of_nodes number of items in above table.
+ */
+void json_path_set_init(json_path_set_t* set, json_path_node_t* storage_for_nodes, int max_num_of_nodes);
+
+
+/**
+ * @brief Function to add a path to a set (see json_path_compile() for path syntax).
+ * @param set pointer to the json_path_set_t object.
+ * @param path null-terminated path.
+ * @returns slot number for values of this path (slots are numbered from 0, in order paths were added,
+ *          and the same path has the same slot), or -1 if path is not valid, or there's not enough nodes.
+ */
+int json_path_set_add(json_path_set_t* set, const char* path);
+
+
+/**
+ * @brief Function to extract values of all paths of a set in one pass over the input: members that are
+ *        not on any path are skipped as a whole (not looked into), and it stops when all values are found.
+ * @param set pointer to the set of paths.
+ * @param slots (out) table of views (a slot for each path): slots of values that were not found have
+ *        start set to NULL (and len to 0).
+ * @param input Input string.
+ * @param input_len length of the input.
+ * @returns number of values found.
+ */
+int json_extract_paths(const json_path_set_t* set, json_str_view_t* slots, const char* input, int input_len);
+
+
+/**
+ * @brief Function to convert a value (e.g. extracted as a view) to an integer (decimal, hex or octal).
+ * @returns non-zero if converted, zero-otherwise (also if the value doesn't fit in int).
+ */
+int json_str_view_to_int(const json_str_view_t* view, int* result);
+
+
+/**
+ * @brief Function to convert a value to a 64-bit integer (as json_str_view_to_int()).
+ * @returns non-zero if converted, zero-otherwise (also if the value doesn't fit in int64_t).
+ */
+int json_str_view_to_int64(const json_str_view_t* view, int64_t* result);
+
+
+/**
+ * @brief Function to decode (unescape) a JSON string.
+ * @param from string to decode (without quotes).
+ * @param len length of the string.
+ * @param to buffer for the decoded string (it can be the same as from, to decode in place).
+ * @param to_len size of the buffer.
+ * @returns length of the decoded string, or -1 on invalid escape sequence or if it didn't fit.
+ */
+int json_unescape(const char* from, int len, char* to, int to_len);
+
+
 /**
  * @brief Function to check if member pointed by info token is an object.
  */
@@ -372,6 +1397,147 @@ int json_next_member_is_object(const char* input, struct json_token_info* info);
 int json_next_member_is_object_or_list(const char* input, struct json_token_info* info);
 
 
+/**
+ * @brief Function to validate JSON text, i.e. to check that it is valid (as per RFC 8259) and
+ *        contains valid UTF-8 only. Unlike other functions that extract members from the input
+ *        (and are permissive), it checks the whole input, but it is fast: runs of plain characters
+ *        within strings are checked several at a time. Objects and lists nested deeper than 63 levels
+ *        are rejected (nesting is tracked with a bit per level).
+ * @param input Input string.
+ * @param input_len length of the input.
+ * @returns non-zero (bool) if input contains a single valid JSON value (and whitespace only), zero-otherwise.
+ */
+int json_validate(const char* input, int input_len);
+
+
+/**
+ * @brief Function to check that JSON text is within limits of a parse budget (in one pass, without validating it).
+ *        Members are only counted for objects and lists nested up to JSON_BUDGET_MAX_DEPTH.
+ * @param input Input string.
+ * @param input_len length of the input.
+ * @param budget pointer to limits to check.
+ * @returns json_budget_ok, or one of json_budget_results describing the limit that was exceeded.
+ */
+int json_check_budget(const char* input, int input_len, const json_parse_budget_t* budget);
+
+
+/* MessagePack conversion functions ---------------------------------------------- */
+
+/**
+ * @brief Function to check if the input is MessagePack rather than JSON text, i.e. if it starts with
+ *        a MessagePack map or array (JSON text can only start with whitespace, '{' or '[').
+ * @param input Input data.
+ * @param input_len length of the input.
+ * @returns non-zero (bool) if input is MessagePack.
+ */
+int json_is_msgpack(const char* input, int input_len);
+
+
+/**
+ * @brief Function to convert a MessagePack value to JSON text. Supported are all MessagePack types
+ *        other than bin and ext (map keys have to be strings), nested at most JSON_RPC_MSGPACK_MAX_DEPTH.
+ * @param input Input data (MessagePack).
+ * @param input_len length of the input.
+ * @param output buffer for JSON text.
+ * @param output_len size of the buffer.
+ * @returns length of the JSON text (it is also null-terminated), or -1 if the input was not valid
+ *          (or not supported) or it didn't fit in the output.
+ */
+int json_from_msgpack(const char* input, int input_len, char* output, int output_len);
+
+
+/**
+ * @brief Function to convert JSON text to MessagePack (using the smallest encoding of each value;
+ *        integers are encoded as integers, other numbers as float64). Output can overlap the input, as
+ *        long as it starts before it (e.g. in the same buffer), in which case conversion fails if output
+ *        would overwrite input that was not yet converted.
+ * @param input Input string (JSON).
+ * @param input_len length of the input.
+ * @param output buffer for MessagePack data.
+ * @param output_len size of the buffer.
+ * @returns length of the MessagePack data, or -1 if the input was not valid or it didn't fit in the output.
+ */
+int json_to_msgpack(const char* input, int input_len, char* output, int output_len);
+
+
+/* generic JSON formatting functions ---------------------------------------------- */
+
+/**
+ * @brief Function to write an integer value (in decimal) at the given position.
+ *        It does not allocate any memory and writes two digits at a time.
+ * @param to position at which the value will be written (at least JSON_FORMAT_INT_MAX_LEN+1 chars).
+ * @param value value to be written.
+ * @returns position just past the last character written (the output is also null-terminated).
+ */
+char* json_format_int(char* to, int64_t value);
+
+
+/**
+ * @brief Function to write a floating point value at the given position, using a round-trip
+ *        representation: it converts back to the same value (e.g. 0.1 is written as "0.1"). It is
+ *        usually, but (as Grisu2 is used) not always, the shortest one.
+ *        Exponent notation is used for very small / big values (e.g. "1e+21", "5e-324").
+ *        As NaN and Infinity can't be represented in JSON, "null" is written for them.
+ * @param to position at which the value will be written (at least JSON_FORMAT_DOUBLE_MAX_LEN+1 chars).
+ * @param value value to be written.
+ * @returns position just past the last character written (the output is also null-terminated).
+ */
+char* json_format_double(char* to, double value);
+
+
+/**
+ * @brief Function to write a string as a JSON string value (i.e. in quotes and with all characters
+ *        that require it escaped) at the given position. Characters not requiring escaping
+ *        are detected several at a time and copied as they are.
+ * @param to position at which the value will be written (at most 6*len+2 chars will be written).
+ * @param from string to be written.
+ * @param len length of the string (or negative if the string is null-terminated).
+ * @returns position just past the last character written (the output is also null-terminated).
+ */
+char* json_format_str(char* to, const char* from, int len);
+
+
+/**
+ * @brief Function to initialise JSON writer to write values into the given buffer.
+ *        Writer functions check the space left before writing, so the output is never
+ *        written past the buffer (writer.overflow is set instead and nothing else is written).
+ *        Output is always null-terminated.
+ * @param writer pointer to the json_writer_t object to be initialised.
+ * @param buf buffer for the output (or NULL: then nothing will be written).
+ * @param buf_len size of the buffer.
+ */
+void json_writer_init(json_writer_t* writer, char* buf, int buf_len);
+
+/**
+ * @brief Functions to begin / end an object or a list (array) (i.e. write '{', '}', '[', ']').
+ *        Separators between members / list elements are written automatically.
+ */
+void json_writer_begin_object(json_writer_t* writer);
+void json_writer_end_object(json_writer_t* writer);
+void json_writer_begin_array(json_writer_t* writer);
+void json_writer_end_array(json_writer_t* writer);
+
+/**
+ * @brief Function to write name (key) of the next member of the current object.
+ *        It should be followed by a call to one of value / begin functions.
+ * @param key null-terminated name of the member.
+ */
+void json_writer_key(json_writer_t* writer, const char* key);
+
+/**
+ * @brief Functions to write values (as members of the current object / list or as top-level values).
+ *        json_writer_value_str() writes a string in quotes (escaping it as needed,
+ *        len can be negative for null-terminated strings), json_writer_value_raw() writes
+ *        already formatted JSON 'as is'.
+ */
+void json_writer_value_int(json_writer_t* writer, int64_t value);
+void json_writer_value_double(json_writer_t* writer, double value);
+void json_writer_value_bool(json_writer_t* writer, int value);
+void json_writer_value_null(json_writer_t* writer);
+void json_writer_value_str(json_writer_t* writer, const char* str, int len);
+void json_writer_value_raw(json_writer_t* writer, const char* json, int len);
+
+
 
 
 #endif /* JSON_RPC_TINY */
@@ -0,0 +1,271 @@
+/**
+ @file    json_rpc_tiny_client.cpp
+ @brief   JSON-RPC client batching concurrent calls (requires pthreads).
+ ___________________________
+
+ The MIT License (MIT)
+
+ Copyright (c) 2013 Lukasz Forynski
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "json_rpc_tiny_client.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+
+/* Private functions ------------------------------------------------------- */
+
+static void reset_batch(json_rpc_client_batch_t* batch, char* buffer, int buffer_len);
+static int add_request(json_rpc_client_batch_t* batch, const char* method, const char* params, uint32_t id);
+static void send_batch(json_rpc_client_t* client, json_rpc_client_batch_t* batch);
+static void pass_response(const json_rpc_client_t* client, json_rpc_client_batch_t* batch, const char* response,
+                          int response_len);
+
+
+/* Exported functions ------------------------------------------------------- */
+
+void json_rpc_client_init(json_rpc_client_t* client, json_rpc_client_send_fcn send, void* send_arg,
+                          char* requests, int requests_len, char* responses, int responses_len)
+{
+    pthread_condattr_t attr;
+
+    pthread_mutex_init(&client->lock, 0);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&client->changed, &attr);
+    pthread_condattr_destroy(&attr);
+
+    client->send = send;
+    client->send_arg = send_arg;
+    reset_batch(&client->batches[0], requests, requests_len / 2);
+    reset_batch(&client->batches[1], requests + requests_len / 2, requests_len / 2);
+    client->open = 0;
+    client->sending = 0;
+    client->responses = responses;
+    client->responses_len = responses_len;
+    client->window_us = JSON_RPC_CLIENT_WINDOW_US;
+    client->max_calls = JSON_RPC_CLIENT_MAX_CALLS;
+    client->next_id = 1;
+    json_path_compile(&client->id_path, "/id");
+    client->calls = 0;
+    client->batches_sent = 0;
+}
+
+void json_rpc_client_destroy(json_rpc_client_t* client)
+{
+    pthread_cond_destroy(&client->changed);
+    pthread_mutex_destroy(&client->lock);
+}
+
+int json_rpc_client_call(json_rpc_client_t* client, const char* method, const char* params,
+                         char* response, int response_len)
+{
+    json_rpc_client_batch_t* batch;
+    json_rpc_client_call_t call;
+    struct timespec deadline;
+    int max_calls = client->max_calls < JSON_RPC_CLIENT_MAX_CALLS ? client->max_calls : JSON_RPC_CLIENT_MAX_CALLS;
+    int i;
+
+    if(max_calls < 1)
+    {
+        max_calls = 1;
+    }
+
+    call.response = response;
+    call.response_len = response_len;
+    call.result = -1;
+    call.done = 0;
+
+    pthread_mutex_lock(&client->lock);
+    while(true)
+    {
+        batch = &client->batches[client->open];
+        if(!batch->num_of_calls && client->next_id > 0x7fff0000)
+        {
+            client->next_id = 1; // (ids are parsed as int, and are consecutive within a batch)
+        }
+        if(batch->num_of_calls < max_calls)
+        {
+            if(add_request(batch, method, params, client->next_id))
+            {
+                break;
+            }
+            if(!batch->num_of_calls)
+            {
+                pthread_mutex_unlock(&client->lock);
+                return -1; // (it doesn't fit even on its own)
+            }
+        }
+        pthread_cond_wait(&client->changed, &client->lock); // (until the batch is taken)
+    }
+    if(!batch->num_of_calls)
+    {
+        batch->first_id = client->next_id;
+    }
+    batch->calls[batch->num_of_calls++] = &call;
+    client->next_id++;
+    client->calls++;
+
+    if(batch->num_of_calls > 1)
+    {
+        if(batch->num_of_calls == max_calls)
+        {
+            pthread_cond_broadcast(&client->changed); // (the first call sends it now)
+        }
+        while(!call.done)
+        {
+            pthread_cond_wait(&client->changed, &client->lock);
+        }
+        pthread_mutex_unlock(&client->lock);
+        return call.result;
+    }
+
+    // the first call of a batch waits for others (and for the previous batch), and sends it
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += (long)client->window_us * 1000;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000;
+    deadline.tv_nsec %= 1000000000;
+    while(batch->num_of_calls < max_calls &&
+          pthread_cond_timedwait(&client->changed, &client->lock, &deadline) != ETIMEDOUT)
+    {
+    }
+    while(client->sending)
+    {
+        pthread_cond_wait(&client->changed, &client->lock);
+    }
+    client->open ^= 1;
+    client->sending = 1;
+    pthread_cond_broadcast(&client->changed); // (calls waiting for space are added to the next batch)
+    pthread_mutex_unlock(&client->lock);
+
+    send_batch(client, batch);
+
+    pthread_mutex_lock(&client->lock);
+    for(i = 0; i < batch->num_of_calls; i++)
+    {
+        batch->calls[i]->done = 1;
+    }
+    reset_batch(batch, batch->writer.start, batch->writer.end - batch->writer.start);
+    client->sending = 0;
+    client->batches_sent++;
+    pthread_cond_broadcast(&client->changed);
+    pthread_mutex_unlock(&client->lock);
+    return call.result;
+}
+
+
+/* Private functions ------------------------------------------------------- */
+
+static void reset_batch(json_rpc_client_batch_t* batch, char* buffer, int buffer_len)
+{
+    json_writer_init(&batch->writer, buffer, buffer_len);
+    json_writer_begin_array(&batch->writer);
+    batch->num_of_calls = 0;
+    batch->first_id = 0;
+}
+
+static int add_request(json_rpc_client_batch_t* batch, const char* method, const char* params, uint32_t id)
+{
+    // request is added only if the batch (with it, and with the end of the array) fits
+    json_writer_t before = batch->writer;
+    json_writer_t closed;
+
+    json_writer_begin_object(&batch->writer);
+    json_writer_key(&batch->writer, "jsonrpc");
+    json_writer_value_str(&batch->writer, "2.0", 3);
+    json_writer_key(&batch->writer, "method");
+    json_writer_value_str(&batch->writer, method, strlen(method));
+    if(params)
+    {
+        json_writer_key(&batch->writer, "params");
+        json_writer_value_raw(&batch->writer, params, strlen(params));
+    }
+    json_writer_key(&batch->writer, "id");
+    json_writer_value_int(&batch->writer, id);
+    json_writer_end_object(&batch->writer);
+
+    closed = batch->writer;
+    json_writer_end_array(&closed); // (written after the request, where the next one would go)
+    if(closed.overflow)
+    {
+        batch->writer = before;
+        return 0;
+    }
+    return 1;
+}
+
+static void send_batch(json_rpc_client_t* client, json_rpc_client_batch_t* batch)
+{
+    int len;
+
+    json_writer_end_array(&batch->writer);
+    len = client->send(batch->writer.start, batch->writer.cursor - batch->writer.start,
+                       client->responses, client->responses_len, client->send_arg);
+    if(len > 0)
+    {
+        pass_response(client, batch, client->responses, len);
+    }
+}
+
+static void pass_response(const json_rpc_client_t* client, json_rpc_client_batch_t* batch, const char* response,
+                          int response_len)
+{
+    // responses (in the batch response, in any order) are passed to calls by their ids
+    json_rpc_client_call_t* call;
+    json_token_info_t info;
+    json_str_view_t id_view;
+    int pos = 0;
+    int id;
+
+    while(pos < response_len && (response[pos] == ' ' || response[pos] == '\t' ||
+                                 response[pos] == '\r' || response[pos] == '\n'))
+    {
+        pos++;
+    }
+    if(pos == response_len || response[pos] != '[')
+    {
+        return; // (e.g. an error for the whole batch)
+    }
+    pos++;
+
+    while(pos < response_len)
+    {
+        pos = json_find_next_member(pos, response, response_len, &info);
+        if(!info.values_len)
+        {
+            break;
+        }
+        if(json_next_member_is_object(response, &info) &&
+           json_extract_path_view(&client->id_path, &id_view, response + info.values_start, info.values_len) &&
+           json_str_view_to_int(&id_view, &id) &&
+           (uint32_t)id - batch->first_id < (uint32_t)batch->num_of_calls)
+        {
+            call = batch->calls[(uint32_t)id - batch->first_id];
+            if(info.values_len < call->response_len)
+            {
+                memcpy(call->response, response + info.values_start, info.values_len);
+                call->response[info.values_len] = 0;
+                call->result = info.values_len;
+            }
+        }
+    }
+}
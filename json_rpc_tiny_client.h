@@ -0,0 +1,158 @@
+/**
+ @file    json_rpc_tiny_client.h
+ @brief   JSON-RPC client batching concurrent calls (requires pthreads).
+ ___________________________
+
+ The MIT License (MIT)
+
+ Copyright (c) 2013 Lukasz Forynski
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ Client that batches calls: calls made (e.g. by many threads) within a short window are sent
+ together, as one JSON-RPC batch (array of requests), and responses from the batch response are
+ passed back to the callers (matched by id). The first call of a batch waits for others (for up to
+ window_us, or until there are max_calls), and sends the batch using a function provided by the user
+ (e.g. over HTTP, or json_rpc_shm_call()); calls made meanwhile are added to the next batch:
+
+     int send_batch(const char* request, int request_len, char* response, int response_len, void* arg)
+     {
+         .. (send the request, and wait for the response)
+         return response_len;
+     }
+
+     json_rpc_client_t client;
+     json_rpc_client_init(&client, send_batch, arg, requests, sizeof(requests), responses, sizeof(responses));
+     ..
+     char response[256];   // (from any thread)
+     int len = json_rpc_client_call(&client, "add", "[1, 2]", response, sizeof(response));
+
+ Only one batch is sent at a time. Requires pthreads.
+*/
+
+#ifndef JSON_RPC_TINY_CLIENT
+#define JSON_RPC_TINY_CLIENT
+
+#include "json_rpc_tiny.h"
+
+#include <pthread.h>
+
+/* Exported defines ------------------------------------------------------------*/
+
+#ifndef JSON_RPC_CLIENT_MAX_CALLS
+#define JSON_RPC_CLIENT_MAX_CALLS   64      /* max number of calls in a batch */
+#endif
+
+#ifndef JSON_RPC_CLIENT_WINDOW_US
+#define JSON_RPC_CLIENT_WINDOW_US   50      /* default time the first call of a batch waits for others */
+#endif
+
+
+/* Exported types ------------------------------------------------------------*/
+
+/**
+ * @brief Type of a function sending a batch (a JSON array of requests), and receiving the response.
+ * @returns length of the response, or -1 on error.
+ */
+typedef int (*json_rpc_client_send_fcn)(const char* request, int request_len, char* response, int response_len,
+                                        void* arg);
+
+
+/**
+ * @brief A call waiting for its response (on the stack of the caller).
+ */
+typedef struct json_rpc_client_call
+{
+    char* response;
+    int response_len;
+    int result;             /* length of the response, or -1 */
+    int done;
+} json_rpc_client_call_t;
+
+
+/**
+ * @brief Batch of calls (ids of calls in a batch are consecutive).
+ */
+typedef struct json_rpc_client_batch
+{
+    json_writer_t writer;   /* (requests are written as they are called) */
+    json_rpc_client_call_t* calls[JSON_RPC_CLIENT_MAX_CALLS];
+    int num_of_calls;
+    uint32_t first_id;
+} json_rpc_client_batch_t;
+
+
+/**
+ * @brief Client (it can be used by many threads).
+ */
+typedef struct json_rpc_client
+{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;         /* (a batch was filled, taken, or its responses were received) */
+    json_rpc_client_send_fcn send;
+    void* send_arg;
+    json_rpc_client_batch_t batches[2];
+    int open;                       /* batch that calls are added to (while the other one can be sent) */
+    int sending;
+    char* responses;
+    int responses_len;
+    uint32_t window_us;             /* (0: a batch is sent when the previous one is done) */
+    int max_calls;                  /* (up to JSON_RPC_CLIENT_MAX_CALLS, 1 to send each call on its own) */
+    uint32_t next_id;
+    json_path_t id_path;            /* (responses are matched by their top-level "id" only) */
+    uint64_t calls;
+    uint64_t batches_sent;
+} json_rpc_client_t;
+
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+ * @brief Initialises the client.
+ * @param client pointer to the json_rpc_client_t object.
+ * @param send function sending batches.
+ * @param send_arg argument passed to the send function.
+ * @param requests buffer for requests (split into two: for the batch being sent, and for the next one).
+ * @param requests_len length of the buffer for requests.
+ * @param responses buffer for the response to a batch.
+ * @param responses_len length of the buffer for responses.
+ */
+void json_rpc_client_init(json_rpc_client_t* client, json_rpc_client_send_fcn send, void* send_arg,
+                          char* requests, int requests_len, char* responses, int responses_len);
+
+
+/**
+ * @brief Releases resources of the client (there can't be any calls in progress).
+ */
+void json_rpc_client_destroy(json_rpc_client_t* client);
+
+
+/**
+ * @brief Calls a method (the call is sent in a batch, with others made at the same time).
+ * @param client pointer to the json_rpc_client_t object.
+ * @param method name of the method.
+ * @param params params (JSON array or object), or NULL.
+ * @param response buffer for the response (the whole response object, e.g. to check if it has an error).
+ * @param response_len length of the buffer.
+ * @returns length of the response, or -1 if it wasn't received, or didn't fit (or the request didn't fit).
+ */
+int json_rpc_client_call(json_rpc_client_t* client, const char* method, const char* params,
+                         char* response, int response_len);
+
+
+#endif /* JSON_RPC_TINY_CLIENT */
@@ -0,0 +1,684 @@
+/**
+ @file    json_rpc_tiny_http.cpp
+ @brief   HTTP/1.1 front-end for JSON-RPC requests (parsing is portable, serving connections requires POSIX sockets).
+ ___________________________
+
+ The MIT License (MIT)
+
+ Copyright (c) 2013 Lukasz Forynski
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "json_rpc_tiny_http.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+
+
+/* Private types and definitions ------------------------------------------------------- */
+
+#define MAX_CHUNK_SIZE          (1 << 30)
+#define MAX_CHUNK_SIZE_DIGITS   16      /* (including leading zeros) */
+
+typedef struct pending_responses
+{
+    struct iovec iov[JSON_RPC_HTTP_MAX_PENDING];
+    int num_of_responses;
+    int used;               /* (part of the output buffer) */
+    uint64_t since_us;      /* when the first of them was ready */
+} pending_responses_t;
+
+
+/* Private functions ------------------------------------------------------- */
+
+static char* find_line_end(char* from, const char* end);
+static int trimmed_line_len(const char* line, const char* line_end);
+static int parse_request_line(const char* line, int line_len, json_rpc_http_request_t* request);
+static int is_equal_lowercase(const char* str, int str_len, const char* lowercase);
+static int has_token(const char* value, int value_len, const char* lowercase);
+static int parse_content_length(const char* value, int value_len);
+static int walk_chunks(char* data, int data_len, int join, int* body_len);
+static char* append(char* to, const char* str);
+static const char* status_text(int status);
+static int send_all(int fd, const char* data, int len);
+static int send_pending(json_rpc_http_conn_t* conn, pending_responses_t* pending);
+static uint64_t now_us();
+
+
+/* Exported functions ------------------------------------------------------- */
+
+int json_rpc_http_parse(char* input, int input_len, json_rpc_http_request_t* request)
+{
+    const char* end = input + input_len;
+    char* pos = input;
+    char* line_end;
+    const char* value;
+    int line_len;
+    int name_len;
+    int value_len;
+    int content_length = -1;
+    int connection_close = 0;
+    int connection_keep_alive = 0;
+    int res;
+
+    memset(request, 0, sizeof(json_rpc_http_request_t));
+    while(pos < end && (*pos == '\r' || *pos == '\n'))
+    {
+        pos++; // (empty lines before the request line are ignored)
+    }
+    line_end = find_line_end(pos, end);
+    if(!line_end)
+    {
+        return 0;
+    }
+    res = parse_request_line(pos, trimmed_line_len(pos, line_end), request);
+    if(res < 0)
+    {
+        return res;
+    }
+
+    while(true)
+    {
+        pos = line_end + 1;
+        line_end = find_line_end(pos, end);
+        if(!line_end)
+        {
+            return 0;
+        }
+        line_len = trimmed_line_len(pos, line_end);
+        if(!line_len)
+        {
+            break; // (end of headers)
+        }
+
+        value = (const char*)memchr(pos, ':', line_len);
+        if(!value || value == pos || value[-1] == ' ' || value[-1] == '\t')
+        {
+            return -400;
+        }
+        name_len = value - pos;
+        value++;
+        value_len = line_len - name_len - 1;
+        while(value_len && (*value == ' ' || *value == '\t'))
+        {
+            value++;
+            value_len--;
+        }
+        while(value_len && (value[value_len - 1] == ' ' || value[value_len - 1] == '\t'))
+        {
+            value_len--;
+        }
+
+        // (only headers that matter for framing of requests and responses are looked at)
+        if(is_equal_lowercase(pos, name_len, "content-length"))
+        {
+            res = parse_content_length(value, value_len);
+            if(res < 0 || (content_length >= 0 && res != content_length))
+            {
+                return -400;
+            }
+            content_length = res;
+        }
+        else if(is_equal_lowercase(pos, name_len, "transfer-encoding"))
+        {
+            if(!is_equal_lowercase(value, value_len, "chunked") || request->chunked)
+            {
+                return -501;
+            }
+            request->chunked = 1;
+        }
+        else if(is_equal_lowercase(pos, name_len, "connection"))
+        {
+            connection_close |= has_token(value, value_len, "close");
+            connection_keep_alive |= has_token(value, value_len, "keep-alive");
+        }
+        else if(is_equal_lowercase(pos, name_len, "expect"))
+        {
+            request->expect_continue = is_equal_lowercase(value, value_len, "100-continue");
+        }
+    }
+
+    if(request->chunked && content_length >= 0)
+    {
+        return -400; // (ambiguous framing)
+    }
+    request->header_len = line_end + 1 - input;
+    request->keep_alive = request->minor_version ? !connection_close : connection_keep_alive && !connection_close;
+    request->body = input + request->header_len;
+
+    if(request->chunked)
+    {
+        // chunks are joined only when the whole body is received (so that it can be parsed again)
+        res = walk_chunks(request->body, input_len - request->header_len, 0, &request->body_len);
+        if(res > 0)
+        {
+            walk_chunks(request->body, input_len - request->header_len, 1, &request->body_len);
+            return request->header_len + res;
+        }
+        request->body_len = 0;
+        return res;
+    }
+    request->body_len = content_length > 0 ? content_length : 0; // (set also when it isn't received yet)
+    if(input_len - request->header_len < request->body_len)
+    {
+        return 0;
+    }
+    return request->header_len + request->body_len;
+}
+
+int json_rpc_http_handle(json_rpc_instance_t* rpc, const json_rpc_http_request_t* request,
+                         char* output, int output_len, void* arg, const char** response)
+{
+    char headers[JSON_RPC_HTTP_HEADER_SPACE];
+    char* to = headers;
+    char* body = output + JSON_RPC_HTTP_HEADER_SPACE;
+    json_rpc_data_t data;
+    int body_len = 0;
+    int status = 405;
+
+    *response = output;
+    if(output_len <= JSON_RPC_HTTP_HEADER_SPACE)
+    {
+        return 0;
+    }
+    if(request->method_len == 4 && memcmp(request->method, "POST", 4) == 0)
+    {
+        data.request = request->body;
+        data.request_len = request->body_len;
+        data.response = body;
+        data.response_len = output_len - JSON_RPC_HTTP_HEADER_SPACE;
+        data.arg = arg;
+        json_rpc_handle_request(rpc, &data);
+        body_len = json_rpc_response_len(&data);
+        status = body_len ? 200 : 204; // (notifications have no response)
+    }
+
+    to = append(to, "HTTP/1.1 ");
+    to = json_format_int(to, status);
+    to = append(to, " ");
+    to = append(to, status_text(status));
+    to = append(to, "\r\n");
+    if(status == 405)
+    {
+        to = append(to, "Allow: POST\r\nContent-Length: 0\r\n");
+    }
+    else if(body_len)
+    {
+        to = append(to, json_is_msgpack(body, body_len) ? "Content-Type: application/msgpack\r\n" :
+                                                          "Content-Type: application/json\r\n");
+        to = append(to, "Content-Length: ");
+        to = json_format_int(to, body_len);
+        to = append(to, "\r\n");
+    }
+    if(!request->keep_alive)
+    {
+        to = append(to, "Connection: close\r\n");
+    }
+    else if(!request->minor_version)
+    {
+        to = append(to, "Connection: keep-alive\r\n");
+    }
+    to = append(to, "\r\n");
+
+    // headers are placed just before the body (so that the response is contiguous)
+    *response = body - (to - headers);
+    memcpy(body - (to - headers), headers, to - headers);
+    return (to - headers) + body_len;
+}
+
+int json_rpc_http_status_response(int status, char* output, int output_len)
+{
+    char headers[JSON_RPC_HTTP_HEADER_SPACE];
+    char* to = headers;
+
+    to = append(to, "HTTP/1.1 ");
+    to = json_format_int(to, status);
+    to = append(to, " ");
+    to = append(to, status_text(status));
+    to = append(to, "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    if(to - headers > output_len)
+    {
+        return 0;
+    }
+    memcpy(output, headers, to - headers);
+    return to - headers;
+}
+
+void json_rpc_http_conn_init(json_rpc_http_conn_t* conn, int fd, json_rpc_instance_t* rpc, char* input, int input_size,
+                             char* output, int output_size, void* arg)
+{
+    conn->fd = fd;
+    conn->rpc = rpc;
+    conn->arg = arg;
+    conn->input = input;
+    conn->input_size = input_size;
+    conn->input_len = 0;
+    conn->output = output;
+    conn->output_size = output_size;
+    conn->max_pending = JSON_RPC_HTTP_MAX_PENDING;
+    conn->max_delay_us = JSON_RPC_HTTP_MAX_DELAY_US;
+    conn->requests = 0;
+    conn->writes = 0;
+}
+
+void json_rpc_http_conn_serve(json_rpc_http_conn_t* conn)
+{
+    static const char continue_response[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    json_rpc_http_request_t request;
+    pending_responses_t pending;
+    const char* response;
+    int response_len;
+    int continue_sent = 0;
+    int wanted = 0; // (bytes needed before the request is parsed again)
+    int pos;
+    int len;
+    ssize_t received;
+
+    pending.num_of_responses = 0;
+    pending.used = 0;
+    while(true)
+    {
+        pos = 0;
+        len = 0;
+        request.header_len = 0;
+        while(pos < conn->input_len && conn->input_len >= wanted)
+        {
+            // (all pipelined requests that were received are handled, and their responses are coalesced)
+            len = json_rpc_http_parse(conn->input + pos, conn->input_len - pos, &request);
+            if(len <= 0)
+            {
+                break;
+            }
+            if(pending.used > conn->output_size / 2 && !send_pending(conn, &pending))
+            {
+                return;
+            }
+            response_len = json_rpc_http_handle(conn->rpc, &request, conn->output + pending.used,
+                                                conn->output_size - pending.used, conn->arg, &response);
+            if(!response_len)
+            {
+                len = -500;
+                break;
+            }
+            if(!pending.num_of_responses && conn->max_delay_us)
+            {
+                pending.since_us = now_us();
+            }
+            pending.iov[pending.num_of_responses].iov_base = (void*)response;
+            pending.iov[pending.num_of_responses].iov_len = response_len;
+            pending.num_of_responses++;
+            pending.used = response + response_len - conn->output;
+            conn->requests++;
+            continue_sent = 0;
+            wanted = 0;
+            pos += len;
+            request.header_len = 0; // (handled: nothing is waited for, unless the next request is partly received)
+            request.expect_continue = 0;
+            if(!request.keep_alive)
+            {
+                send_pending(conn, &pending);
+                return;
+            }
+            if((pending.num_of_responses >= conn->max_pending || pending.num_of_responses == JSON_RPC_HTTP_MAX_PENDING ||
+                (conn->max_delay_us && now_us() - pending.since_us >= conn->max_delay_us)) &&
+               !send_pending(conn, &pending))
+            {
+                return;
+            }
+        }
+        if(!send_pending(conn, &pending)) // (responses never wait for more input)
+        {
+            return;
+        }
+        if(len < 0)
+        {
+            len = json_rpc_http_status_response(-len, conn->output, conn->output_size);
+            send_all(conn->fd, conn->output, len);
+            return;
+        }
+
+        memmove(conn->input, conn->input + pos, conn->input_len - pos);
+        conn->input_len -= pos;
+        if(request.header_len)
+        {
+            // headers of the next request are received: wait for the rest of it without parsing it again
+            wanted = request.chunked ? 0 : request.header_len + request.body_len;
+            if(request.expect_continue && !continue_sent)
+            {
+                continue_sent = send_all(conn->fd, continue_response, sizeof(continue_response) - 1);
+            }
+        }
+        if(conn->input_len == conn->input_size)
+        {
+            len = json_rpc_http_status_response(request.header_len ? 413 : 431, conn->output, conn->output_size);
+            send_all(conn->fd, conn->output, len);
+            return;
+        }
+
+        received = recv(conn->fd, conn->input + conn->input_len, conn->input_size - conn->input_len, 0);
+        if(received <= 0)
+        {
+            if(received < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            return; // (closed)
+        }
+        conn->input_len += received;
+    }
+}
+
+
+/* Private functions ------------------------------------------------------- */
+
+static char* find_line_end(char* from, const char* end)
+{
+    // (memchr scans many bytes at a time, using vector instructions where available)
+    return (char*)memchr(from, '\n', end - from);
+}
+
+static int trimmed_line_len(const char* line, const char* line_end)
+{
+    // line ends with CRLF (a bare LF is accepted as well)
+    int len = line_end - line;
+    return (len && line[len - 1] == '\r') ? len - 1 : len;
+}
+
+static int parse_request_line(const char* line, int line_len, json_rpc_http_request_t* request)
+{
+    // method SP request-target SP HTTP/1.x
+    const char* end = line + line_len;
+    const char* pos = line;
+
+    request->method = pos;
+    while(pos < end && *pos != ' ')
+    {
+        pos++;
+    }
+    request->method_len = pos - line;
+    if(!request->method_len || pos == end)
+    {
+        return -400;
+    }
+
+    request->target = ++pos;
+    while(pos < end && *pos != ' ')
+    {
+        pos++;
+    }
+    request->target_len = pos - request->target;
+    if(!request->target_len || end - pos != 9 || memcmp(pos + 1, "HTTP/", 5) != 0)
+    {
+        return -400;
+    }
+    if(pos[6] != '1' || pos[7] != '.' || pos[8] < '0' || pos[8] > '9')
+    {
+        return -505;
+    }
+    request->minor_version = pos[8] - '0';
+    return 0;
+}
+
+static int is_equal_lowercase(const char* str, int str_len, const char* lowercase)
+{
+    // case-insensitive (for letters) comparison with a lowercase string
+    int i;
+    for(i = 0; i < str_len; i++)
+    {
+        if(!lowercase[i] || (str[i] | ((str[i] >= 'A' && str[i] <= 'Z') ? 0x20 : 0)) != lowercase[i])
+        {
+            return 0;
+        }
+    }
+    return !lowercase[i];
+}
+
+static int has_token(const char* value, int value_len, const char* lowercase)
+{
+    // value is a comma-separated list of tokens
+    const char* end = value + value_len;
+    const char* token;
+
+    while(value < end)
+    {
+        while(value < end && (*value == ' ' || *value == '\t' || *value == ','))
+        {
+            value++;
+        }
+        token = value;
+        while(value < end && *value != ',' && *value != ' ' && *value != '\t')
+        {
+            value++;
+        }
+        if(value > token && is_equal_lowercase(token, value - token, lowercase))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int parse_content_length(const char* value, int value_len)
+{
+    int result = 0;
+    int i;
+
+    if(!value_len)
+    {
+        return -1;
+    }
+    for(i = 0; i < value_len; i++)
+    {
+        if(value[i] < '0' || value[i] > '9' || result > (0x7fffffff - 9) / 10)
+        {
+            return -1;
+        }
+        result = result * 10 + (value[i] - '0');
+    }
+    return result;
+}
+
+static int walk_chunks(char* data, int data_len, int join, int* body_len)
+{
+    // chunk-size (hex) [; extensions] CRLF, chunk-data CRLF .. last chunk (0), trailers (ignored), CRLF;
+    // when joining, chunk-data is moved to the beginning (it never overtakes what wasn't read yet)
+    const char* line_end;
+    int pos = 0;
+    int size;
+    int digits;
+    int line_len;
+    int value;
+    char c;
+
+    *body_len = 0;
+    while(true)
+    {
+        size = 0;
+        for(digits = 0; pos < data_len; digits++, pos++)
+        {
+            c = data[pos] | 0x20;
+            if(data[pos] >= '0' && data[pos] <= '9')
+            {
+                value = data[pos] - '0';
+            }
+            else if(c >= 'a' && c <= 'f')
+            {
+                value = c - 'a' + 10;
+            }
+            else
+            {
+                break;
+            }
+            // (checked before shifting, so that size can't overflow)
+            if(digits >= MAX_CHUNK_SIZE_DIGITS || size > (MAX_CHUNK_SIZE >> 4))
+            {
+                return -413;
+            }
+            size = size * 16 + value;
+        }
+        if(size < 0 || size >= MAX_CHUNK_SIZE)
+        {
+            return -413;
+        }
+        if(pos < data_len && !digits)
+        {
+            return -400;
+        }
+        line_end = (const char*)memchr(data + pos, '\n', data_len - pos);
+        if(!line_end)
+        {
+            return 0;
+        }
+        pos = line_end + 1 - data;
+        if(!size)
+        {
+            break;
+        }
+
+        if(data_len - pos < size + 1)
+        {
+            return 0;
+        }
+        if(join)
+        {
+            memmove(data + *body_len, data + pos, size);
+        }
+        *body_len += size;
+        pos += size;
+        if(data[pos] == '\r')
+        {
+            if(++pos == data_len)
+            {
+                return 0;
+            }
+        }
+        if(data[pos++] != '\n')
+        {
+            return -400;
+        }
+    }
+
+    do
+    {
+        line_end = (const char*)memchr(data + pos, '\n', data_len - pos);
+        if(!line_end)
+        {
+            return 0;
+        }
+        line_len = trimmed_line_len(data + pos, line_end);
+        pos = line_end + 1 - data;
+    } while(line_len);
+    return pos;
+}
+
+static char* append(char* to, const char* str)
+{
+    while(*str)
+    {
+        *to++ = *str++;
+    }
+    return to;
+}
+
+static const char* status_text(int status)
+{
+    switch(status)
+    {
+        case 200: return "OK";
+        case 204: return "No Content";
+        case 400: return "Bad Request";
+        case 405: return "Method Not Allowed";
+        case 413: return "Content Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 501: return "Not Implemented";
+        case 505: return "HTTP Version Not Supported";
+        default: return "Internal Server Error";
+    }
+}
+
+static int send_all(int fd, const char* data, int len)
+{
+    ssize_t sent;
+    while(len > 0)
+    {
+        sent = send(fd, data, len, MSG_NOSIGNAL);
+        if(sent < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return 0;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return 1;
+}
+
+static int send_pending(json_rpc_http_conn_t* conn, pending_responses_t* pending)
+{
+    // sends all pending responses with one call (like writev, but without SIGPIPE), continuing after partial sends
+    struct msghdr message;
+    struct iovec* iov = pending->iov;
+    int num_of_iov = pending->num_of_responses;
+    ssize_t sent;
+
+    memset(&message, 0, sizeof(message));
+    pending->num_of_responses = 0;
+    pending->used = 0;
+    while(num_of_iov)
+    {
+        message.msg_iov = iov;
+        message.msg_iovlen = num_of_iov;
+        sent = sendmsg(conn->fd, &message, MSG_NOSIGNAL);
+        if(sent < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return 0;
+        }
+        conn->writes++;
+        while(num_of_iov && (size_t)sent >= iov->iov_len)
+        {
+            sent -= iov->iov_len;
+            iov++;
+            num_of_iov--;
+        }
+        if(num_of_iov)
+        {
+            iov->iov_base = (char*)iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
+    return 1;
+}
+
+static uint64_t now_us()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
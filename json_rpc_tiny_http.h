@@ -0,0 +1,164 @@
+/**
+ @file    json_rpc_tiny_http.h
+ @brief   HTTP/1.1 front-end for JSON-RPC requests (parsing is portable, serving connections requires POSIX sockets).
+ ___________________________
+
+ The MIT License (MIT)
+
+ Copyright (c) 2013 Lukasz Forynski
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ HTTP/1.1 front-end: requests (JSON-RPC over HTTP POST) are parsed in place (nothing is allocated
+ or copied: request line, headers and body are pointers into the input buffer, and chunked bodies
+ are joined in place), handled by json_rpc_handle_request(), and response headers are written
+ into the output buffer, just before the body written there by the handler:
+
+     json_rpc_http_request_t request;
+     int len = json_rpc_http_parse(input, input_len, &request);   // > 0: whole request received
+     if(len > 0)
+     {
+         const char* response;
+         int response_len = json_rpc_http_handle(&rpc, &request, output, sizeof(output), arg, &response);
+         .. (send response_len bytes from response)
+     }
+
+ Connections (keep-alive, with pipelined requests) can be served using json_rpc_http_conn_serve()
+ (POSIX: blocking socket). Responses to requests received at once are coalesced in the output buffer
+ and sent with one call (writev), flushed when the input is used up, or sooner if the first of them
+ waited longer than max_delay_us (e.g. behind a slow handler), or the buffer is half full.
+*/
+
+#ifndef JSON_RPC_TINY_HTTP
+#define JSON_RPC_TINY_HTTP
+
+#include "json_rpc_tiny.h"
+
+/* Exported defines ------------------------------------------------------------*/
+
+#define JSON_RPC_HTTP_HEADER_SPACE  128     /* space (in the output buffer) for response headers */
+
+#ifndef JSON_RPC_HTTP_MAX_PENDING
+#define JSON_RPC_HTTP_MAX_PENDING   64      /* max number of responses sent with one call */
+#endif
+
+#ifndef JSON_RPC_HTTP_MAX_DELAY_US
+#define JSON_RPC_HTTP_MAX_DELAY_US  200     /* default max time a response waits to be sent with others */
+#endif
+
+
+/* Exported types ------------------------------------------------------------*/
+
+/**
+ * @brief Parsed HTTP request (pointers into the input buffer).
+ */
+typedef struct json_rpc_http_request
+{
+    const char* method;
+    const char* target;
+    char* body;             /* (chunked body is joined in place) */
+    int method_len;
+    int target_len;
+    int body_len;
+    int header_len;         /* length of the request line and headers (0 until all of them are received) */
+    uint8_t minor_version;  /* HTTP/1.x */
+    uint8_t keep_alive;     /* (connection is kept open after the response) */
+    uint8_t expect_continue;
+    uint8_t chunked;
+} json_rpc_http_request_t;
+
+
+/**
+ * @brief Connection served by json_rpc_http_conn_serve().
+ */
+typedef struct json_rpc_http_conn
+{
+    int fd;
+    json_rpc_instance_t* rpc;
+    void* arg;              /* passed to handlers */
+    char* input;            /* (the whole request has to fit) */
+    int input_size;
+    int input_len;
+    char* output;           /* (responses are written here: each of them can take up to a half of it) */
+    int output_size;
+    int max_pending;        /* (up to JSON_RPC_HTTP_MAX_PENDING, 1 to send each response on its own) */
+    uint32_t max_delay_us;  /* (0: responses are only sent when the input is used up) */
+    uint64_t requests;
+    uint64_t writes;        /* number of calls sending responses */
+} json_rpc_http_conn_t;
+
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+ * @brief Parses a HTTP/1.x request (it can be followed by more, pipelined, requests).
+ * @param input pointer to the received data (modified if the body is chunked).
+ * @param input_len length of the received data.
+ * @param request (out) parsed request.
+ * @returns length of the whole request (including body), 0 if more data is needed (request->header_len
+ *          is non-zero when headers were received), or negative HTTP status (e.g. -400) if it isn't valid.
+ */
+int json_rpc_http_parse(char* input, int input_len, json_rpc_http_request_t* request);
+
+
+/**
+ * @brief Handles a parsed request, and creates the HTTP response (POST requests are passed to
+ *        json_rpc_handle_request(), others are answered with 405, and notifications with 204).
+ * @param rpc instance handling the request.
+ * @param request parsed request.
+ * @param output buffer for the response (JSON-RPC response is written at JSON_RPC_HTTP_HEADER_SPACE,
+ *        and headers just before it).
+ * @param output_len length of the buffer.
+ * @param arg argument passed to handlers.
+ * @param response (out) beginning of the response (in the output buffer).
+ * @returns length of the response.
+ */
+int json_rpc_http_handle(json_rpc_instance_t* rpc, const json_rpc_http_request_t* request,
+                         char* output, int output_len, void* arg, const char** response);
+
+
+/**
+ * @brief Creates a response (without a body) for a status, e.g. for an error returned by json_rpc_http_parse().
+ * @returns length of the response (the connection is closed after it).
+ */
+int json_rpc_http_status_response(int status, char* output, int output_len);
+
+
+/**
+ * @brief Initialises a connection.
+ * @param conn pointer to the json_rpc_http_conn_t object.
+ * @param fd connected socket (it isn't closed by json_rpc_http_conn_serve()).
+ * @param rpc instance handling requests.
+ * @param input buffer for received requests (max length of a request).
+ * @param input_size size of the input buffer.
+ * @param output buffer for responses.
+ * @param output_size size of the output buffer.
+ * @param arg argument passed to handlers.
+ */
+void json_rpc_http_conn_init(json_rpc_http_conn_t* conn, int fd, json_rpc_instance_t* rpc, char* input, int input_size,
+                             char* output, int output_size, void* arg);
+
+
+/**
+ * @brief Serves requests received on the connection, until it is closed (by the client, or after a request
+ *        without keep-alive, or an invalid one).
+ */
+void json_rpc_http_conn_serve(json_rpc_http_conn_t* conn);
+
+
+#endif /* JSON_RPC_TINY_HTTP */
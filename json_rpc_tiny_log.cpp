@@ -0,0 +1,289 @@
+/**
+ @file    json_rpc_tiny_log.cpp
+ @brief   Processing of (large) logs of recorded JSON-RPC requests (requires POSIX: mmap and pthreads).
+ ___________________________
+
+ The MIT License (MIT)
+
+ Copyright (c) 2013 Lukasz Forynski
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "json_rpc_tiny_log.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/* Private types and definitions ------------------------------------------------------- */
+
+typedef struct log_thread
+{
+    pthread_t thread;
+    json_rpc_log_chunk_t chunk;
+    json_rpc_log_line_fcn fcn;
+    void* arg;
+} log_thread_t;
+
+
+/* Private functions ------------------------------------------------------- */
+
+static void* process_chunk(void* thread_arg);
+static int name_is_equal(const char* name, int name_len, const char* fcn_name);
+static void count_request(json_rpc_log_count_t* count, const char* request, int request_len);
+
+
+/* Exported functions ------------------------------------------------------- */
+
+int json_rpc_log_open(json_rpc_log_t* log, const char* path)
+{
+    struct stat info;
+    void* data;
+
+    log->data = 0;
+    log->len = 0;
+    log->fd = open(path, O_RDONLY);
+    if(log->fd < 0)
+    {
+        return 0;
+    }
+    if(fstat(log->fd, &info) != 0)
+    {
+        json_rpc_log_close(log);
+        return 0;
+    }
+    if(info.st_size > 0)
+    {
+        data = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, log->fd, 0);
+        if(data == MAP_FAILED)
+        {
+            json_rpc_log_close(log);
+            return 0;
+        }
+        madvise(data, info.st_size, MADV_SEQUENTIAL); // (more read-ahead: each chunk is read once, in order)
+        log->data = (const char*)data;
+        log->len = info.st_size;
+    }
+    return 1;
+}
+
+void json_rpc_log_close(json_rpc_log_t* log)
+{
+    if(log->data)
+    {
+        munmap((void*)log->data, log->len);
+    }
+    if(log->fd >= 0)
+    {
+        close(log->fd);
+    }
+    log->data = 0;
+    log->len = 0;
+    log->fd = -1;
+}
+
+void json_rpc_log_split(const json_rpc_log_t* log, json_rpc_log_chunk_t* chunks, int num_of_chunks)
+{
+    const char* end = log->data + log->len;
+    const char* start = log->data;
+    const char* next;
+    int i;
+
+    for(i = 0; i < num_of_chunks; i++)
+    {
+        // (each chunk ends just past the line end found after its expected size)
+        next = log->data + log->len / num_of_chunks * (i + 1);
+        if(i == num_of_chunks - 1 || next >= end)
+        {
+            next = end;
+        }
+        else if(next > start)
+        {
+            next = (const char*)memchr(next - 1, '\n', end - next + 1);
+            next = next ? next + 1 : end;
+        }
+        else
+        {
+            next = start; // (previous chunk took this one)
+        }
+        chunks[i].start = start;
+        chunks[i].len = next - start;
+        start = next;
+    }
+}
+
+uint64_t json_rpc_log_for_each_line(const json_rpc_log_chunk_t* chunk, json_rpc_log_line_fcn fcn, void* arg)
+{
+    const char* pos = chunk->start;
+    const char* end = chunk->start + chunk->len;
+    const char* line_end;
+    uint64_t num_of_lines = 0;
+    int64_t line_len;
+
+    while(pos < end)
+    {
+        line_end = (const char*)memchr(pos, '\n', end - pos);
+        line_end = line_end ? line_end : end;
+        line_len = line_end - pos;
+        if(line_len && pos[line_len - 1] == '\r')
+        {
+            line_len--;
+        }
+        if(line_len > 0 && line_len <= 0x7fffffff) // (longer lines are skipped)
+        {
+            fcn(pos, (int)line_len, arg);
+            num_of_lines++;
+        }
+        pos = line_end + 1;
+    }
+    return num_of_lines;
+}
+
+int json_rpc_log_process(const json_rpc_log_t* log, int num_of_threads, json_rpc_log_line_fcn fcn, void** args)
+{
+    json_rpc_log_chunk_t chunks[JSON_RPC_LOG_MAX_THREADS];
+    log_thread_t threads[JSON_RPC_LOG_MAX_THREADS];
+    int started = 1;
+    int result = 1;
+    int i;
+
+    if(num_of_threads < 1 || num_of_threads > JSON_RPC_LOG_MAX_THREADS)
+    {
+        return 0;
+    }
+
+    json_rpc_log_split(log, chunks, num_of_threads);
+    for(i = 0; i < num_of_threads; i++)
+    {
+        threads[i].chunk = chunks[i];
+        threads[i].fcn = fcn;
+        threads[i].arg = args[i];
+    }
+
+    for(; started < num_of_threads; started++)
+    {
+        if(pthread_create(&threads[started].thread, 0, process_chunk, &threads[started]) != 0)
+        {
+            result = 0;
+            break;
+        }
+    }
+    process_chunk(&threads[0]);
+
+    for(i = 1; i < started; i++)
+    {
+        pthread_join(threads[i].thread, 0);
+    }
+    return result;
+}
+
+void json_rpc_log_replay_line(const char* line, int line_len, void* arg)
+{
+    json_rpc_log_replay_t* replay = (json_rpc_log_replay_t*)arg;
+    json_rpc_data_t data;
+
+    data.request = line;
+    data.request_len = line_len;
+    data.response = replay->response;
+    data.response_len = replay->response_len;
+    data.arg = replay->arg;
+    json_rpc_handle_request(replay->rpc, &data);
+
+    replay->requests++;
+    replay->request_bytes += line_len;
+    replay->response_bytes += json_rpc_response_len(&data);
+}
+
+void json_rpc_log_count_line(const char* line, int line_len, void* arg)
+{
+    json_rpc_log_count_t* count = (json_rpc_log_count_t*)arg;
+    json_token_info_t token;
+    int pos = 0;
+
+    while(pos < line_len && (line[pos] == ' ' || line[pos] == '\t'))
+    {
+        pos++;
+    }
+    if(pos < line_len && line[pos] == '[') // batch
+    {
+        pos++;
+        while(pos < line_len)
+        {
+            pos = json_find_next_member(pos, line, line_len, &token);
+            if(!token.values_len)
+            {
+                break;
+            }
+            count_request(count, line + token.values_start, token.values_len);
+        }
+    }
+    else
+    {
+        count_request(count, line, line_len);
+    }
+}
+
+
+/* Private functions ------------------------------------------------------- */
+
+static void* process_chunk(void* thread_arg)
+{
+    log_thread_t* thread = (log_thread_t*)thread_arg;
+    json_rpc_log_for_each_line(&thread->chunk, thread->fcn, thread->arg);
+    return 0;
+}
+
+static int name_is_equal(const char* name, int name_len, const char* fcn_name)
+{
+    int i;
+    for(i = 0; i < name_len; i++)
+    {
+        if(name[i] != fcn_name[i]) // (also if fcn_name is shorter)
+        {
+            return 0;
+        }
+    }
+    return fcn_name[name_len] == 0;
+}
+
+static void count_request(json_rpc_log_count_t* count, const char* request, int request_len)
+{
+    const char* method;
+    int method_len = 0;
+    int i;
+
+    count->requests++;
+    method = json_extract_member_str("method", &method_len, request, request_len);
+    if(method)
+    {
+        for(i = 0; i < count->rpc->num_of_handlers; i++)
+        {
+            if(name_is_equal(method, method_len, count->rpc->handlers[i].fcn_name))
+            {
+                count->calls[i]++;
+                return;
+            }
+        }
+    }
+    count->unknown++;
+}
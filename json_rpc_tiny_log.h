@@ -0,0 +1,175 @@
+/**
+ @file    json_rpc_tiny_log.h
+ @brief   Processing of (large) logs of recorded JSON-RPC requests (requires POSIX: mmap and pthreads).
+ ___________________________
+
+ The MIT License (MIT)
+
+ Copyright (c) 2013 Lukasz Forynski
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ A log is a file with one request per line (NDJSON). It is memory-mapped, split at line
+ boundaries into a chunk per thread, and each line is passed to a function (in the thread
+ processing its chunk), e.g. to replay requests or to count them by method:
+
+     json_rpc_log_t log;
+     json_rpc_log_replay_t replay[4];   // (per thread: instance, response buffer and counters)
+     void* args[4] = {&replay[0], &replay[1], &replay[2], &replay[3]};
+     if(json_rpc_log_open(&log, "requests.ndjson"))
+     {
+         json_rpc_log_process(&log, 4, json_rpc_log_replay_line, args);
+         json_rpc_log_close(&log);
+     }
+
+ Lines are not copied (nor null-terminated), so that processing runs at memory bandwidth.
+*/
+
+#ifndef JSON_RPC_TINY_LOG
+#define JSON_RPC_TINY_LOG
+
+#include "json_rpc_tiny.h"
+
+/* Exported defines ------------------------------------------------------------*/
+
+#ifndef JSON_RPC_LOG_MAX_THREADS
+#define JSON_RPC_LOG_MAX_THREADS    64  /* max number of threads processing a log */
+#endif
+
+
+/* Exported types ------------------------------------------------------------*/
+
+/**
+ * @brief Structure describing a memory-mapped log.
+ */
+typedef struct json_rpc_log
+{
+    const char* data;
+    uint64_t len;
+    int fd;
+} json_rpc_log_t;
+
+
+/**
+ * @brief Part of a log (whole lines only).
+ */
+typedef struct json_rpc_log_chunk
+{
+    const char* start;
+    uint64_t len;
+} json_rpc_log_chunk_t;
+
+
+/**
+ * @brief Type of a function called for each (non-empty) line of the log.
+ * @param line pointer to the line (not null-terminated, without the line end).
+ * @param line_len length of the line.
+ * @param arg argument of the thread processing the line (see json_rpc_log_process()).
+ */
+typedef void (*json_rpc_log_line_fcn)(const char* line, int line_len, void* arg);
+
+
+/**
+ * @brief Argument of json_rpc_log_replay_line() (one per thread).
+ */
+typedef struct json_rpc_log_replay
+{
+    json_rpc_instance_t* rpc;   /* instance handling requests (e.g. with stats enabled) */
+    char* response;             /* buffer for responses */
+    int response_len;
+    void* arg;                  /* argument passed to handlers */
+    uint64_t requests;          /* number of lines replayed */
+    uint64_t request_bytes;
+    uint64_t response_bytes;
+} json_rpc_log_replay_t;
+
+
+/**
+ * @brief Argument of json_rpc_log_count_line() (one per thread).
+ */
+typedef struct json_rpc_log_count
+{
+    json_rpc_instance_t* rpc;   /* methods are counted by handlers of this instance (which are not called) */
+    uint64_t* calls;            /* table with a counter for each handler */
+    uint64_t unknown;           /* requests of methods without a handler (or without a method) */
+    uint64_t requests;
+} json_rpc_log_count_t;
+
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+ * @brief Opens (memory-maps) a log.
+ * @param log pointer to the json_rpc_log_t object.
+ * @param path path of the file.
+ * @returns non-zero (bool) if the log was opened.
+ */
+int json_rpc_log_open(json_rpc_log_t* log, const char* path);
+
+
+/**
+ * @brief Closes (unmaps) a log.
+ * @param log pointer to the json_rpc_log_t object.
+ */
+void json_rpc_log_close(json_rpc_log_t* log);
+
+
+/**
+ * @brief Splits a log into chunks of (roughly) the same size, at line boundaries.
+ * @param log pointer to the json_rpc_log_t object.
+ * @param chunks table for the chunks.
+ * @param num_of_chunks number of chunks to split the log into (some of them can be empty).
+ */
+void json_rpc_log_split(const json_rpc_log_t* log, json_rpc_log_chunk_t* chunks, int num_of_chunks);
+
+
+/**
+ * @brief Calls a function for each line of a chunk.
+ * @param chunk pointer to the chunk.
+ * @param fcn function to be called.
+ * @param arg argument passed to the function.
+ * @returns number of lines.
+ */
+uint64_t json_rpc_log_for_each_line(const json_rpc_log_chunk_t* chunk, json_rpc_log_line_fcn fcn, void* arg);
+
+
+/**
+ * @brief Processes a log in parallel: log is split into a chunk per thread, and the function is called
+ *        for each line (by the thread processing its chunk). The calling thread processes the first chunk.
+ * @param log pointer to the json_rpc_log_t object.
+ * @param num_of_threads number of threads (at most JSON_RPC_LOG_MAX_THREADS).
+ * @param fcn function to be called for each line.
+ * @param args table of arguments (one for each thread).
+ * @returns non-zero (bool) if the log was processed (i.e. threads could be started).
+ */
+int json_rpc_log_process(const json_rpc_log_t* log, int num_of_threads, json_rpc_log_line_fcn fcn, void** args);
+
+
+/**
+ * @brief Line function that handles the line as a request (arg is a json_rpc_log_replay_t).
+ */
+void json_rpc_log_replay_line(const char* line, int line_len, void* arg);
+
+
+/**
+ * @brief Line function that counts requests (also in batches) by method (arg is a json_rpc_log_count_t).
+ */
+void json_rpc_log_count_line(const char* line, int line_len, void* arg);
+
+
+#endif /* JSON_RPC_TINY_LOG */
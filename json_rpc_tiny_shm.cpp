@@ -0,0 +1,481 @@
+/**
+ @file    json_rpc_tiny_shm.cpp
+ @brief   Shared-memory transport for JSON-RPC requests between processes on the same host (requires Linux).
+ ___________________________
+
+ The MIT License (MIT)
+
+ Copyright (c) 2013 Lukasz Forynski
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "json_rpc_tiny_shm.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+
+/* Private types and definitions ------------------------------------------------------- */
+
+#define WAIT_TIMEOUT_NS     100000000   /* (waiting is re-checked, e.g. for json_rpc_shm_stop(), this often) */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RELAX()         __builtin_ia32_pause()
+#else
+#define CPU_RELAX()         __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#endif
+
+
+/* Private functions ------------------------------------------------------- */
+
+static json_rpc_shm_slot_t* slot_at(const json_rpc_shm_t* shm, uint32_t pos);
+static int spins();
+static int wait_for(const json_rpc_shm_t* shm, uint32_t* seq, uint32_t wanted, uint32_t* waiting, int max_waits);
+static void publish(uint32_t* seq, uint32_t value, uint32_t* waiting);
+static int skip_abandoned(json_rpc_shm_t* shm, uint32_t pos);
+static int reclaim_unreleased(json_rpc_shm_t* shm, uint32_t pos);
+static int timed_out(int* waits, uint32_t* waited_pos, uint32_t pos, int timeout_ms);
+static void handle_slot(json_rpc_shm_t* shm, json_rpc_shm_slot_t* slot, uint32_t pos,
+                        json_rpc_instance_t* rpc, void* arg);
+
+
+/* Exported functions ------------------------------------------------------- */
+
+int json_rpc_shm_create(json_rpc_shm_t* shm, int num_of_slots, int request_size, int response_size)
+{
+    json_rpc_shm_header_t* header;
+    uint32_t slots = 4; // (at least 4: states of a slot are told apart by its seq)
+    uint32_t slot_size;
+    uint32_t i;
+    void* data;
+
+    shm->fd = -1;
+    shm->len = 0;
+    shm->header = 0;
+    if(num_of_slots <= 0 || num_of_slots > (1 << 20) || request_size <= 1 || response_size <= 1 ||
+       request_size > (1 << 24) || response_size > (1 << 24))
+    {
+        return 0;
+    }
+    while(slots < (uint32_t)num_of_slots)
+    {
+        slots *= 2;
+    }
+    slot_size = (sizeof(json_rpc_shm_slot_t) + request_size + response_size + 63) & ~63u; // (whole cache lines)
+
+    shm->fd = memfd_create("json_rpc_shm", MFD_CLOEXEC);
+    if(shm->fd < 0)
+    {
+        return 0;
+    }
+    shm->len = sizeof(json_rpc_shm_header_t) + (uint64_t)slots * slot_size;
+    if(ftruncate(shm->fd, shm->len) != 0 ||
+       (data = mmap(0, shm->len, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0)) == MAP_FAILED)
+    {
+        json_rpc_shm_close(shm);
+        return 0;
+    }
+
+    header = (json_rpc_shm_header_t*)data;
+    header->num_of_slots = slots;
+    header->request_size = request_size;
+    header->response_size = response_size;
+    header->slot_size = slot_size;
+    header->stopped = 0;
+    header->head = 0;
+    header->tail = 0;
+    header->server_waiting = 0;
+    shm->header = header;
+    shm->spins = spins();
+    shm->claim_timeout_ms = JSON_RPC_SHM_CLAIM_TIMEOUT_MS;
+    shm->release_timeout_ms = JSON_RPC_SHM_RELEASE_TIMEOUT_MS;
+    for(i = 0; i < slots; i++)
+    {
+        slot_at(shm, i)->seq = i;
+        slot_at(shm, i)->client_waiting = 0;
+    }
+    __atomic_store_n(&header->magic, JSON_RPC_SHM_MAGIC, __ATOMIC_RELEASE);
+    return 1;
+}
+
+int json_rpc_shm_attach(json_rpc_shm_t* shm, int fd)
+{
+    json_rpc_shm_header_t* header;
+    struct stat info;
+    void* data;
+
+    shm->fd = fd;
+    shm->len = 0;
+    shm->header = 0;
+    if(fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(json_rpc_shm_header_t) ||
+       (data = mmap(0, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        json_rpc_shm_close(shm);
+        return 0;
+    }
+    shm->len = info.st_size;
+    header = (json_rpc_shm_header_t*)data;
+    if(__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != JSON_RPC_SHM_MAGIC ||
+       header->num_of_slots < 4 || (header->num_of_slots & (header->num_of_slots - 1)) ||
+       header->request_size <= 1 || header->response_size <= 1 ||
+       header->slot_size < sizeof(json_rpc_shm_slot_t) + (uint64_t)header->request_size + header->response_size ||
+       sizeof(json_rpc_shm_header_t) + (uint64_t)header->num_of_slots * header->slot_size > shm->len)
+    {
+        munmap(data, shm->len);
+        shm->len = 0;
+        json_rpc_shm_close(shm);
+        return 0;
+    }
+    shm->header = header;
+    shm->spins = spins();
+    shm->claim_timeout_ms = JSON_RPC_SHM_CLAIM_TIMEOUT_MS;
+    shm->release_timeout_ms = JSON_RPC_SHM_RELEASE_TIMEOUT_MS;
+    return 1;
+}
+
+void json_rpc_shm_close(json_rpc_shm_t* shm)
+{
+    if(shm->header)
+    {
+        munmap(shm->header, shm->len);
+    }
+    if(shm->fd >= 0)
+    {
+        close(shm->fd);
+    }
+    shm->fd = -1;
+    shm->len = 0;
+    shm->header = 0;
+}
+
+char* json_rpc_shm_request_begin(json_rpc_shm_t* shm, int* max_len, uint32_t* ticket)
+{
+    json_rpc_shm_header_t* header = shm->header;
+    json_rpc_shm_slot_t* slot;
+    uint32_t pos = __atomic_load_n(&header->head, __ATOMIC_RELAXED);
+    int32_t diff;
+
+    while(true)
+    {
+        slot = slot_at(shm, pos);
+        diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if(diff == 0)
+        {
+            if(__atomic_compare_exchange_n(&header->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if(diff < 0)
+        {
+            return 0; // (slot is still used for a request of the previous round)
+        }
+        else
+        {
+            pos = __atomic_load_n(&header->head, __ATOMIC_RELAXED);
+        }
+    }
+    *ticket = pos;
+    *max_len = header->request_size - 1; // (request is null-terminated)
+    return (char*)(slot + 1);
+}
+
+int json_rpc_shm_request_end(json_rpc_shm_t* shm, uint32_t ticket, int request_len)
+{
+    json_rpc_shm_slot_t* slot = slot_at(shm, ticket);
+    uint32_t seq = ticket;
+    slot->request_len = request_len;
+    ((char*)(slot + 1))[request_len] = 0;
+
+    // (exchanged, as the server could have skipped the slot in the meantime)
+    if(!__atomic_compare_exchange_n(&slot->seq, &seq, ticket + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    {
+        return 0;
+    }
+    if(__atomic_load_n(&shm->header->server_waiting, __ATOMIC_SEQ_CST))
+    {
+        syscall(SYS_futex, &slot->seq, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+    }
+    return 1;
+}
+
+const char* json_rpc_shm_response_wait(json_rpc_shm_t* shm, uint32_t ticket, int* response_len)
+{
+    json_rpc_shm_slot_t* slot = slot_at(shm, ticket);
+    *response_len = 0;
+    if(!wait_for(shm, &slot->seq, ticket + 2, &slot->client_waiting, -1))
+    {
+        return 0; // (stopped)
+    }
+    *response_len = slot->response_len;
+    return (const char*)(slot + 1) + shm->header->request_size;
+}
+
+int json_rpc_shm_release(json_rpc_shm_t* shm, uint32_t ticket)
+{
+    // (exchanged, as the server could have reclaimed the slot in the meantime)
+    uint32_t seq = ticket + 2;
+    return __atomic_compare_exchange_n(&slot_at(shm, ticket)->seq, &seq, ticket + shm->header->num_of_slots, 0,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+int json_rpc_shm_call(json_rpc_shm_t* shm, const char* request, int request_len, char* response, int response_len)
+{
+    const char* result;
+    char* to;
+    uint32_t ticket;
+    int max_len;
+    int len;
+
+    if(request_len < 0 || request_len >= (int)shm->header->request_size)
+    {
+        return -1; // (checked before a slot is claimed: every claimed slot has to be passed to the server)
+    }
+    to = json_rpc_shm_request_begin(shm, &max_len, &ticket);
+    if(!to)
+    {
+        return -1;
+    }
+    memcpy(to, request, request_len);
+    if(!json_rpc_shm_request_end(shm, ticket, request_len))
+    {
+        return -1;
+    }
+
+    result = json_rpc_shm_response_wait(shm, ticket, &len);
+    if(!result)
+    {
+        return -1;
+    }
+    if(len < response_len)
+    {
+        memcpy(response, result, len);
+        response[len] = 0;
+    }
+    else
+    {
+        len = -1;
+    }
+    if(!json_rpc_shm_release(shm, ticket))
+    {
+        len = -1; // (reclaimed by the server while it was copied: it might have been overwritten)
+    }
+    return len;
+}
+
+int json_rpc_shm_poll(json_rpc_shm_t* shm, json_rpc_instance_t* rpc, void* arg)
+{
+    json_rpc_shm_header_t* header = shm->header;
+    json_rpc_shm_slot_t* slot;
+    uint32_t pos;
+    int handled = 0;
+
+    while(true)
+    {
+        pos = __atomic_load_n(&header->tail, __ATOMIC_RELAXED); // (only changed by the server)
+        slot = slot_at(shm, pos);
+        if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1)
+        {
+            break;
+        }
+        handle_slot(shm, slot, pos, rpc, arg);
+        __atomic_store_n(&header->tail, pos + 1, __ATOMIC_RELAXED);
+        handled++;
+    }
+    return handled;
+}
+
+void json_rpc_shm_serve(json_rpc_shm_t* shm, json_rpc_instance_t* rpc, void* arg)
+{
+    json_rpc_shm_header_t* header = shm->header;
+    uint32_t pos;
+    uint32_t head;
+    uint32_t claimed_pos = 0;
+    uint32_t unreleased_pos = 0;
+    int claimed_waits = 0;      // (how long the slot at the tail is claimed without a request)
+    int unreleased_waits = 0;   // (how long the slot at the head has a response that is not released)
+
+    while(!__atomic_load_n(&header->stopped, __ATOMIC_ACQUIRE))
+    {
+        if(json_rpc_shm_poll(shm, rpc, arg))
+        {
+            continue;
+        }
+        pos = __atomic_load_n(&header->tail, __ATOMIC_RELAXED);
+        if(wait_for(shm, &slot_at(shm, pos)->seq, pos + 1, &header->server_waiting, 1))
+        {
+            claimed_waits = 0;
+            unreleased_waits = 0;
+            continue;
+        }
+
+        head = __atomic_load_n(&header->head, __ATOMIC_RELAXED);
+        if(head == pos)
+        {
+            claimed_waits = 0;
+        }
+        else if(timed_out(&claimed_waits, &claimed_pos, pos, shm->claim_timeout_ms) && skip_abandoned(shm, pos))
+        {
+            claimed_waits = 0;
+        }
+
+        // slot at the head can't be claimed (for its next round) until its response is released
+        if(__atomic_load_n(&slot_at(shm, head)->seq, __ATOMIC_ACQUIRE) != head - header->num_of_slots + 2)
+        {
+            unreleased_waits = 0;
+        }
+        else if(timed_out(&unreleased_waits, &unreleased_pos, head, shm->release_timeout_ms) &&
+                reclaim_unreleased(shm, head))
+        {
+            unreleased_waits = 0;
+        }
+    }
+}
+
+void json_rpc_shm_stop(json_rpc_shm_t* shm)
+{
+    json_rpc_shm_header_t* header = shm->header;
+    uint32_t i;
+
+    __atomic_store_n(&header->stopped, 1, __ATOMIC_SEQ_CST);
+    for(i = 0; i < header->num_of_slots; i++) // (server and clients might be waiting on any of them)
+    {
+        syscall(SYS_futex, &slot_at(shm, i)->seq, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+    }
+}
+
+
+/* Private functions ------------------------------------------------------- */
+
+static json_rpc_shm_slot_t* slot_at(const json_rpc_shm_t* shm, uint32_t pos)
+{
+    const json_rpc_shm_header_t* header = shm->header;
+    return (json_rpc_shm_slot_t*)((char*)shm->header + sizeof(json_rpc_shm_header_t) +
+                                  (uint64_t)(pos & (header->num_of_slots - 1)) * header->slot_size);
+}
+
+static int spins()
+{
+    return sysconf(_SC_NPROCESSORS_ONLN) > 1 ? JSON_RPC_SHM_SPINS : 0;
+}
+
+static int wait_for(const json_rpc_shm_t* shm, uint32_t* seq, uint32_t wanted, uint32_t* waiting, int max_waits)
+{
+    // spins for a while, and then waits using futex: the other side only wakes it if 'waiting' is set,
+    // so it is set before seq is checked again (and futex doesn't wait if seq changed meanwhile);
+    // gives up after max_waits timeouts of WAIT_TIMEOUT_NS (if it is not negative)
+    struct timespec timeout = {0, WAIT_TIMEOUT_NS};
+    uint32_t value;
+    int i;
+
+    for(i = 0; i < shm->spins; i++)
+    {
+        if(__atomic_load_n(seq, __ATOMIC_ACQUIRE) == wanted)
+        {
+            return 1;
+        }
+        CPU_RELAX();
+    }
+
+    while(true)
+    {
+        __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+        value = __atomic_load_n(seq, __ATOMIC_SEQ_CST);
+        if(value == wanted || __atomic_load_n(&shm->header->stopped, __ATOMIC_ACQUIRE) || !max_waits--)
+        {
+            break;
+        }
+        syscall(SYS_futex, seq, FUTEX_WAIT, value, &timeout, 0, 0);
+    }
+    __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+    return value == wanted;
+}
+
+static void publish(uint32_t* seq, uint32_t value, uint32_t* waiting)
+{
+    __atomic_store_n(seq, value, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(waiting, __ATOMIC_SEQ_CST))
+    {
+        syscall(SYS_futex, seq, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+    }
+}
+
+static int skip_abandoned(json_rpc_shm_t* shm, uint32_t pos)
+{
+    // slot claimed by a client that didn't pass the request in time (e.g. it died) is released,
+    // unless the request was passed in the meantime (then json_rpc_shm_request_end() fails for it)
+    json_rpc_shm_header_t* header = shm->header;
+    uint32_t seq = pos;
+
+    if(!__atomic_compare_exchange_n(&slot_at(shm, pos)->seq, &seq, pos + header->num_of_slots, 0,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    {
+        return 0;
+    }
+    __atomic_store_n(&header->tail, pos + 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+static int reclaim_unreleased(json_rpc_shm_t* shm, uint32_t pos)
+{
+    // slot with a response that wasn't released in time (e.g. the client died before it released it)
+    // is released for position pos, unless it was released in the meantime (json_rpc_shm_release() fails
+    // for it after this)
+    uint32_t seq = pos - shm->header->num_of_slots + 2;
+    return __atomic_compare_exchange_n(&slot_at(shm, pos)->seq, &seq, pos, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static int timed_out(int* waits, uint32_t* waited_pos, uint32_t pos, int timeout_ms)
+{
+    // counts timeouts of waiting (each WAIT_TIMEOUT_NS) in which the same slot stays in the same state
+    *waits = (*waits && *waited_pos == pos) ? *waits + 1 : 1;
+    *waited_pos = pos;
+    return (int64_t)*waits * (WAIT_TIMEOUT_NS / 1000000) >= timeout_ms;
+}
+
+static void handle_slot(json_rpc_shm_t* shm, json_rpc_shm_slot_t* slot, uint32_t pos,
+                        json_rpc_instance_t* rpc, void* arg)
+{
+    // request is handled in place, and response is written into the slot
+    json_rpc_shm_header_t* header = shm->header;
+    json_rpc_data_t data;
+    char* request = (char*)(slot + 1);
+    uint32_t request_len = slot->request_len;
+
+    if(request_len >= header->request_size) // (written by a client: not trusted)
+    {
+        request_len = header->request_size - 1;
+    }
+    request[request_len] = 0;
+    data.request = request;
+    data.request_len = request_len;
+    data.response = request + header->request_size;
+    data.response_len = header->response_size;
+    data.arg = arg;
+    json_rpc_handle_request(rpc, &data);
+    slot->response_len = json_rpc_response_len(&data);
+    publish(&slot->seq, pos + 2, &slot->client_waiting);
+}
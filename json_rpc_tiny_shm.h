@@ -0,0 +1,211 @@
+/**
+ @file    json_rpc_tiny_shm.h
+ @brief   Shared-memory transport for JSON-RPC requests between processes on the same host (requires Linux).
+ ___________________________
+
+ The MIT License (MIT)
+
+ Copyright (c) 2013 Lukasz Forynski
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ Requests are passed to the server through shared memory (a memfd, mapped by the server and by its
+ clients, e.g. passed to them over a unix socket or inherited by fork()), without socket calls and copies
+ by the kernel: a client writes its request directly into a slot of a ring, the server handles it in place
+ (json_rpc_handle_request() reads the request from the slot and writes the response into the slot), and
+ the client reads the response from the slot, and releases it. Waiting (for requests, or for a response)
+ is done spinning for a short while, and then using futex (wakeups are only made if the other side waits):
+
+     // server                                           // client (e.g. after fork())
+     json_rpc_shm_t shm;                                 request = json_rpc_shm_request_begin(&shm, &max_len, &ticket);
+     json_rpc_shm_create(&shm, 64, 4096, 4096);          .. (write the request into it)
+     .. (pass shm.fd to clients)                         json_rpc_shm_request_end(&shm, ticket, request_len);
+     json_rpc_shm_serve(&shm, &rpc, arg);                response = json_rpc_shm_response_wait(&shm, ticket, &len);
+                                                         .. (use the response)
+                                                         json_rpc_shm_release(&shm, ticket);
+
+ Ring can have many clients (each slot is claimed atomically), and one server thread.
+ Requests are handled in order, so a client that dies between json_rpc_shm_request_begin() and
+ json_rpc_shm_request_end() would block the ring: json_rpc_shm_serve() skips a slot that stays claimed
+ without a request for longer than claim_timeout_ms (and json_rpc_shm_request_end() fails for it).
+ Similarly, a client that dies before json_rpc_shm_release() would keep its slot from being claimed
+ again: when clients reach such a slot, it is reclaimed after release_timeout_ms (and
+ json_rpc_shm_release() fails for it).
+ Requires Linux (memfd_create, futex).
+*/
+
+#ifndef JSON_RPC_TINY_SHM
+#define JSON_RPC_TINY_SHM
+
+#include "json_rpc_tiny.h"
+
+/* Exported defines ------------------------------------------------------------*/
+
+#define JSON_RPC_SHM_MAGIC          0x4a525053  /* "JRPS": beginning of the shared memory */
+
+#ifndef JSON_RPC_SHM_SPINS
+#define JSON_RPC_SHM_SPINS          4096        /* how long to spin before waiting using futex (if there is more than one CPU) */
+#endif
+
+#ifndef JSON_RPC_SHM_CLAIM_TIMEOUT_MS
+#define JSON_RPC_SHM_CLAIM_TIMEOUT_MS 1000      /* how long a claimed slot is waited for its request (see above) */
+#endif
+
+#ifndef JSON_RPC_SHM_RELEASE_TIMEOUT_MS
+#define JSON_RPC_SHM_RELEASE_TIMEOUT_MS 1000    /* how long a slot that is needed is waited to be released (see above) */
+#endif
+
+
+/* Exported types ------------------------------------------------------------*/
+
+/**
+ * @brief Header of the shared memory (followed by slots, each with a request and a response).
+ */
+typedef struct json_rpc_shm_header
+{
+    uint32_t magic;
+    uint32_t num_of_slots;      /* (power of 2) */
+    uint32_t request_size;      /* space for a request in each slot */
+    uint32_t response_size;     /* space for a response in each slot */
+    uint32_t slot_size;         /* (including header of the slot, and padding) */
+    uint32_t stopped;           /* set by json_rpc_shm_stop() */
+    JSON_RPC_CACHE_ALIGNED uint32_t head;   /* next position to be claimed by a client */
+    JSON_RPC_CACHE_ALIGNED uint32_t tail;   /* next position to be handled by the server */
+    uint32_t server_waiting;    /* server waits (on futex) for the next request */
+} json_rpc_shm_header_t;
+
+
+/**
+ * @brief Header of a slot: seq is the position for which the slot is free, position + 1 when a request
+ *        is written, position + 2 when a response is written, and position + number of slots when released.
+ */
+typedef struct json_rpc_shm_slot
+{
+    uint32_t seq;
+    uint32_t client_waiting;    /* client waits (on futex) for the response */
+    uint32_t request_len;
+    uint32_t response_len;
+} json_rpc_shm_slot_t;
+
+
+/**
+ * @brief Shared memory, as mapped by a process.
+ */
+typedef struct json_rpc_shm
+{
+    int fd;
+    uint64_t len;
+    json_rpc_shm_header_t* header;
+    int spins;          /* JSON_RPC_SHM_SPINS, or 0 on a single CPU (where the other side can't run while spinning) */
+    int claim_timeout_ms;   /* (server) JSON_RPC_SHM_CLAIM_TIMEOUT_MS, can be changed after create / attach */
+    int release_timeout_ms; /* (server) JSON_RPC_SHM_RELEASE_TIMEOUT_MS, can be changed after create / attach */
+} json_rpc_shm_t;
+
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+ * @brief Creates (and maps) shared memory for requests.
+ * @param shm pointer to the json_rpc_shm_t object.
+ * @param num_of_slots number of slots (i.e. max number of requests in progress), rounded up to a power of 2.
+ * @param request_size max length of a request.
+ * @param response_size space for a response (it has to be enough for responses, as they are not bound-checked).
+ * @returns non-zero (bool) if created.
+ */
+int json_rpc_shm_create(json_rpc_shm_t* shm, int num_of_slots, int request_size, int response_size);
+
+
+/**
+ * @brief Maps shared memory created by json_rpc_shm_create() (e.g. in another process).
+ *        Its header is checked (magic, number of slots and their sizes) before it is used.
+ * @param shm pointer to the json_rpc_shm_t object.
+ * @param fd file descriptor of the shared memory (it is owned by shm after this call).
+ * @returns non-zero (bool) if mapped.
+ */
+int json_rpc_shm_attach(json_rpc_shm_t* shm, int fd);
+
+
+/**
+ * @brief Unmaps shared memory (and closes its file descriptor).
+ */
+void json_rpc_shm_close(json_rpc_shm_t* shm);
+
+
+/**
+ * @brief Claims a slot for a request (client side).
+ * @param shm pointer to the json_rpc_shm_t object.
+ * @param max_len (out) max length of the request.
+ * @param ticket (out) ticket of the request (to be used for other calls).
+ * @returns pointer to the space for the request in the slot, or NULL if all slots are used.
+ */
+char* json_rpc_shm_request_begin(json_rpc_shm_t* shm, int* max_len, uint32_t* ticket);
+
+
+/**
+ * @brief Passes the request (written into the slot) to the server.
+ * @returns non-zero (bool) if passed, 0 if the server skipped the slot (see claim_timeout_ms).
+ */
+int json_rpc_shm_request_end(json_rpc_shm_t* shm, uint32_t ticket, int request_len);
+
+
+/**
+ * @brief Waits for the response.
+ * @returns pointer to the response in the slot (valid until the slot is released).
+ */
+const char* json_rpc_shm_response_wait(json_rpc_shm_t* shm, uint32_t ticket, int* response_len);
+
+
+/**
+ * @brief Releases the slot (so that it can be used for another request).
+ * @returns non-zero (bool) if released, 0 if the server reclaimed the slot before (see release_timeout_ms),
+ *          in which case the response might have been overwritten.
+ */
+int json_rpc_shm_release(json_rpc_shm_t* shm, uint32_t ticket);
+
+
+/**
+ * @brief Calls the server (claims a slot, copies request into it, waits for the response and copies it).
+ * @returns length of the response, or -1 if there was no free slot, request / response didn't fit,
+ *          or the slot was skipped or reclaimed.
+ */
+int json_rpc_shm_call(json_rpc_shm_t* shm, const char* request, int request_len, char* response, int response_len);
+
+
+/**
+ * @brief Handles requests that are waiting (server side, without waiting for more).
+ * @param shm pointer to the json_rpc_shm_t object.
+ * @param rpc instance handling the requests.
+ * @param arg argument passed to handlers.
+ * @returns number of requests handled.
+ */
+int json_rpc_shm_poll(json_rpc_shm_t* shm, json_rpc_instance_t* rpc, void* arg);
+
+
+/**
+ * @brief Handles requests (waiting for them) until json_rpc_shm_stop() is called.
+ */
+void json_rpc_shm_serve(json_rpc_shm_t* shm, json_rpc_instance_t* rpc, void* arg);
+
+
+/**
+ * @brief Stops json_rpc_shm_serve() (it can be called from any thread / process).
+ */
+void json_rpc_shm_stop(json_rpc_shm_t* shm);
+
+
+#endif /* JSON_RPC_TINY_SHM */
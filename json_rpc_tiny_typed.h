@@ -0,0 +1,326 @@
+/**
+ @file    json_rpc_tiny_typed.h
+ @brief   Binding of plain C++ functions as json_rpc_tiny handlers (requires C++17).
+ ___________________________
+
+ The MIT License (MIT)
+
+ Copyright (c) 2013 Lukasz Forynski
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of
+ this software and associated documentation files (the "Software"), to deal in
+ the Software without restriction, including without limitation the rights to
+ use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ the Software, and to permit persons to whom the Software is furnished to do so,
+ subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ A function like:
+
+     int add(int a, int b);
+     std::string_view search(std::string_view last_name, int age);
+
+ can be registered as a handler with:
+
+     json_rpc_register_typed<add>(&rpc, "add");                  // positional params: [1, 2]
+
+     static const char* const search_names[] = {"last_name", "age"};
+     json_rpc_register_typed<search, search_names>(&rpc, "search"); // named params: {"age": 26, ..}
+
+ Params schema (see json_rpc_register_handler()) is generated from the function's signature,
+ so params are validated and extracted before the handler is called, and the handler generated
+ for the function only converts them to its argument types and writes its result.
+
+ Supported argument types: integral types (values out of their range, or out of int64_t range, are
+ invalid params), bool, std::string_view, json_str_view_t (string left as it is in the request)
+ and std::optional of those (for optional params).
+ Supported result types: integral and floating point types, bool, std::string_view, const char*,
+ std::string and void (result is null).
+*/
+
+#ifndef JSON_RPC_TINY_TYPED
+#define JSON_RPC_TINY_TYPED
+
+#include "json_rpc_tiny.h"
+
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/* Exported defines ------------------------------------------------------------*/
+
+#ifndef JSON_RPC_TYPED_STR_STORAGE
+#define JSON_RPC_TYPED_STR_STORAGE  256 /* space for decoding of each std::string_view param with escape sequences */
+#endif
+
+
+/* Private types ------------------------------------------------------------*/
+
+// conversion of a param (extracted as described by the params schema) to the argument type
+template <typename T, typename Enable = void>
+struct json_rpc_typed_param;
+
+template <typename T>
+struct json_rpc_typed_param<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type>
+{
+    static constexpr uint16_t type = json_rpc_param_int64;
+    static constexpr bool is_str = false;
+    static T decode(const json_rpc_param_t& param, char*, int& ok)
+    {
+        // (params are extracted as int64_t: values that don't fit in T are rejected, not truncated)
+        int64_t value = param.int64_value;
+        if(value < (int64_t)std::numeric_limits<T>::min() ||
+           (value > 0 && (uint64_t)value > (uint64_t)std::numeric_limits<T>::max()))
+        {
+            ok = 0;
+            return T();
+        }
+        return static_cast<T>(value);
+    }
+};
+
+template <>
+struct json_rpc_typed_param<bool>
+{
+    static constexpr uint16_t type = json_rpc_param_bool;
+    static constexpr bool is_str = false;
+    static bool decode(const json_rpc_param_t& param, char*, int&)
+    {
+        return param.int_value != 0;
+    }
+};
+
+template <>
+struct json_rpc_typed_param<json_str_view_t>
+{
+    static constexpr uint16_t type = json_rpc_param_str;
+    static constexpr bool is_str = false;
+    static json_str_view_t decode(const json_rpc_param_t& param, char*, int&)
+    {
+        return param.value;
+    }
+};
+
+template <>
+struct json_rpc_typed_param<std::string_view>
+{
+    static constexpr uint16_t type = json_rpc_param_str;
+    static constexpr bool is_str = true;
+    static std::string_view decode(const json_rpc_param_t& param, char* storage, int& ok)
+    {
+        // (only copied if it has to be decoded)
+        int len = 0;
+        const char* str = json_str_view_decode(&param.value, storage, JSON_RPC_TYPED_STR_STORAGE, &len);
+        if(!str)
+        {
+            ok = 0;
+            return std::string_view();
+        }
+        return std::string_view(str, len);
+    }
+};
+
+template <typename T>
+struct json_rpc_typed_param<std::optional<T>>
+{
+    static constexpr uint16_t type = json_rpc_typed_param<T>::type;
+    static constexpr bool is_str = json_rpc_typed_param<T>::is_str;
+    static std::optional<T> decode(const json_rpc_param_t& param, char* storage, int& ok)
+    {
+        if(!param.present)
+        {
+            return std::nullopt;
+        }
+        return json_rpc_typed_param<T>::decode(param, storage, ok);
+    }
+};
+
+template <typename T>
+struct json_rpc_typed_is_optional : std::false_type {};
+
+template <typename T>
+struct json_rpc_typed_is_optional<std::optional<T>> : std::true_type {};
+
+
+// writing of the result
+inline void json_rpc_typed_write(json_writer_t* writer, bool value)
+{
+    json_writer_value_bool(writer, value);
+}
+
+inline void json_rpc_typed_write(json_writer_t* writer, std::string_view value)
+{
+    json_writer_value_str(writer, value.data(), (int)value.size());
+}
+
+inline void json_rpc_typed_write(json_writer_t* writer, const char* value)
+{
+    json_writer_value_str(writer, value, -1);
+}
+
+inline void json_rpc_typed_write(json_writer_t* writer, const std::string& value)
+{
+    json_writer_value_str(writer, value.data(), (int)value.size());
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type
+json_rpc_typed_write(json_writer_t* writer, T value)
+{
+    json_writer_value_int(writer, (int64_t)value);
+}
+
+template <typename T>
+typename std::enable_if<std::is_floating_point<T>::value>::type
+json_rpc_typed_write(json_writer_t* writer, T value)
+{
+    json_writer_value_double(writer, (double)value);
+}
+
+
+// names of params (none for positional params)
+template <const char* const* Names>
+struct json_rpc_typed_names
+{
+    static const char* name(std::size_t i)
+    {
+        return Names[i];
+    }
+};
+
+template <>
+struct json_rpc_typed_names<nullptr>
+{
+    static const char* name(std::size_t)
+    {
+        return 0;
+    }
+};
+
+
+// signature of the bound function
+template <typename Fcn>
+struct json_rpc_typed_signature;
+
+template <typename Result, typename... Args>
+struct json_rpc_typed_signature<Result (*)(Args...)>
+{
+    typedef Result result_type;
+    typedef std::tuple<typename std::decay<Args>::type...> args_type;
+    static constexpr int num_of_args = sizeof...(Args);
+};
+
+
+/**
+ * @brief Handler generated for a function (see json_rpc_register_typed()).
+ *        Names (if not null) point at a table of names of function's params (in order of its arguments),
+ *        otherwise params are positional.
+ */
+template <auto Fcn, const char* const* Names = nullptr>
+struct json_rpc_typed_handler
+{
+    typedef json_rpc_typed_signature<decltype(Fcn)> signature;
+    typedef typename signature::args_type args_type;
+    static constexpr int num_of_params = signature::num_of_args;
+
+    static_assert(num_of_params <= JSON_RPC_MAX_SCHEMA_PARAMS, "too many params (see JSON_RPC_MAX_SCHEMA_PARAMS)");
+
+    template <std::size_t I>
+    using arg_param = json_rpc_typed_param<typename std::tuple_element<I, args_type>::type>;
+
+    template <std::size_t... I>
+    static constexpr int count_str_params(std::index_sequence<I...>)
+    {
+        return (0 + ... + (arg_param<I>::is_str ? 1 : 0));
+    }
+    static constexpr int num_of_str_params = count_str_params(std::make_index_sequence<num_of_params>());
+
+    template <std::size_t I>
+    static json_rpc_param_spec_t spec()
+    {
+        json_rpc_param_spec_t param_spec;
+        param_spec.name = json_rpc_typed_names<Names>::name(I);
+        param_spec.type = arg_param<I>::type;
+        param_spec.flags = json_rpc_typed_is_optional<typename std::tuple_element<I, args_type>::type>::value ?
+                           0 : json_rpc_param_required;
+        return param_spec;
+    }
+
+    template <std::size_t... I>
+    static const json_rpc_param_spec_t* schema(std::index_sequence<I...>)
+    {
+        static const json_rpc_param_spec_t params_schema[num_of_params ? num_of_params : 1] = { spec<I>()... };
+        return params_schema;
+    }
+
+    static const json_rpc_param_spec_t* schema()
+    {
+        return schema(std::make_index_sequence<num_of_params>());
+    }
+
+    template <std::size_t... I>
+    static char* call(rpc_request_info_t* info, std::index_sequence<I...>)
+    {
+        char storage[num_of_str_params ? num_of_params : 1][num_of_str_params ? JSON_RPC_TYPED_STR_STORAGE : 1];
+        int ok = 1;
+        args_type args{ arg_param<I>::decode(info->params[I], storage[num_of_str_params ? I : 0], ok)... };
+        (void)storage;
+
+        if(!ok)
+        {
+            return json_rpc_create_error(json_rpc_err_invalid_params, info);
+        }
+
+        if constexpr(std::is_void<typename signature::result_type>::value)
+        {
+            std::apply(Fcn, args);
+            return json_rpc_create_result("null", info);
+        }
+        else
+        {
+            json_writer_t writer;
+            json_rpc_writer_begin(&writer, info);
+            json_rpc_typed_write(&writer, std::apply(Fcn, args));
+            return json_rpc_writer_end(&writer, info);
+        }
+    }
+
+    static char* handle(rpc_request_info_t* info)
+    {
+        return call(info, std::make_index_sequence<num_of_params>());
+    }
+};
+
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+ * @brief Registers a function (with typed arguments and result) as a handler.
+ * @tparam Fcn pointer to the function.
+ * @tparam Names (optional) pointer to a table with names of function's params (if params are named).
+ * @param self pointer to the json_rpc_instance_t object.
+ * @param fcn_name name of the function (as it appears in RCP request).
+ * @param flags combination (bitwise-or) of json_rpc_handler_flags.
+ */
+template <auto Fcn, const char* const* Names = nullptr>
+void json_rpc_register_typed(json_rpc_instance_t* self, const char* fcn_name, unsigned int flags = 0)
+{
+    typedef json_rpc_typed_handler<Fcn, Names> handler;
+    json_rpc_register_handler(self, fcn_name, handler::handle, flags, handler::schema(), handler::num_of_params);
+}
+
+
+#endif /* JSON_RPC_TINY_TYPED */
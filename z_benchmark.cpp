@@ -0,0 +1,818 @@
+/*
+ * z_benchmark.cpp
+ *
+ * This file contains micro-benchmarks of json_rpc_tiny: parsing (member iteration / extraction),
+ * dispatch, integer conversion, response creation and end-to-end request handling
+ * for a corpus of small, medium, huge and batch requests (as JSON and MessagePack).
+ *
+ * Results are printed as a table, or (with --json) as one JSON object per line,
+ * so that they can be collected and compared between versions.
+ * Optional argument (other than --json) selects benchmarks whose names contain it.
+ * Round trips through the shared-memory ring (json_rpc_tiny_shm.h) are measured with a server thread,
+ * and HTTP requests (json_rpc_tiny_http.h, and a typical string-based wrapper for comparison) over loopback,
+ * also sent by many threads through a client that batches them (json_rpc_tiny_client.h).
+ * With --log <file> (a log of requests, one per line), the log is processed (requests are counted
+ * by method, and replayed) by 1, 2, 4.. threads, up to the number of hardware threads.
+ */
+
+#include "json_rpc_tiny.h"
+#include "json_rpc_tiny_typed.h"
+#include "json_rpc_tiny_log.h"
+#include "json_rpc_tiny_shm.h"
+#include "json_rpc_tiny_http.h"
+#include "json_rpc_tiny_client.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+// ======== benchmark harness ==========
+
+struct bench_result
+{
+    std::string name;
+    double ns_per_op;
+    double ops_per_s;
+    double bytes_per_s; // (0 if not applicable)
+};
+
+static bool json_output = false;
+static const char* name_filter = NULL;
+static volatile long sink; // results are accumulated here so that benchmarked code is not optimised-out
+
+// runs 'op' (doubling number of iterations) until it takes at least min_time, reports the last run
+template <typename Op>
+void run_benchmark(const std::string& name, size_t bytes_per_op, Op op)
+{
+    typedef std::chrono::steady_clock clock;
+    const double min_time_ns = 200e6;
+    double elapsed_ns = 0;
+    long iterations = 1;
+
+    if(name_filter && name.find(name_filter) == std::string::npos)
+    {
+        return;
+    }
+
+    while(true)
+    {
+        clock::time_point start = clock::now();
+        for(long i = 0; i < iterations; i++)
+        {
+            op();
+        }
+        elapsed_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        if(elapsed_ns >= min_time_ns || iterations >= (1L << 40))
+        {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    bench_result res;
+    res.name = name;
+    res.ns_per_op = elapsed_ns / iterations;
+    res.ops_per_s = 1e9 / res.ns_per_op;
+    res.bytes_per_s = bytes_per_op ? res.ops_per_s * bytes_per_op : 0;
+
+    if(json_output)
+    {
+        char line[256];
+        json_writer_t w;
+        json_writer_init(&w, line, sizeof(line));
+        json_writer_begin_object(&w);
+        json_writer_key(&w, "benchmark");
+        json_writer_value_str(&w, res.name.c_str(), -1);
+        json_writer_key(&w, "iterations");
+        json_writer_value_int(&w, iterations);
+        json_writer_key(&w, "ns_per_op");
+        json_writer_value_double(&w, res.ns_per_op);
+        json_writer_key(&w, "ops_per_s");
+        json_writer_value_double(&w, res.ops_per_s);
+        json_writer_key(&w, "bytes_per_s");
+        json_writer_value_double(&w, res.bytes_per_s);
+        json_writer_end_object(&w);
+        printf("%s\n", line);
+    }
+    else
+    {
+        printf("%-44s %12.1f ns/op %14.0f ops/s", res.name.c_str(), res.ns_per_op, res.ops_per_s);
+        if(res.bytes_per_s)
+        {
+            printf(" %10.1f MB/s", res.bytes_per_s / 1e6);
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+
+// ======== corpus ==========
+
+std::string small_request()
+{
+    return "{\"jsonrpc\": \"2.0\", \"method\": \"add\", \"params\": [1, 2], \"id\": 1}";
+}
+
+// named params, including nested object, strings and a list
+std::string medium_request()
+{
+    return "{\"jsonrpc\": \"2.0\", \"method\": \"search\", \"params\": "
+           "{\"last_name\": \"Python\", \"first_name\": \"Monty\", \"age\": 26, "
+           "\"address\": {\"street\": \"Some Road 12\", \"city\": \"London\", \"zip\": \"W1 2AB\"}, "
+           "\"tags\": [\"comedy\", \"british\", \"flying circus\"], \"limit\": 0x40}, \"id\": 22}";
+}
+
+// a long list of objects in params
+std::string huge_request()
+{
+    std::string req = "{\"jsonrpc\": \"2.0\", \"method\": \"ingest\", \"params\": [";
+    for(int i = 0; i < 300; i++)
+    {
+        char item[128];
+        snprintf(item, sizeof(item), "%s{\"id\": %d, \"name\": \"item number %d\", \"value\": %d}",
+                 i ? ", " : "", i, i, i * 7);
+        req += item;
+    }
+    req += "], \"id\": 333}";
+    return req;
+}
+
+std::string batch_request()
+{
+    std::string req = "[";
+    for(int i = 0; i < 16; i++)
+    {
+        char item[128];
+        snprintf(item, sizeof(item), "%s{\"jsonrpc\": \"2.0\", \"method\": \"add\", \"params\": [%d, %d], \"id\": %d}",
+                 i ? ", " : "", i, i * 2, i + 100);
+        req += item;
+    }
+    req += "]";
+    return req;
+}
+
+
+// ======== handlers ==========
+
+char* add(rpc_request_info_t* info)
+{
+    int a = 0;
+    int b = 0;
+    if(rpc_extract_param_int(0, &a, info) && rpc_extract_param_int(1, &b, info))
+    {
+        char* res = json_rpc_result_begin(info);
+        if(res)
+        {
+            res = json_format_int(res, a + b);
+        }
+        return json_rpc_result_end(res, info);
+    }
+    return json_rpc_create_error(json_rpc_err_invalid_params, info);
+}
+
+char* search(rpc_request_info_t* info)
+{
+    int age = 0;
+    int len = 0;
+    const char* last_name = rpc_extract_param_str("last_name", &len, info);
+    if(last_name && rpc_extract_param_int("age", &age, info))
+    {
+        return json_rpc_create_result("\"Monty\"", info);
+    }
+    return json_rpc_create_error(json_rpc_err_invalid_params, info);
+}
+
+// the same as search, bound as a typed handler
+static const char* const typed_search_names[] = {"last_name", "age"};
+std::string_view typed_search(std::string_view last_name, int age)
+{
+    return (last_name.size() && age) ? "Monty" : "";
+}
+
+char* ingest(rpc_request_info_t* info)
+{
+    json_token_info_t token;
+    int pos = 1; // (past the list begin)
+    int count = 0;
+    const char* params = info->data->request + info->params_start;
+    while(true)
+    {
+        pos = json_find_next_member(pos, params, info->params_len, &token);
+        if(!token.values_len)
+        {
+            break;
+        }
+        count++;
+    }
+
+    char* res = json_rpc_result_begin(info);
+    if(res)
+    {
+        res = json_format_int(res, count);
+    }
+    return json_rpc_result_end(res, info);
+}
+
+char* nop(rpc_request_info_t* info)
+{
+    return json_rpc_create_result("0", info);
+}
+
+
+// ======== benchmarks ==========
+
+#define MAX_NUM_OF_HANDLERS 64
+json_rpc_handler_t storage_for_handlers[MAX_NUM_OF_HANDLERS];
+char response_buffer[64 * 1024];
+
+void bench_parsing(const std::string& name, const std::string& input)
+{
+    const char* in = input.c_str();
+    int in_len = input.size();
+
+    // iterate over all top-level members (and members of params)
+    run_benchmark("find_next_member/" + name, in_len, [&]() {
+        json_token_info_t token;
+        int pos = 1;
+        long n = 0;
+        while(true)
+        {
+            pos = json_find_next_member(pos, in, in_len, &token);
+            if(!token.values_len)
+            {
+                break;
+            }
+            n += token.values_len;
+        }
+        sink += n;
+    });
+
+    run_benchmark("extract_member_str/by_name/" + name, in_len, [&]() {
+        int len = 0;
+        const char* p = json_extract_member_str("id", &len, in, in_len);
+        sink += len + (p != NULL);
+    });
+
+    run_benchmark("extract_member_str/by_position/" + name, in_len, [&]() {
+        int len = 0;
+        const char* p = json_extract_member_str(3, &len, in, in_len);
+        sink += len + (p != NULL);
+    });
+}
+
+void bench_paths()
+{
+    // nested value: chained extraction (each rescans its part) vs a path (compiled once, walked once)
+    static const std::string input = medium_request();
+    const char* in = input.c_str();
+    int in_len = input.size();
+
+    run_benchmark("extract_nested/chained/medium", in_len, [&]() {
+        int params_len = 0;
+        int address_len = 0;
+        int len = 0;
+        const char* params = json_extract_member_str("params", &params_len, in, in_len);
+        const char* address = json_extract_member_str("address", &address_len, params, params_len);
+        const char* p = json_extract_member_str("zip", &len, address, address_len);
+        sink += len + (p != NULL);
+    });
+
+    json_path_t path;
+    json_path_compile(&path, "/params/address/zip");
+    run_benchmark("extract_nested/path/medium", in_len, [&]() {
+        int len = 0;
+        const char* p = json_extract_path_str(&path, &len, in, in_len);
+        sink += len + (p != NULL);
+    });
+
+    // 40 nested fields (4 of each of 10 records, among other members): a path at a time vs a set of paths
+    static std::string records = "{";
+    for(int i = 0; i < 12; i++)
+    {
+        char item[256];
+        snprintf(item, sizeof(item), "%s\"rec%d\": {\"id\": %d, \"meta\": {\"tags\": [1, 2, 3], \"note\": \"n%d\"}, "
+                 "\"pos\": {\"x\": %d, \"y\": %d}, \"size\": [%d, %d]}", i ? ", " : "", i, i, i, i, i * 2, i * 3, i + 1);
+        records += item;
+    }
+    records += "}";
+    static json_path_t paths[40];
+    static json_path_node_t nodes[128];
+    json_path_set_t set;
+    json_path_set_init(&set, nodes, 128);
+    for(int i = 0; i < 40; i++)
+    {
+        static const char* const fields[] = {"/id", "/pos/x", "/pos/y", "/size/1"};
+        std::string path_str = "/rec" + std::to_string(i / 4) + fields[i % 4];
+        json_path_compile(&paths[i], path_str.c_str());
+        json_path_set_add(&set, path_str.c_str());
+    }
+
+    run_benchmark("extract_40_fields/paths/records", records.size(), [&]() {
+        int len = 0;
+        for(int i = 0; i < 40; i++)
+        {
+            sink += (json_extract_path_str(&paths[i], &len, records.c_str(), records.size()) != NULL) + len;
+        }
+    });
+
+    static json_str_view_t slots[40];
+    run_benchmark("extract_40_fields/path_set/records", records.size(), [&]() {
+        sink += json_extract_paths(&set, slots, records.c_str(), records.size());
+    });
+}
+
+void bench_dispatch()
+{
+    // dispatch by name (linear search through registered handlers): first and last of many handlers
+    static char names[MAX_NUM_OF_HANDLERS][16];
+    json_rpc_instance_t rpc;
+    json_rpc_init(&rpc, storage_for_handlers, MAX_NUM_OF_HANDLERS);
+    for(int i = 0; i < MAX_NUM_OF_HANDLERS; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "method_%02d", i);
+        json_rpc_register_handler(&rpc, names[i], nop);
+    }
+
+    const int positions[] = {0, MAX_NUM_OF_HANDLERS - 1};
+    for(int p : positions)
+    {
+        static std::string request;
+        request = std::string("{\"jsonrpc\": \"2.0\", \"method\": \"") + names[p] + "\", \"params\": [], \"id\": 1}";
+        json_rpc_data_t data;
+        data.request = request.c_str();
+        data.request_len = request.size();
+        data.response = response_buffer;
+        data.response_len = sizeof(response_buffer);
+        data.arg = NULL;
+
+        char name[64];
+        snprintf(name, sizeof(name), "dispatch/handler_%d_of_%d", p + 1, MAX_NUM_OF_HANDLERS);
+        run_benchmark(name, request.size(), [&]() {
+            sink += json_rpc_handle_request(&rpc, &data)[0];
+        });
+    }
+}
+
+void bench_conversion()
+{
+    // integer conversion (through extraction of a single member)
+    const char* inputs[][2] = { {"decimal", "[1234567]"}, {"negative", "[-1234567]"}, {"hex", "[0x12d687]"} };
+    for(auto& in : inputs)
+    {
+        const char* input = in[1];
+        int input_len = strlen(input);
+        run_benchmark(std::string("convert_to_int/") + in[0], input_len, [&]() {
+            int value = 0;
+            json_extract_member_int(0, &value, input, input_len);
+            sink += value;
+        });
+    }
+}
+
+void bench_response_creation()
+{
+    static const char* request = "{\"jsonrpc\": \"2.0\", \"method\": \"x\", \"params\": [], \"id\": 12345}";
+    json_rpc_data_t data;
+    data.request = request;
+    data.request_len = strlen(request);
+    data.response = response_buffer;
+    data.response_len = sizeof(response_buffer);
+    data.arg = NULL;
+
+    rpc_request_info_t info;
+    info.data = &data;
+    info.params_start = strstr(request, "[]") - request;
+    info.params_len = 2;
+    info.id_start = strstr(request, "12345") - request;
+    info.id_len = 5;
+    info.info_flags = 2; // (JSON-RPC 2.0 request)
+    info.error = -1;
+
+    run_benchmark("create_result", 0, [&]() {
+        response_buffer[0] = 0;
+        sink += json_rpc_create_result("{\"operation\": \"+\", \"res\": 160}", &info)[0];
+    });
+
+    run_benchmark("create_error", 0, [&]() {
+        response_buffer[0] = 0;
+        sink += json_rpc_create_error(json_rpc_err_method_not_found, &info)[0];
+    });
+}
+
+void bench_handle_request(const std::string& name, const std::string& request)
+{
+    json_rpc_instance_t rpc;
+    json_rpc_init(&rpc, storage_for_handlers, MAX_NUM_OF_HANDLERS);
+    json_rpc_register_handler(&rpc, "add", add);
+    json_rpc_register_handler(&rpc, "search", search);
+    json_rpc_register_handler(&rpc, "ingest", ingest);
+    json_rpc_register_typed<typed_search, typed_search_names>(&rpc, "typed_search");
+
+    json_rpc_data_t data;
+    data.request = request.c_str();
+    data.request_len = request.size();
+    data.response = response_buffer;
+    data.response_len = sizeof(response_buffer);
+    data.arg = NULL;
+
+    run_benchmark("handle_request/" + name, request.size(), [&]() {
+        sink += json_rpc_handle_request(&rpc, &data)[0];
+    });
+}
+
+void bench_shm(const std::string& name, const std::string& request)
+{
+    json_rpc_instance_t rpc;
+    json_rpc_init(&rpc, storage_for_handlers, MAX_NUM_OF_HANDLERS);
+    json_rpc_register_handler(&rpc, "add", add);
+    json_rpc_register_handler(&rpc, "search", search);
+    json_rpc_register_handler(&rpc, "ingest", ingest);
+
+    json_rpc_shm_t shm;
+    if(!json_rpc_shm_create(&shm, 16, request.size() + 1, sizeof(response_buffer)))
+    {
+        printf("can't create shared memory\n");
+        return;
+    }
+    std::thread server(json_rpc_shm_serve, &shm, &rpc, (void*)NULL);
+
+    // (request is copied into a slot, handled by the server thread, and response is copied out)
+    run_benchmark("shm_call/" + name, request.size(), [&]() {
+        sink += json_rpc_shm_call(&shm, request.c_str(), request.size(), response_buffer, sizeof(response_buffer));
+    });
+    json_rpc_shm_stop(&shm);
+    server.join();
+    json_rpc_shm_close(&shm);
+}
+
+// ======== HTTP over loopback ==========
+
+// a typical wrapper (for comparison): headers are split into strings and looked up in a map,
+// the body is copied out, and the response is concatenated into a new string
+void wrapper_serve(int fd, json_rpc_instance_t* rpc)
+{
+    std::string buffer;
+    std::vector<char> response(64 * 1024);
+    char received[16 * 1024];
+    while(true)
+    {
+        size_t header_end;
+        ssize_t n;
+        while((header_end = buffer.find("\r\n\r\n")) == std::string::npos)
+        {
+            if((n = recv(fd, received, sizeof(received), 0)) <= 0)
+            {
+                return;
+            }
+            buffer.append(received, n);
+        }
+        std::istringstream lines(buffer.substr(0, header_end));
+        std::string line;
+        std::getline(lines, line); // (request line)
+        std::map<std::string, std::string> headers;
+        while(std::getline(lines, line))
+        {
+            size_t colon = line.find(':');
+            std::string name = line.substr(0, colon);
+            for(auto& c : name)
+            {
+                c = tolower(c);
+            }
+            size_t value_start = line.find_first_not_of(" ", colon + 1);
+            headers[name] = line.substr(value_start, line.find_last_not_of("\r ") + 1 - value_start);
+        }
+        size_t length = std::stoul(headers["content-length"]);
+        while(buffer.size() < header_end + 4 + length)
+        {
+            if((n = recv(fd, received, sizeof(received), 0)) <= 0)
+            {
+                return;
+            }
+            buffer.append(received, n);
+        }
+        std::string body = buffer.substr(header_end + 4, length);
+        buffer.erase(0, header_end + 4 + length);
+
+        json_rpc_data_t data;
+        data.request = body.c_str();
+        data.request_len = body.size();
+        data.response = &response[0];
+        data.response_len = response.size();
+        data.arg = NULL;
+        json_rpc_handle_request(rpc, &data);
+        std::string out = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+                          std::to_string(json_rpc_response_len(&data)) + "\r\n\r\n" +
+                          std::string(&response[0], json_rpc_response_len(&data));
+        if(send(fd, out.data(), out.size(), MSG_NOSIGNAL) < 0)
+        {
+            return;
+        }
+    }
+}
+
+void tiny_serve(int fd, json_rpc_instance_t* rpc, int max_pending)
+{
+    static char input[64 * 1024];
+    static char output[64 * 1024];
+    json_rpc_http_conn_t conn;
+    json_rpc_http_conn_init(&conn, fd, rpc, input, sizeof(input), output, sizeof(output), NULL);
+    conn.max_pending = max_pending;
+    json_rpc_http_conn_serve(&conn);
+}
+
+void tiny_serve(int fd, json_rpc_instance_t* rpc)
+{
+    tiny_serve(fd, rpc, JSON_RPC_HTTP_MAX_PENDING);
+}
+
+void tiny_serve_unbatched(int fd, json_rpc_instance_t* rpc)
+{
+    tiny_serve(fd, rpc, 1); // (a write per response)
+}
+
+// connects a client to a server (over TCP on loopback), and returns the client's socket (or -1)
+int connect_loopback(int* server_fd)
+{
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int client_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    sockaddr_in addr = {};
+    socklen_t addr_len = sizeof(addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(listen_fd < 0 || client_fd < 0 || bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+       listen(listen_fd, 1) != 0 || getsockname(listen_fd, (sockaddr*)&addr, &addr_len) != 0 ||
+       connect(client_fd, (sockaddr*)&addr, sizeof(addr)) != 0 || (*server_fd = accept(listen_fd, NULL, NULL)) < 0)
+    {
+        close(listen_fd);
+        close(client_fd);
+        return -1;
+    }
+    close(listen_fd);
+    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(*server_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return client_fd;
+}
+
+// sends requests (at once), and reads until all responses are received
+void http_round_trip(int fd, const std::string& requests, int num_of_responses, std::string& received)
+{
+    char buffer[16 * 1024];
+    size_t pos = 0;
+    received.clear();
+    send(fd, requests.data(), requests.size(), MSG_NOSIGNAL);
+    while(num_of_responses)
+    {
+        size_t header_end = received.find("\r\n\r\n", pos);
+        size_t length_at = received.find("Content-Length: ", pos);
+        if(header_end != std::string::npos && length_at < header_end &&
+           received.size() >= header_end + 4 + strtoul(&received[length_at + 16], NULL, 10))
+        {
+            pos = header_end + 4 + strtoul(&received[length_at + 16], NULL, 10);
+            num_of_responses--;
+            continue;
+        }
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if(n <= 0)
+        {
+            return;
+        }
+        received.append(buffer, n);
+    }
+}
+
+void bench_http(const std::string& name, const std::string& body)
+{
+    json_rpc_instance_t rpc;
+    json_rpc_init(&rpc, storage_for_handlers, MAX_NUM_OF_HANDLERS);
+    json_rpc_register_handler(&rpc, "add", add);
+    json_rpc_register_handler(&rpc, "search", search);
+    json_rpc_register_handler(&rpc, "ingest", ingest);
+
+    std::string request = "POST /rpc HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/json\r\nContent-Length: " +
+                          std::to_string(body.size()) + "\r\n\r\n" + body;
+    std::string pipelined;
+    for(int i = 0; i < 16; i++)
+    {
+        pipelined += request;
+    }
+    std::string received;
+
+    void (*servers[])(int, json_rpc_instance_t*) = {tiny_serve, tiny_serve_unbatched, wrapper_serve};
+    const char* server_names[] = {"tiny", "tiny_unbatched", "wrapper"};
+    for(int s = 0; s < 3; s++)
+    {
+        int server_fd = -1;
+        int client_fd = connect_loopback(&server_fd);
+        if(client_fd < 0)
+        {
+            printf("can't connect over loopback\n");
+            return;
+        }
+        std::thread server(servers[s], server_fd, &rpc);
+        run_benchmark("http_keep_alive/" + name + "/" + server_names[s], request.size(), [&]() {
+            http_round_trip(client_fd, request, 1, received);
+            sink += received.size();
+        });
+        run_benchmark("http_pipelined_x16/" + name + "/" + server_names[s], pipelined.size(), [&]() {
+            http_round_trip(client_fd, pipelined, 16, received);
+            sink += received.size();
+        });
+        close(client_fd);
+        server.join();
+        close(server_fd);
+    }
+}
+
+// sends a batch over HTTP (keep-alive connection), and copies the body of the response
+int http_send_batch(const char* request, int request_len, char* response, int response_len, void* arg)
+{
+    static std::string received;
+    std::string message = "POST /rpc HTTP/1.1\r\nHost: localhost\r\nContent-Length: " + std::to_string(request_len) +
+                          "\r\n\r\n" + std::string(request, request_len);
+    http_round_trip(*(int*)arg, message, 1, received);
+    size_t body = received.find("\r\n\r\n") + 4;
+    if(body < 4 || received.size() - body >= (size_t)response_len)
+    {
+        return -1;
+    }
+    memcpy(response, &received[body], received.size() - body);
+    return received.size() - body;
+}
+
+void bench_client()
+{
+    json_rpc_instance_t rpc;
+    json_rpc_init(&rpc, storage_for_handlers, MAX_NUM_OF_HANDLERS);
+    json_rpc_register_handler(&rpc, "add", add);
+
+    static char requests[64 * 1024];
+    static char responses[64 * 1024];
+    const int num_of_threads = 8;
+    const int calls_per_thread = 64;
+    const char* variants[] = {"batched", "unbatched"};
+    for(int v = 0; v < 2; v++)
+    {
+        int server_fd = -1;
+        int client_fd = connect_loopback(&server_fd);
+        if(client_fd < 0)
+        {
+            printf("can't connect over loopback\n");
+            return;
+        }
+        std::thread server([&]() { tiny_serve(server_fd, &rpc); });
+        json_rpc_client_t client;
+        json_rpc_client_init(&client, http_send_batch, &client_fd, requests, sizeof(requests), responses,
+                             sizeof(responses));
+        client.max_calls = v ? 1 : JSON_RPC_CLIENT_MAX_CALLS;
+
+        // (callers in many threads, e.g. fanning out a request to many services)
+        run_benchmark("client_fanout_8x64/" + std::string(variants[v]), 0, [&]() {
+            std::thread callers[num_of_threads];
+            for(auto& caller : callers)
+            {
+                caller = std::thread([&]() {
+                    char response[256];
+                    for(int i = 0; i < calls_per_thread; i++)
+                    {
+                        sink += json_rpc_client_call(&client, "add", "[1, 2]", response, sizeof(response));
+                    }
+                });
+            }
+            for(auto& caller : callers)
+            {
+                caller.join();
+            }
+        });
+        json_rpc_client_destroy(&client);
+        close(client_fd);
+        server.join();
+        close(server_fd);
+    }
+}
+
+void bench_log(const char* path)
+{
+    json_rpc_log_t log;
+    if(!json_rpc_log_open(&log, path))
+    {
+        printf("can't open: %s\n", path);
+        return;
+    }
+
+    int max_threads = std::thread::hardware_concurrency();
+    max_threads = max_threads < 1 ? 1 : max_threads > JSON_RPC_LOG_MAX_THREADS ? JSON_RPC_LOG_MAX_THREADS : max_threads;
+    static json_rpc_handler_t handlers[JSON_RPC_LOG_MAX_THREADS][8];
+    static json_rpc_instance_t rpc[JSON_RPC_LOG_MAX_THREADS];
+    static uint64_t calls[JSON_RPC_LOG_MAX_THREADS][8];
+    static std::vector<char> responses[JSON_RPC_LOG_MAX_THREADS];
+    json_rpc_log_count_t counts[JSON_RPC_LOG_MAX_THREADS];
+    json_rpc_log_replay_t replays[JSON_RPC_LOG_MAX_THREADS];
+    void* count_args[JSON_RPC_LOG_MAX_THREADS];
+    void* replay_args[JSON_RPC_LOG_MAX_THREADS];
+
+    for(int i = 0; i < max_threads; i++)
+    {
+        // (an instance per thread)
+        json_rpc_init(&rpc[i], handlers[i], 8);
+        json_rpc_register_handler(&rpc[i], "add", add);
+        json_rpc_register_handler(&rpc[i], "search", search);
+        json_rpc_register_handler(&rpc[i], "ingest", ingest);
+        json_rpc_register_typed<typed_search, typed_search_names>(&rpc[i], "typed_search");
+        responses[i].resize(64 * 1024);
+
+        counts[i].rpc = &rpc[i];
+        counts[i].calls = calls[i];
+        counts[i].unknown = counts[i].requests = 0;
+        count_args[i] = &counts[i];
+        replays[i].rpc = &rpc[i];
+        replays[i].response = &responses[i][0];
+        replays[i].response_len = responses[i].size();
+        replays[i].arg = NULL;
+        replays[i].requests = replays[i].request_bytes = replays[i].response_bytes = 0;
+        replay_args[i] = &replays[i];
+    }
+
+    for(int threads = 1; threads <= max_threads; threads = (threads * 2 > max_threads && threads < max_threads) ?
+                                                                max_threads : threads * 2)
+    {
+        run_benchmark("log_count/" + std::to_string(threads) + "_threads", log.len, [&]() {
+            json_rpc_log_process(&log, threads, json_rpc_log_count_line, count_args);
+        });
+        run_benchmark("log_replay/" + std::to_string(threads) + "_threads", log.len, [&]() {
+            json_rpc_log_process(&log, threads, json_rpc_log_replay_line, replay_args);
+        });
+    }
+    json_rpc_log_close(&log);
+}
+
+int main(int argc, char** argv)
+{
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--json") == 0)
+        {
+            json_output = true;
+        }
+        else if(strcmp(argv[i], "--log") == 0 && i + 1 < argc)
+        {
+            bench_log(argv[i + 1]);
+            return 0;
+        }
+        else
+        {
+            name_filter = argv[i];
+        }
+    }
+
+    const std::string corpus[][2] =
+    {
+        {"small",  small_request()},
+        {"medium", medium_request()},
+        {"huge",   huge_request()},
+        {"batch",  batch_request()},
+    };
+
+    for(auto& c : corpus)
+    {
+        bench_parsing(c[0], c[1]);
+    }
+    bench_paths();
+    bench_dispatch();
+    bench_conversion();
+    bench_response_creation();
+    for(auto& c : corpus)
+    {
+        bench_handle_request(c[0], c[1]);
+    }
+
+    std::string typed_request = medium_request();
+    typed_request.replace(typed_request.find("\"search\""), 8, "\"typed_search\"");
+    bench_handle_request("medium_typed", typed_request);
+    bench_shm("small", corpus[0][1]);
+    bench_shm("medium", corpus[1][1]);
+    bench_http("small", corpus[0][1]);
+    bench_http("medium", corpus[1][1]);
+    bench_client();
+
+    // the same requests, encoded as MessagePack
+    for(auto& c : corpus)
+    {
+        std::string packed(c[1].size(), 0);
+        packed.resize(json_to_msgpack(c[1].c_str(), c[1].size(), &packed[0], packed.size()));
+        bench_handle_request(c[0] + "_msgpack", packed);
+    }
+    return 0;
+}
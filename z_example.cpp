@@ -9,14 +9,24 @@
  */
 
 #include "json_rpc_tiny.h"
+#include "json_rpc_tiny_typed.h"
+#include "json_rpc_tiny_log.h"
+#include "json_rpc_tiny_shm.h"
+#include "json_rpc_tiny_http.h"
+#include "json_rpc_tiny_client.h"
 
 
 #include <string.h>
 #include <iostream>
 #include <sstream>
 #include <ctime>
+#include <thread>
+#include <atomic>
+#include <vector>
 
 #include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 void rpc_handling_examples(char** argv);
 void extracting_json_examples();
@@ -30,17 +40,23 @@ int run_tests();
 char* getTimeDate(rpc_request_info_t* info)
 {
     // (no need to parse arguments here)
-    std::stringstream res;
     time_t curr_time;
     time(&curr_time);
     struct tm * now = localtime(&curr_time);
-    res << "\""
-         << (now->tm_year + 1900) << '-'
-         << (now->tm_mon + 1) << '-'
-         <<  now->tm_mday
-         << "\"";
 
-    return json_rpc_create_result(res.str().c_str(), info);
+    // result is written directly into the response (no need for temporary buffers)
+    char* res = json_rpc_result_begin(info);
+    if(res)
+    {
+        *res++ = '\"';
+        res = json_format_int(res, now->tm_year + 1900);
+        *res++ = '-';
+        res = json_format_int(res, now->tm_mon + 1);
+        *res++ = '-';
+        res = json_format_int(res, now->tm_mday);
+        *res++ = '\"';
+    }
+    return json_rpc_result_end(res, info);
 }
 
 // uses named params
@@ -130,30 +146,38 @@ char* calculate(rpc_request_info_t* info)
       rpc_extract_param_int("first", &first, info) &&
       rpc_extract_param_int("second", &second, info))
     {
-        std::stringstream result;
-        result << "{" << "\"operation\": \"" << std::string(operation, op_len);
-        result << "\", \"res\": ";
-
+        int value = 0;
         switch(operation[0])
         {
         case '*':
-            result << first * second;
+            value = first * second;
             break;
 
         case '+':
-            result << first + second;
+            value = first + second;
             break;
 
         case '-':
-            result << first - second;
+            value = first - second;
             break;
 
         case '/':
-            result << first / second;
+            value = first / second;
             break;
         }
-        result << "}";
-        res = json_rpc_create_result(result.str().c_str(), info);
+
+        // write result directly into the response
+        char* result = json_rpc_result_begin(info);
+        if(result)
+        {
+            strcpy(result, "{\"operation\": ");
+            result = json_format_str(result + strlen(result), operation, op_len);
+            strcpy(result, ", \"res\": ");
+            result += strlen(result);
+            result = json_format_int(result, value);
+            *result++ = '}';
+        }
+        res = json_rpc_result_end(result, info);
     }
     else
     {
@@ -179,12 +203,18 @@ char* ordered_params(rpc_request_info_t* info)
        rpc_extract_param_int(0, &first, info) &&
        rpc_extract_param_int(2, &third, info))
     {
-        std::stringstream s;
-        s << "{\"first\": " << first << ", ";
-        s << "\"second\": \"" << std::string(second, second_len) << "\", ";
-        s << "\"third\": " << third << "}";
-
-        res = json_rpc_create_result(s.str().c_str(), info);
+        // structured results can be written directly into the response using JSON writer
+        json_writer_t result;
+        json_rpc_writer_begin(&result, info);
+        json_writer_begin_object(&result);
+        json_writer_key(&result, "first");
+        json_writer_value_int(&result, first);
+        json_writer_key(&result, "second");
+        json_writer_value_str(&result, second, second_len);
+        json_writer_key(&result, "third");
+        json_writer_value_int(&result, third);
+        json_writer_end_object(&result);
+        res = json_rpc_writer_end(&result, info);
     }
     else
     {
@@ -219,13 +249,26 @@ char* handleMessage(rpc_request_info_t* info)
 char* send_back(rpc_request_info_t* info)
 {
     char* res = NULL;
+    json_str_view_t what;
+    const char* msg = NULL;
     int len = 0;
-    const char* msg = rpc_extract_param_str("what", &len, info);
+    char storage[64];
+
+    // string is only copied (decoded) if it contains escape sequences
+    if(rpc_extract_param_view("what", &what, info))
+    {
+        msg = json_str_view_decode(&what, storage, sizeof(storage), &len);
+    }
+
     if(msg)
     {
-        std::string message(msg, len);
-        message = "{\"res\": \"" + message + "\"}";
-        res = json_rpc_create_result(message.c_str(), info);
+        json_writer_t result;
+        json_rpc_writer_begin(&result, info);
+        json_writer_begin_object(&result);
+        json_writer_key(&result, "res");
+        json_writer_value_str(&result, msg, len);
+        json_writer_end_object(&result);
+        res = json_rpc_writer_end(&result, info);
     }
     else
     {
@@ -234,6 +277,73 @@ char* send_back(rpc_request_info_t* info)
     return res;
 }
 
+// params can also be described by a schema (when the handler is registered):
+// they are then validated and extracted before the handler is called
+const json_rpc_param_spec_t describe_params[] =
+{
+    {"name",  json_rpc_param_str,  json_rpc_param_required},
+    {"age",   json_rpc_param_int,  json_rpc_param_required},
+    {"admin", json_rpc_param_bool, 0}                       // (optional)
+};
+const int describe_num_of_params = sizeof(describe_params)/sizeof(describe_params[0]);
+
+char* describe(rpc_request_info_t* info)
+{
+    // (params are in the order of the schema)
+    const json_rpc_param_t* name = &info->params[0];
+    const json_rpc_param_t* age = &info->params[1];
+    const json_rpc_param_t* admin = &info->params[2];
+
+    json_writer_t result;
+    json_rpc_writer_begin(&result, info);
+    json_writer_begin_object(&result);
+    json_writer_key(&result, "who");
+    json_writer_value_raw(&result, name->value.start - 1, name->value.len + 2); // (as it was, with quotes)
+    json_writer_key(&result, "adult");
+    json_writer_value_bool(&result, age->int_value >= 18);
+    json_writer_key(&result, "admin");
+    json_writer_value_bool(&result, admin->present && admin->int_value);
+    json_writer_end_object(&result);
+    return json_rpc_writer_end(&result, info);
+}
+
+// in C++ plain functions can be bound as handlers (see json_rpc_register_typed()):
+// params are converted to argument types, and the returned value is written as the result
+int add(int a, int b)
+{
+    return a + b;
+}
+
+int typed_resets = 0;
+void typed_reset()
+{
+    typed_resets++;
+}
+
+unsigned int typed_square(uint8_t value)
+{
+    return value * value;
+}
+
+int64_t typed_add64(int64_t a, int b)
+{
+    return a + b;
+}
+
+json_rpc_instance_t* reload_self = 0;
+json_rpc_instance_t* reload_handlers = 0;
+json_rpc_instance_t* reload_previous = 0;
+void typed_reload()
+{
+    reload_previous = json_rpc_registry_publish_in_handler(reload_self, reload_handlers);
+}
+
+static const char* const typed_search_names[] = {"last_name", "age"}; // (for named params)
+std::string_view typed_search(std::string_view last_name, std::optional<int> age)
+{
+    return (last_name == "Python" && age.value_or(26) == 26) ? "Monty" : "nobody";
+}
+
 // ====  example JSON RPC requests ==
 const char* example_requests[] =
 {
@@ -254,6 +364,9 @@ const char* example_requests[] =
  "{\"jsonrpc\": \"2.0\", \"method\": \"calculate\", \"params\": [{\"first\": -0x32, \"second\": -055, \"op\": \"-\"}], \"id\": 44}",
  "{\"jsonrpc\": \"2.0\", \"method\": \"send_back\", \"params\": [{\"what\": \"{[{abcde}]}\"}], \"id\": 45}",
  "{\"jsonrpc\": \"2.0\", \"thod\": \"search\".. }", // not valid, but a whole object, jsonrpc will be parsed..
+ "{\"jsonrpc\": \"2.0\", \"method\": \"describe\", \"params\": [{\"age\": 33, \"name\": \"Brian\"}], \"id\": 46}",
+ "{\"jsonrpc\": \"2.0\", \"method\": \"add\", \"params\": [0x10, -3], \"id\": 47}",
+ "{\"jsonrpc\": \"2.0\", \"method\": \"typed_search\", \"params\": {\"last_name\": \"Python\"}, \"id\": 48}",
 };
 const int num_of_examples = sizeof(example_requests)/sizeof(char*);
 
@@ -291,6 +404,9 @@ void rpc_handling_examples(char** argv)
     json_rpc_register_handler(&rpc, "calculate",      calculate);
     json_rpc_register_handler(&rpc, "ordered_params", ordered_params);
     json_rpc_register_handler(&rpc, "send_back",      send_back);
+    json_rpc_register_handler(&rpc, "describe",       describe, 0, describe_params, describe_num_of_params);
+    json_rpc_register_typed<add>(&rpc, "add");
+    json_rpc_register_typed<typed_search, typed_search_names>(&rpc, "typed_search");
 
     // prepare and initialise request data
     json_rpc_data_t req_data;
@@ -455,6 +571,43 @@ void print_all_members_of_object(const std::string& input, int curr_pos, int obj
                                   s << " " << #_cond_ << "\n"; \
                                   throw std::runtime_error(s.str()); } })
 
+// clock used for stats in tests: advances by 10 ticks at each call
+uint64_t test_clock()
+{
+    static uint64_t ticks = 0;
+    return ticks += 10;
+}
+
+// clock that is only advanced by tests
+uint64_t manual_time = 0;
+uint64_t manual_clock()
+{
+    return manual_time;
+}
+
+// 'calculate' that counts its calls (to check if results came from the cache)
+int calculate_calls = 0;
+char* counted_calculate(rpc_request_info_t* info)
+{
+    calculate_calls++;
+    return calculate(info);
+}
+
+// 'calculate' that takes a while (so that identical calls overlap), or throws when asked to
+int slow_calculate_calls = 0;
+bool slow_calculate_throws = false;
+char* slow_calculate(rpc_request_info_t* info)
+{
+    __atomic_fetch_add(&slow_calculate_calls, 1, __ATOMIC_RELAXED);
+    if(slow_calculate_throws)
+    {
+        slow_calculate_throws = false;
+        throw std::runtime_error("handler failed");
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    return calculate(info);
+}
+
 // helper method: executes JSON rpc given example number and returns the response
 const char*  handle_request_for_example(int example_number, json_rpc_data_t& req_data, json_rpc_instance& rpc)
 {
@@ -500,6 +653,9 @@ int run_tests()
     json_rpc_register_handler(&rpc, "calculate",      calculate);
     json_rpc_register_handler(&rpc, "ordered_params", ordered_params);
     json_rpc_register_handler(&rpc, "send_back",      send_back);
+    json_rpc_register_handler(&rpc, "describe",       describe, 0, describe_params, describe_num_of_params);
+    json_rpc_register_typed<add>(&rpc, "add");
+    json_rpc_register_typed<typed_search, typed_search_names>(&rpc, "typed_search");
 
 
     try
@@ -619,6 +775,1008 @@ int run_tests()
         TEST_COND_(extract_str_param("id", batch_res) == "none");
 
 
+        // formatting helpers
+        char formatted[64];
+        TEST_COND_(std::string(formatted, json_format_int(formatted, -9223372036854775807LL - 1)) == "-9223372036854775808");
+        TEST_COND_(std::string(formatted, json_format_int(formatted, 1234567)) == "1234567");
+        TEST_COND_(std::string(formatted, json_format_double(formatted, 0.1)) == "0.1");
+        TEST_COND_(std::string(formatted, json_format_double(formatted, 1e21)) == "1e+21");
+        TEST_COND_(std::string(formatted, json_format_double(formatted, 5e-324)) == "5e-324");
+        TEST_COND_(std::string(formatted, json_format_double(formatted, 0.000025)) == "0.000025");
+        TEST_COND_(std::string(formatted, json_format_str(formatted, "a \"quoted\"\n\x01 text", -1)) ==
+                   "\"a \\\"quoted\\\"\\n\\u0001 text\"");
+
+        // JSON writer
+        json_writer_t writer;
+        json_writer_init(&writer, formatted, sizeof(formatted));
+        json_writer_begin_object(&writer);
+        json_writer_key(&writer, "list");
+        json_writer_begin_array(&writer);
+        json_writer_value_int(&writer, 1);
+        json_writer_value_double(&writer, 2.5);
+        json_writer_begin_object(&writer);
+        json_writer_end_object(&writer);
+        json_writer_end_array(&writer);
+        json_writer_key(&writer, "ok");
+        json_writer_value_bool(&writer, 1);
+        json_writer_end_object(&writer);
+        TEST_COND_(!writer.overflow);
+        TEST_COND_(std::string(formatted) == "{\"list\": [1, 2.5, {}], \"ok\": true}");
+
+        json_writer_init(&writer, formatted, 8);
+        json_writer_value_str(&writer, "too long to fit", -1);
+        TEST_COND_(writer.overflow && formatted[0] == 0);
+
+        char deep_json[256]; // (up to 63 levels of nesting)
+        json_writer_init(&writer, deep_json, sizeof(deep_json));
+        for(int level = 0; level < 63; level++)
+        {
+            json_writer_begin_array(&writer);
+        }
+        TEST_COND_(!writer.overflow);
+        json_writer_begin_array(&writer);
+        TEST_COND_(writer.overflow);
+        json_writer_value_int(&writer, 1);
+        TEST_COND_(writer.overflow);
+
+        req_data.response_len = 96; // result that doesn't fit is replaced with an error
+        res_str = handle_request_for_example(11, req_data, rpc);
+        req_data.response_len = RESPONSE_BUF_MAX_LEN;
+        TEST_COND_(extract_int_param("code", extract_str_param("error", res_str)) == -32603);
+        TEST_COND_(extract_int_param("id", res_str) == 41);
+
+        // string views (escape sequences decoded only when needed)
+        std::string escaped = "{\"plain\": \"abc\", \"esc\": \"q\\\"t, \\u00e9\\ud83d\\ude00\\n\", \"next\": 5}";
+        json_str_view_t view;
+        int decoded_len = 0;
+        TEST_COND_(json_extract_member_view("plain", &view, escaped.c_str(), escaped.size()));
+        TEST_COND_(!view.has_escapes);
+        TEST_COND_(json_str_view_decode(&view, formatted, sizeof(formatted), &decoded_len) == view.start);
+        TEST_COND_(json_extract_member_view("esc", &view, escaped.c_str(), escaped.size()));
+        TEST_COND_(view.has_escapes);
+        const char* decoded = json_str_view_decode(&view, formatted, sizeof(formatted), &decoded_len);
+        TEST_COND_(decoded && std::string(decoded, decoded_len) == "q\"t, \xc3\xa9\xf0\x9f\x98\x80\n");
+        TEST_COND_(extract_int_param("next", escaped) == 5); // (escaped quote doesn't end the string)
+
+        // strict parsing: malformed requests are rejected (with 'Parse error') before any handler runs
+        TEST_COND_(json_validate(example_requests[8], strlen(example_requests[8])));
+        TEST_COND_(!json_validate(example_requests[7], strlen(example_requests[7]))); // "id": 37s
+        TEST_COND_(!json_validate("\"\xc0\x80\"", 4));                                 // overlong UTF-8
+        std::string nested_63 = std::string(63, '[') + std::string(63, ']');
+        std::string nested_64 = std::string(64, '[') + std::string(64, ']');
+        TEST_COND_(json_validate(nested_63.c_str(), nested_63.size()));
+        TEST_COND_(!json_validate(nested_64.c_str(), nested_64.size()));                // (nested too deep)
+        json_rpc_set_options(&rpc, json_rpc_option_strict_parsing);
+        res_str = handle_request_for_example(7, req_data, rpc);
+        TEST_COND_(extract_int_param("code", extract_str_param("error", res_str)) == -32700);
+        res_str = handle_request_for_example(8, req_data, rpc);
+        TEST_COND_(extract_int_param("res", res_str) == 160);
+        json_rpc_set_options(&rpc, 0);
+
+        // parse budgets: deep, wide or long requests are rejected (with 'Invalid Request') in one pass
+        json_parse_budget_t budget = {4, 8, 256, 0};
+        std::string deep = std::string(5, '[') + std::string(5, ']');
+        TEST_COND_(json_check_budget(deep.c_str(), deep.size(), &budget) == json_budget_depth_exceeded);
+        TEST_COND_(json_check_budget(deep.c_str() + 1, deep.size() - 2, &budget) == json_budget_ok);
+        TEST_COND_(json_check_budget("[1,2,3,4,5,6,7,8,9]", 19, &budget) == json_budget_members_exceeded);
+        TEST_COND_(json_check_budget("[[1,2,3,4],[5,6,7,8],\"9,,,,,,,,,\"]", 34, &budget) == json_budget_ok);
+        json_rpc_set_parse_budget(&rpc, &budget);
+        res_str = handle_request_for_example(8, req_data, rpc);
+        TEST_COND_(extract_int_param("res", res_str) == 160);
+        std::string deep_request = std::string("{\"jsonrpc\": \"2.0\", \"method\": \"calculate\", \"params\": ") +
+                                   deep + ", \"id\": 55}";
+        req_data.request = deep_request.c_str();
+        req_data.request_len = deep_request.size();
+        res_str = json_rpc_handle_request(&rpc, &req_data);
+        TEST_COND_(extract_int_param("code", extract_str_param("error", res_str)) == -32600);
+        std::string batch_of_three = std::string("[") + example_requests[8] + ", " + example_requests[9] + ", " +
+                                     example_requests[10] + "]";
+        req_data.request = batch_of_three.c_str();
+        req_data.request_len = batch_of_three.size();
+        res_str = json_rpc_handle_request(&rpc, &req_data);
+        TEST_COND_(extract_int_param("code", extract_str_param("error", res_str)) == -32600); // (over 256 bytes)
+        budget.max_bytes = 0;
+        budget.max_steps = 4; // (calculate needs 9: object, then first, second, op in it)
+        res_str = handle_request_for_example(8, req_data, rpc);
+        TEST_COND_(extract_int_param("code", extract_str_param("error", res_str)) == -32602);
+        json_rpc_set_parse_budget(&rpc, 0);
+
+        // requests without params are handled with empty params (not those of the previous one in a batch)
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"getTimeDate\", \"id\": 55}";
+        req_data.request_len = strlen(req_data.request);
+        res_str = json_rpc_handle_request(&rpc, &req_data);
+        TEST_COND_(extract_str_param("result", res_str).size() > 0 && extract_str_param("error", res_str).empty());
+        std::string batch_without_params = std::string("[") + example_requests[8] +
+                                           ", {\"jsonrpc\": \"2.0\", \"method\": \"calculate\", \"id\": 56}]";
+        req_data.request = batch_without_params.c_str();
+        req_data.request_len = batch_without_params.size();
+        res_str = json_rpc_handle_request(&rpc, &req_data);
+        TEST_COND_(extract_int_param("code", extract_str_param("error", extract_str_param(1, res_str))) == -32602);
+
+        // offsets are not limited to 32kB
+        std::string long_request = std::string("{\"jsonrpc\": \"2.0\", \"pad\": \"") + std::string(40000, 'x') +
+                                   "\", \"method\": \"calculate\", \"params\": [{\"first\": 1, \"second\": 2, "
+                                   "\"op\": \"+\"}], \"id\": 57}";
+        req_data.request = long_request.c_str();
+        req_data.request_len = long_request.size();
+        res_str = json_rpc_handle_request(&rpc, &req_data);
+        TEST_COND_(extract_int_param("res", res_str) == 3 && extract_int_param("id", res_str) == 57);
+
+        // stats
+        json_rpc_method_stats_t stats[MAX_NUM_OF_HANDLERS + 1];
+        json_rpc_method_stats_t snapshot[MAX_NUM_OF_HANDLERS + 1];
+        json_rpc_enable_stats(&rpc, stats, MAX_NUM_OF_HANDLERS + 1, test_clock);
+        handle_request_for_example(8, req_data, rpc);  // calculate
+        handle_request_for_example(3, req_data, rpc);  // search: invalid params
+        handle_request_for_example(1, req_data, rpc);  // method not found
+        json_rpc_stats_snapshot(snapshot, stats, MAX_NUM_OF_HANDLERS + 1);
+        json_rpc_enable_stats(&rpc, 0, 0, 0);
+        TEST_COND_(snapshot[5].calls == 1 && snapshot[5].parse_time == 10 && snapshot[5].handler_time == 10);
+        TEST_COND_(json_rpc_stats_percentile(&snapshot[5], 990) == 20);
+        TEST_COND_(snapshot[2].errors[json_rpc_err_invalid_params] == 1);
+        TEST_COND_(snapshot[MAX_NUM_OF_HANDLERS].errors[json_rpc_err_method_not_found] == 1);
+        TEST_COND_(json_rpc_latency_bucket_min(json_rpc_latency_bucket(1000)) == 896); // (896..1023 bucket)
+
+        // paths: nested values are found in one walk (members not on the path are not looked into)
+        std::string nested = "{\"filter\": {\"name\": {\"min\": 1}, \"range\": [{\"min\": 0}, [5], {}, "
+                             "{\"min\": 42, \"max\": \"50\"}]}, \"a/b\": \"slash\", \"esc\": \"x\\ny\"}";
+        json_path_t path;
+        int path_value_len = 0;
+        const char* path_value = 0;
+        TEST_COND_(json_path_compile(&path, "/filter/range/3/min") && path.num_of_segments == 4);
+        TEST_COND_(path.segments[2].index == 3 && path.segments[3].index == -1);
+        path_value = json_extract_path_str(&path, &path_value_len, nested.c_str(), nested.size());
+        TEST_COND_(path_value && std::string(path_value, path_value_len) == "42");
+        json_path_compile(&path, "filter.range[3].max");
+        path_value = json_extract_path_str(&path, &path_value_len, nested.c_str(), nested.size());
+        TEST_COND_(path_value && std::string(path_value, path_value_len) == "50");
+        json_path_compile(&path, "/filter/range/1/0");
+        path_value = json_extract_path_str(&path, &path_value_len, nested.c_str(), nested.size());
+        TEST_COND_(path_value && std::string(path_value, path_value_len) == "5");
+        json_path_compile(&path, "/a~1b");
+        path_value = json_extract_path_str(&path, &path_value_len, nested.c_str(), nested.size());
+        TEST_COND_(path_value && std::string(path_value, path_value_len) == "slash");
+        json_path_compile(&path, "/filter/min"); // (only at this depth, unlike json_extract_member_str())
+        TEST_COND_(!json_extract_path_str(&path, &path_value_len, nested.c_str(), nested.size()) && !path_value_len);
+        json_path_compile(&path, "/filter/range/4");
+        TEST_COND_(!json_extract_path_str(&path, &path_value_len, nested.c_str(), nested.size()));
+        json_path_compile(&path, "/filter/range/01");
+        TEST_COND_(!json_extract_path_str(&path, &path_value_len, nested.c_str(), nested.size()));
+        json_path_compile(&path, "esc");
+        TEST_COND_(json_extract_path_view(&path, &view, nested.c_str(), nested.size()) && view.has_escapes);
+        json_path_compile(&path, "");
+        TEST_COND_(json_extract_path_view(&path, &view, nested.c_str(), nested.size()) && view.len == (int)nested.size());
+        TEST_COND_(!json_path_compile(&path, "/a~2") && !json_path_compile(&path, "a.b.c.d.e.f.g.h.i.j.k.l.m.n.o.p.q"));
+
+        std::string path_request = "{\"jsonrpc\": \"2.0\", \"method\": \"ingest\", \"params\": [" + nested + "], \"id\": 1}";
+        rpc_request_info_t path_info;
+        req_data.request = path_request.c_str();
+        req_data.request_len = path_request.size();
+        path_info.data = &req_data;
+        path_info.params_start = path_request.find('[');
+        path_info.params_len = nested.size() + 2;
+        path_info.steps_left = -1;
+        int path_int = 0;
+        TEST_COND_(rpc_extract_param_path_int("filter.range[3].max", &path_int, &path_info) && path_int == 50);
+        TEST_COND_(rpc_extract_param_path_int("/0/filter/name/min", &path_int, &path_info) && path_int == 1);
+        json_path_compile(&path, "/filter/range/3/min");
+        path_info.steps_left = 5; // (filter, name, range, 0, 1, 2, 3 would be needed)
+        TEST_COND_(!rpc_extract_param_path_int(&path, &path_int, &path_info));
+
+        // set of paths: values of all of them are extracted in one pass (into path_slots)
+        json_path_node_t path_nodes[16];
+        json_path_set_t path_set;
+        json_str_view_t path_slots[6];
+        json_path_set_init(&path_set, path_nodes, 16);
+        TEST_COND_(json_path_set_add(&path_set, "/filter/range/3/min") == 0);
+        TEST_COND_(json_path_set_add(&path_set, "filter.range[3].max") == 1);
+        TEST_COND_(json_path_set_add(&path_set, "/filter/name") == 2);
+        TEST_COND_(json_path_set_add(&path_set, "/esc") == 3);
+        TEST_COND_(json_path_set_add(&path_set, "/missing/value") == 4);
+        TEST_COND_(json_path_set_add(&path_set, "/filter/range/3/min") == 0); // (the same path)
+        TEST_COND_(path_set.num_of_paths == 5 && path_set.num_of_nodes == 10);
+        TEST_COND_(json_path_set_add(&path_set, "/a_name_that_is_longer_than_a_node_can_keep") == -1);
+        TEST_COND_(json_extract_paths(&path_set, path_slots, nested.c_str(), nested.size()) == 4);
+        TEST_COND_(json_str_view_to_int(&path_slots[0], &path_int) && path_int == 42);
+        TEST_COND_(json_str_view_to_int(&path_slots[1], &path_int) && path_int == 50);
+        TEST_COND_(std::string(path_slots[2].start, path_slots[2].len) == "{\"min\": 1}");
+        TEST_COND_(path_slots[3].has_escapes && path_slots[3].len == 4 && !path_slots[4].start && !path_slots[4].len);
+        path_info.steps_left = -1;
+        TEST_COND_(rpc_extract_param_paths(&path_set, path_slots, &path_info) == 4); // (params: [{...}])
+        TEST_COND_(json_str_view_to_int(&path_slots[0], &path_int) && path_int == 42);
+        json_path_set_init(&path_set, path_nodes, 4);
+        TEST_COND_(json_path_set_add(&path_set, "/a/b/c") == 0 && json_path_set_add(&path_set, "/a/b/c/d") == -1);
+
+        // params schema: params are validated / extracted before the handler is called
+        res_str = handle_request_for_example(17, req_data, rpc);
+        TEST_COND_(extract_str_param("who", res_str) == "Brian");
+        TEST_COND_(extract_str_param("adult", res_str) == "true" && extract_str_param("admin", res_str) == "false");
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"describe\", "
+                           "\"params\": [{\"name\": \"Tim\", \"admin\": true, \"age\": 9}], \"id\": 47}";
+        req_data.request_len = strlen(req_data.request);
+        res_str = json_rpc_handle_request(&rpc, &req_data);
+        TEST_COND_(extract_str_param("adult", res_str) == "false" && extract_str_param("admin", res_str) == "true");
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"describe\", \"params\": [{\"name\": \"Tim\"}], \"id\": 48}";
+        req_data.request_len = strlen(req_data.request);
+        res_str = json_rpc_handle_request(&rpc, &req_data); // (missing required param)
+        TEST_COND_(extract_int_param("code", extract_str_param("error", res_str)) == -32602);
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"describe\", "
+                           "\"params\": [{\"name\": 5, \"age\": 9}], \"id\": 49}";
+        req_data.request_len = strlen(req_data.request);
+        res_str = json_rpc_handle_request(&rpc, &req_data); // (not a string)
+        TEST_COND_(extract_int_param("code", extract_str_param("error", res_str)) == -32602);
+
+        // typed handlers
+        res_str = handle_request_for_example(18, req_data, rpc);
+        TEST_COND_(extract_int_param("result", res_str) == 13);
+        res_str = handle_request_for_example(19, req_data, rpc);
+        TEST_COND_(extract_str_param("result", res_str) == "Monty");
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"typed_search\", "
+                           "\"params\": {\"age\": 3, \"last_name\": \"Pyth\\u006fn\"}, \"id\": 49}";
+        req_data.request_len = strlen(req_data.request);
+        res_str = json_rpc_handle_request(&rpc, &req_data); // (escaped name is decoded)
+        TEST_COND_(extract_str_param("result", res_str) == "nobody" && extract_int_param("id", res_str) == 49);
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"add\", \"params\": [1, \"2\"], \"id\": 50}";
+        req_data.request_len = strlen(req_data.request);
+        res_str = json_rpc_handle_request(&rpc, &req_data);
+        TEST_COND_(extract_int_param("code", extract_str_param("error", res_str)) == -32602);
+        json_rpc_handler_t typed_handlers[3];
+        json_rpc_instance_t typed_rpc;
+        json_rpc_init(&typed_rpc, typed_handlers, 3);
+        json_rpc_register_typed<typed_reset>(&typed_rpc, "reset");
+        json_rpc_register_typed<typed_square>(&typed_rpc, "square");
+        json_rpc_register_typed<typed_add64>(&typed_rpc, "add64");
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"reset\", \"params\": [], \"id\": 51}";
+        req_data.request_len = strlen(req_data.request);
+        res_str = json_rpc_handle_request(&typed_rpc, &req_data); // (void: result is null)
+        TEST_COND_(typed_resets == 1 && strstr(res_str, "\"result\": null"));
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"square\", \"params\": [255], \"id\": 52}";
+        req_data.request_len = strlen(req_data.request);
+        res_str = json_rpc_handle_request(&typed_rpc, &req_data);
+        TEST_COND_(extract_int_param("result", res_str) == 65025);
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"square\", \"params\": [256], \"id\": 53}";
+        req_data.request_len = strlen(req_data.request);
+        res_str = json_rpc_handle_request(&typed_rpc, &req_data); // (doesn't fit in uint8_t)
+        TEST_COND_(extract_int_param("code", extract_str_param("error", res_str)) == -32602);
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"square\", \"params\": [-1], \"id\": 54}";
+        req_data.request_len = strlen(req_data.request);
+        res_str = json_rpc_handle_request(&typed_rpc, &req_data);
+        TEST_COND_(extract_int_param("code", extract_str_param("error", res_str)) == -32602);
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"add64\", \"params\": [4294967297, 1], \"id\": 55}";
+        req_data.request_len = strlen(req_data.request);
+        res_str = json_rpc_handle_request(&typed_rpc, &req_data); // (int64_t: not truncated to int)
+        TEST_COND_(strstr(res_str, "\"result\": 4294967298"));
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"add64\", \"params\": [1, 3000000000], \"id\": 56}";
+        req_data.request_len = strlen(req_data.request);
+        res_str = json_rpc_handle_request(&typed_rpc, &req_data); // (doesn't fit in int)
+        TEST_COND_(extract_int_param("code", extract_str_param("error", res_str)) == -32602);
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"add64\", \"params\": [-9223372036854775808, 0], \"id\": 57}";
+        req_data.request_len = strlen(req_data.request);
+        res_str = json_rpc_handle_request(&typed_rpc, &req_data);
+        TEST_COND_(strstr(res_str, "\"result\": -9223372036854775808"));
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"add64\", \"params\": [9223372036854775808, 0], \"id\": 58}";
+        req_data.request_len = strlen(req_data.request);
+        res_str = json_rpc_handle_request(&typed_rpc, &req_data); // (doesn't fit in int64_t)
+        TEST_COND_(extract_int_param("code", extract_str_param("error", res_str)) == -32602);
+        json_str_view_t overflowing_view = {"3000000000", 10, 0};
+        int overflowing_int = 0;
+        TEST_COND_(!json_str_view_to_int(&overflowing_view, &overflowing_int));
+
+        // limits: calls over the rate limit (1 per second, in bursts of 2) are rejected with 'Server busy'
+        json_rpc_limit_t limit;
+        json_rpc_limit_init(&limit, 4, 1, 2, manual_clock, 1000);
+        TEST_COND_(json_rpc_set_limit(&rpc, "calculate", &limit));
+        handle_request_for_example(8, req_data, rpc);
+        res_str = handle_request_for_example(8, req_data, rpc);
+        TEST_COND_(extract_int_param("res", res_str) == 160);
+        res_str = handle_request_for_example(8, req_data, rpc);
+        TEST_COND_(extract_int_param("code", extract_str_param("error", res_str)) == -32000);
+        manual_time += 1500;
+        res_str = handle_request_for_example(8, req_data, rpc);
+        TEST_COND_(extract_int_param("res", res_str) == 160 && limit.in_flight == 0);
+        json_rpc_set_limit(&rpc, "calculate", 0);
+
+        // handler registry: handlers can be replaced (published) while instances are in use
+        json_rpc_handler_t staged_handlers[2][2];
+        json_rpc_instance_t staged[2];
+        json_rpc_registry_t registry;
+        json_rpc_init(&staged[0], staged_handlers[0], 2);
+        json_rpc_register_handler(&staged[0], "calculate", calculate);
+        json_rpc_registry_init(&registry, &staged[0]);
+        json_rpc_enable_registry(&rpc, &registry);
+        res_str = handle_request_for_example(8, req_data, rpc);
+        TEST_COND_(extract_int_param("res", res_str) == 160);
+        res_str = handle_request_for_example(2, req_data, rpc); // (search is not published)
+        TEST_COND_(extract_int_param("code", extract_str_param("error", res_str)) == -32601);
+        json_rpc_init(&staged[1], staged_handlers[1], 2);
+        json_rpc_register_handler(&staged[1], "search", search);
+        TEST_COND_(json_rpc_registry_publish(&registry, &staged[1]) == &staged[0]);
+        res_str = handle_request_for_example(2, req_data, rpc);
+        TEST_COND_(extract_str_param("result", res_str) == "Monty");
+        res_str = handle_request_for_example(8, req_data, rpc);
+        TEST_COND_(extract_int_param("code", extract_str_param("error", res_str)) == -32601);
+        json_rpc_register_typed<typed_reload>(&staged[1], "reload"); // (handlers are published from a handler)
+        reload_self = &rpc;
+        reload_handlers = &staged[0];
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"reload\", \"params\": [], \"id\": 60}";
+        req_data.request_len = strlen(req_data.request);
+        res_str = json_rpc_handle_request(&rpc, &req_data);
+        TEST_COND_(reload_previous == &staged[1] && strstr(res_str, "\"result\": null"));
+        res_str = handle_request_for_example(8, req_data, rpc);
+        TEST_COND_(extract_int_param("res", res_str) == 160);
+        TEST_COND_(rpc.registry_reader.active == 0 && registry.readers == &rpc.registry_reader);
+        json_rpc_enable_registry(&rpc, 0);
+        TEST_COND_(registry.readers == 0);
+
+        // handlers are published while other threads handle requests (each uses the handlers it saw)
+        json_rpc_handler_t reader_handlers[2][1];
+        json_rpc_instance_t reader_rpc[2];
+        std::thread reader_threads[2];
+        int reader_unexpected[2] = {0, 0};
+        std::atomic<bool> readers_done(false);
+        for(int t = 0; t < 2; t++)
+        {
+            json_rpc_init(&reader_rpc[t], reader_handlers[t], 1);
+            json_rpc_enable_registry(&reader_rpc[t], &registry);
+            reader_threads[t] = std::thread([&reader_rpc, &reader_unexpected, &readers_done, t]()
+            {
+                char response[256];
+                while(!readers_done)
+                {
+                    json_rpc_data_t data = {example_requests[8], response, (int)strlen(example_requests[8]),
+                                            (int)sizeof(response), 0};
+                    std::string res = json_rpc_handle_request(&reader_rpc[t], &data);
+                    if(res.find("160") == std::string::npos && res.find("-32601") == std::string::npos)
+                    {
+                        reader_unexpected[t]++;
+                    }
+                }
+            });
+        }
+        for(int i = 0; i < 200; i++)
+        {
+            json_rpc_registry_publish(&registry, &staged[i & 1]);
+        }
+        readers_done = true;
+        for(int t = 0; t < 2; t++)
+        {
+            reader_threads[t].join();
+            TEST_COND_(reader_unexpected[t] == 0 && reader_rpc[t].registry_reader.active == 0);
+            json_rpc_enable_registry(&reader_rpc[t], 0);
+        }
+        TEST_COND_(registry.readers == 0);
+
+        // priorities: a batch can be reordered (high priority first), responses are in the same order
+        json_rpc_handler_t prioritised_handlers[3];
+        json_rpc_instance_t prioritised_rpc;
+        json_rpc_init(&prioritised_rpc, prioritised_handlers, 3);
+        json_rpc_register_handler(&prioritised_rpc, "calculate", calculate, json_rpc_handler_priority_low);
+        json_rpc_register_handler(&prioritised_rpc, "health", getTimeDate, json_rpc_handler_priority_high);
+        json_rpc_register_handler(&prioritised_rpc, "search", search);
+        json_rpc_set_options(&prioritised_rpc, json_rpc_option_reorder_batch);
+        const char* batch = "[{\"jsonrpc\": \"2.0\", \"method\": \"calculate\", "
+                            "\"params\": [{\"first\":1,\"second\":2,\"op\":\"+\"}], \"id\": 1}, "
+                            "{\"jsonrpc\": \"2.0\", \"method\": \"search\", \"params\": {\"last_name\": \"Python\"}, \"id\": 2}, "
+                            "{\"jsonrpc\": \"2.0\", \"method\": \"health\", \"id\": 3}]";
+        req_data.request = batch;
+        req_data.request_len = strlen(batch);
+        res_str = json_rpc_handle_request(&prioritised_rpc, &req_data);
+        TEST_COND_(json_validate(res_str, strlen(res_str)));
+        TEST_COND_(extract_int_param("id", extract_str_param(0, res_str)) == 3);
+        TEST_COND_(extract_int_param("id", extract_str_param(1, res_str)) == 2);
+        TEST_COND_(extract_int_param("id", extract_str_param(2, res_str)) == 1);
+        TEST_COND_(extract_int_param("res", extract_str_param(2, res_str)) == 3);
+#ifdef JSON_RPC_TINY_TRACE
+        json_rpc_trace_t batch_trace;
+        json_rpc_trace_event_t batch_events[64];
+        json_rpc_enable_trace(&prioritised_rpc, &batch_trace, batch_events, 64);
+        json_rpc_handle_request(&prioritised_rpc, &req_data);
+        json_rpc_enable_trace(&prioritised_rpc, 0, 0, 0);
+        int parse_starts = 0;
+        int parse_ends = 0;
+        for(uint64_t e = 0; e < batch_trace.head; e++) // (requests are traced once, in their pass)
+        {
+            parse_starts += batch_events[e].event == json_rpc_trace_parse_start;
+            parse_ends += batch_events[e].event == json_rpc_trace_parse_end;
+        }
+        TEST_COND_(parse_starts == 3 && parse_ends == 3);
+#endif
+
+        // priorities: scheduled requests are taken by priority, but lower ones are not starved
+        json_rpc_scheduler_t scheduler;
+        json_rpc_queue_slot_t slots[json_rpc_num_of_priorities * 4];
+        json_rpc_data_t queued[6];
+        const char* queued_requests[] = {
+            "{\"jsonrpc\": \"2.0\", \"method\": \"calculate\", \"id\": 1}",
+            "{\"jsonrpc\": \"2.0\", \"method\": \"search\", \"id\": 2}",
+            "{\"jsonrpc\": \"2.0\", \"method\": \"health\", \"id\": 3}",
+            "{\"jsonrpc\": \"2.0\", \"method\": \"health\", \"id\": 4}",
+            "{\"jsonrpc\": \"2.0\", \"method\": \"health\", \"id\": 5}",
+            "[{\"jsonrpc\": \"2.0\", \"method\": \"health\", \"id\": 6}, {\"method\": \"calculate\", \"id\": 7}]"
+        };
+        TEST_COND_(!json_rpc_scheduler_init(&scheduler, slots, 3, 2)); // (not a power of 2)
+        TEST_COND_(json_rpc_scheduler_init(&scheduler, slots, 4, 2));
+        for(int i = 0; i < 6; i++)
+        {
+            queued[i].request = queued_requests[i];
+            queued[i].request_len = strlen(queued_requests[i]);
+            TEST_COND_(json_rpc_schedule(&scheduler, &prioritised_rpc, &queued[i]));
+        }
+        TEST_COND_(json_rpc_scheduler_next(&scheduler) == &queued[2]);
+        TEST_COND_(json_rpc_scheduler_next(&scheduler) == &queued[3]);
+        TEST_COND_(json_rpc_scheduler_next(&scheduler) == &queued[0]); // (passed over twice)
+        TEST_COND_(json_rpc_scheduler_next(&scheduler) == &queued[1]); // (passed over twice)
+        TEST_COND_(json_rpc_scheduler_next(&scheduler) == &queued[4]);
+        TEST_COND_(json_rpc_scheduler_next(&scheduler) == &queued[5]); // (batch with a low priority request)
+        TEST_COND_(json_rpc_scheduler_next(&scheduler) == 0);
+        for(int i = 0; i < 5; i++)
+        {
+            TEST_COND_(json_rpc_schedule(&scheduler, &prioritised_rpc, &queued[2]) == (i < 4));
+        }
+
+        // MessagePack: requests (detected from the first byte) are handled by the same handlers
+        // (response buffer has to have space for both request and response as JSON)
+        char packed[512];
+        char unpacked[512];
+        char packed_response[1024];
+        json_rpc_data_t packed_data;
+        packed_data.response = packed_response;
+        packed_data.response_len = sizeof(packed_response);
+        packed_data.arg = 0;
+        std::string batch_of_two = std::string("[") + example_requests[8] + ", " + example_requests[9] + "]";
+        int packed_len = json_to_msgpack(batch_of_two.c_str(), batch_of_two.size(), packed, sizeof(packed));
+        TEST_COND_(packed_len > 0 && packed_len < (int)batch_of_two.size() && json_is_msgpack(packed, packed_len));
+        packed_data.request = packed;
+        packed_data.request_len = packed_len;
+        json_rpc_handle_request(&rpc, &packed_data);
+        TEST_COND_(json_from_msgpack(packed_data.response, json_rpc_response_len(&packed_data), unpacked, sizeof(unpacked)) > 0);
+        TEST_COND_(extract_int_param("res", extract_str_param(0, unpacked)) == 160);
+        TEST_COND_(extract_int_param("id", extract_str_param(1, unpacked)) == 39);
+        packed_data.request_len = json_to_msgpack(example_requests[2], strlen(example_requests[2]), packed, sizeof(packed));
+        json_rpc_handle_request(&rpc, &packed_data);
+        json_from_msgpack(packed_data.response, json_rpc_response_len(&packed_data), unpacked, sizeof(unpacked));
+        TEST_COND_(extract_str_param("result", unpacked) == "Monty" && extract_str_param("error", unpacked) == "null");
+        packed[0] = (char)0x8f; // (a map with more members than there are)
+        json_rpc_handle_request(&rpc, &packed_data);
+        json_from_msgpack(packed_data.response, json_rpc_response_len(&packed_data), unpacked, sizeof(unpacked));
+        TEST_COND_(extract_int_param("code", extract_str_param("error", unpacked)) == -32700);
+        const char* str_id_requests[] = {"{\"method\": \"search\", \"params\": [{\"last_name\": \"Python\", \"age\": 26}], \"id\": \"x\"}",
+                                         "[{\"jsonrpc\": \"2.0\", \"method\": \"none\", \"id\": \"a b\"}, "
+                                         "{\"jsonrpc\": \"2.0\", \"method\": \"calculate\", \"params\": [{\"first\": 128, \"second\": 32, \"op\": \"+\"}], \"id\": 7}]"};
+        packed_data.request_len = json_to_msgpack(str_id_requests[0], strlen(str_id_requests[0]), packed, sizeof(packed));
+        json_rpc_handle_request(&rpc, &packed_data); // (string ids are strings in the response)
+        TEST_COND_(json_from_msgpack(packed_data.response, json_rpc_response_len(&packed_data), unpacked, sizeof(unpacked)) > 0);
+        TEST_COND_(extract_str_param("result", unpacked) == "Monty" && strstr(unpacked, "\"id\":\"x\""));
+        packed_data.request_len = json_to_msgpack(str_id_requests[1], strlen(str_id_requests[1]), packed, sizeof(packed));
+        json_rpc_handle_request(&rpc, &packed_data);
+        TEST_COND_(json_from_msgpack(packed_data.response, json_rpc_response_len(&packed_data), unpacked, sizeof(unpacked)) > 0);
+        TEST_COND_(extract_int_param("code", extract_str_param("error", extract_str_param(0, unpacked))) == -32601);
+        TEST_COND_(strstr(unpacked, "\"id\":\"a b\"") && extract_int_param("id", extract_str_param(1, unpacked)) == 7);
+
+        // doubles written by json_format_double() are packed back to exactly the same value
+        uint64_t random_bits = 88172645463325252ULL;
+        const char* edge_doubles[] = {"903.6040261939943", "1.7976931348623157e308", "5e-324", "2.2250738585072014e-308",
+                                      "2.225073858507201e-308", "1e23", "0.1", "9007199254740993.0", "1.7976931348623159e308"};
+        const uint64_t edge_bits[] = {0x408c3cd50baf6910ULL, 0x7fefffffffffffffULL, 1, 0x0010000000000000ULL,
+                                      0x000fffffffffffffULL, 0x44b52d02c7e14af6ULL, 0x3fb999999999999aULL,
+                                      0x4340000000000000ULL, 0x7ff0000000000000ULL};
+        int round_trip_errors = 0;
+        for(int i = 0; i < 20000 + 9; i++)
+        {
+            union { double d; uint64_t u; } value;
+            char number[40];
+            if(i < 9)
+            {
+                strcpy(number, edge_doubles[i]);
+                value.u = edge_bits[i];
+            }
+            else
+            {
+                random_bits ^= random_bits << 13;
+                random_bits ^= random_bits >> 7;
+                random_bits ^= random_bits << 17;
+                value.u = (i % 2) ? random_bits : 0;
+                value.d = (i % 2) ? value.d : (random_bits >> 11) * (1000.0 / (1ULL << 53));
+                if((value.u >> 52 & 0x7ff) == 0x7ff)
+                {
+                    continue; // (not a number / infinity)
+                }
+                *json_format_double(number, value.d) = 0;
+                if(!strpbrk(number, ".eE"))
+                {
+                    continue; // (integral text, packed as an integer)
+                }
+            }
+            unsigned char packed_double[16];
+            if(json_to_msgpack(number, strlen(number), (char*)packed_double, sizeof(packed_double)) != 9 ||
+               packed_double[0] != 0xcb)
+            {
+                round_trip_errors++;
+                continue;
+            }
+            uint64_t unpacked_bits = 0;
+            for(int b = 1; b < 9; b++)
+            {
+                unpacked_bits = (unpacked_bits << 8) | packed_double[b];
+            }
+            round_trip_errors += (unpacked_bits != value.u);
+        }
+        TEST_COND_(round_trip_errors == 0);
+
+        // request log: lines are processed in parallel, in chunks split at line ends
+        const char* log_name = "z_example_log.ndjson";
+        FILE* log_file = fopen(log_name, "w");
+        TEST_COND_(log_file);
+        for(int i = 0; i < 100; i++)
+        {
+            fprintf(log_file, "%s\n", example_requests[(i % 4) ? 8 : 2]);
+        }
+        fprintf(log_file, "[%s, %s]\r\n", example_requests[8], example_requests[9]); // (a batch)
+        fclose(log_file);
+
+        json_rpc_log_t log;
+        json_rpc_log_chunk_t chunks[3];
+        TEST_COND_(json_rpc_log_open(&log, log_name));
+        json_rpc_log_split(&log, chunks, 3);
+        TEST_COND_(chunks[0].start[chunks[0].len - 1] == '\n' && chunks[1].start[chunks[1].len - 1] == '\n');
+        TEST_COND_(chunks[0].len + chunks[1].len + chunks[2].len == log.len);
+
+        json_rpc_log_count_t counts[2];
+        uint64_t calls[2][MAX_NUM_OF_HANDLERS] = {};
+        void* count_args[2] = {&counts[0], &counts[1]};
+        for(int i = 0; i < 2; i++)
+        {
+            counts[i].rpc = &rpc;
+            counts[i].calls = calls[i];
+            counts[i].unknown = 0;
+            counts[i].requests = 0;
+        }
+        TEST_COND_(json_rpc_log_process(&log, 2, json_rpc_log_count_line, count_args));
+        TEST_COND_(counts[0].requests + counts[1].requests == 102 && counts[0].unknown + counts[1].unknown == 0);
+        TEST_COND_(calls[0][2] + calls[1][2] == 25 && calls[0][5] + calls[1][5] == 77); // (search, calculate)
+
+        json_rpc_log_replay_t replay[2];
+        char replay_responses[2][RESPONSE_BUF_MAX_LEN];
+        void* replay_args[2] = {&replay[0], &replay[1]};
+        for(int i = 0; i < 2; i++)
+        {
+            replay[i].rpc = &rpc;
+            replay[i].response = replay_responses[i];
+            replay[i].response_len = RESPONSE_BUF_MAX_LEN;
+            replay[i].arg = 0;
+            replay[i].requests = replay[i].request_bytes = replay[i].response_bytes = 0;
+        }
+        TEST_COND_(json_rpc_log_process(&log, 2, json_rpc_log_replay_line, replay_args));
+        TEST_COND_(replay[0].requests + replay[1].requests == 101 && replay[1].response_bytes > 0);
+        TEST_COND_(extract_int_param("id", extract_str_param(1, replay_responses[1])) == 39); // (the batch is last)
+        json_rpc_log_close(&log);
+        remove(log_name);
+
+        // lines of a log are not null-terminated: nothing is read past their end
+        const char* unterminated_inputs[] = {"{\"method\": \"calculate\", \"params\": [{\"first\": 128, \"second\": 32, \"op\": \"+\"}], \"id\": 38}  ",
+                                             "\"method\"", "{\"method\": \"search\", \"id"};
+        std::vector<char> unterminated(unterminated_inputs[0], unterminated_inputs[0] + strlen(unterminated_inputs[0]));
+        req_data.request = unterminated.data();
+        req_data.request_len = unterminated.size();
+        res_str = json_rpc_handle_request(&rpc, &req_data);
+        TEST_COND_(extract_int_param("res", res_str) == 160);
+        json_token_info_t unterminated_token;
+        for(int i = 1; i < 3; i++)
+        {
+            unterminated.assign(unterminated_inputs[i], unterminated_inputs[i] + strlen(unterminated_inputs[i]));
+            json_find_next_member(0, unterminated.data(), unterminated.size(), &unterminated_token);
+            TEST_COND_(unterminated_token.values_start + unterminated_token.values_len <= (int)unterminated.size());
+            json_rpc_log_count_line(unterminated.data(), unterminated.size(), &counts[0]);
+        }
+
+        // shared-memory ring: requests are handled in place by a server thread (or process), responses are read from the slot
+        json_rpc_shm_t shm;
+        char shm_response[RESPONSE_BUF_MAX_LEN];
+        uint32_t tickets[4];
+        int shm_max_len = 0;
+        TEST_COND_(json_rpc_shm_create(&shm, 3, 256, RESPONSE_BUF_MAX_LEN) && shm.header->num_of_slots == 4);
+        for(int i = 0; i < 4; i++)
+        {
+            char* shm_request = json_rpc_shm_request_begin(&shm, &shm_max_len, &tickets[i]);
+            TEST_COND_(shm_request && shm_max_len == 255 && tickets[i] == (uint32_t)i);
+            strcpy(shm_request, example_requests[8 + (i % 2)]);
+            TEST_COND_(json_rpc_shm_request_end(&shm, tickets[i], strlen(example_requests[8 + (i % 2)])));
+        }
+        TEST_COND_(!json_rpc_shm_request_begin(&shm, &shm_max_len, &tickets[0])); // (ring is full)
+        TEST_COND_(json_rpc_shm_poll(&shm, &rpc, 0) == 4 && json_rpc_shm_poll(&shm, &rpc, 0) == 0);
+        for(int i = 0; i < 4; i++)
+        {
+            int len = 0;
+            const char* shm_result = json_rpc_shm_response_wait(&shm, tickets[i], &len);
+            TEST_COND_(shm_result && len > 0 && extract_int_param("id", std::string(shm_result, len)) == 38 + (i % 2));
+            TEST_COND_(json_rpc_shm_release(&shm, tickets[i]));
+        }
+        json_rpc_shm_t shm_client;
+        TEST_COND_(json_rpc_shm_attach(&shm_client, dup(shm.fd)) && shm_client.header->num_of_slots == 4);
+        json_rpc_shm_close(&shm_client);
+        shm.header->num_of_slots = 3; // (header is checked when attached)
+        TEST_COND_(!json_rpc_shm_attach(&shm_client, dup(shm.fd)));
+        shm.header->num_of_slots = 4;
+        shm.header->slot_size = 256;
+        TEST_COND_(!json_rpc_shm_attach(&shm_client, dup(shm.fd)));
+        shm.header->slot_size = (sizeof(json_rpc_shm_slot_t) + 256 + RESPONSE_BUF_MAX_LEN + 63) & ~63u;
+
+        shm.claim_timeout_ms = 100;
+        std::thread shm_server(json_rpc_shm_serve, &shm, &rpc, (void*)0);
+        for(int i = 0; i < 10; i++)
+        {
+            int len = json_rpc_shm_call(&shm, example_requests[8], strlen(example_requests[8]), shm_response,
+                                        sizeof(shm_response));
+            TEST_COND_(len > 0 && extract_int_param("res", extract_str_param("result", shm_response)) == 160);
+        }
+        TEST_COND_(json_rpc_shm_call(&shm, example_requests[8], strlen(example_requests[8]), shm_response, 8) == -1);
+        uint32_t abandoned_ticket = 0; // (claimed by a client that dies before passing its request)
+        TEST_COND_(json_rpc_shm_request_begin(&shm, &shm_max_len, &abandoned_ticket));
+        int shm_len = json_rpc_shm_call(&shm, example_requests[8], strlen(example_requests[8]), shm_response,
+                                        sizeof(shm_response));
+        TEST_COND_(shm_len > 0 && extract_int_param("res", extract_str_param("result", shm_response)) == 160);
+        TEST_COND_(!json_rpc_shm_request_end(&shm, abandoned_ticket, 0)); // (slot was skipped)
+        shm.release_timeout_ms = 100; // (a client that doesn't release its slot doesn't block the ring)
+        uint32_t unreleased_ticket = 0;
+        char* unreleased_request = json_rpc_shm_request_begin(&shm, &shm_max_len, &unreleased_ticket);
+        TEST_COND_(unreleased_request);
+        strcpy(unreleased_request, example_requests[8]);
+        TEST_COND_(json_rpc_shm_request_end(&shm, unreleased_ticket, strlen(example_requests[8])));
+        TEST_COND_(json_rpc_shm_response_wait(&shm, unreleased_ticket, &shm_len));
+        int shm_failed_calls = 0;
+        for(int i = 0; i < 8; i++) // (ring wraps to the unreleased slot)
+        {
+            while((shm_len = json_rpc_shm_call(&shm, example_requests[8], strlen(example_requests[8]), shm_response,
+                                               sizeof(shm_response))) < 0 && shm_failed_calls < 100)
+            {
+                shm_failed_calls++;
+                usleep(10000);
+            }
+            TEST_COND_(shm_len > 0 && extract_int_param("res", extract_str_param("result", shm_response)) == 160);
+        }
+        TEST_COND_(shm_failed_calls > 0 && !json_rpc_shm_release(&shm, unreleased_ticket)); // (slot was reclaimed)
+        json_rpc_shm_stop(&shm);
+        shm_server.join();
+        json_rpc_shm_close(&shm);
+
+        // HTTP: requests are parsed in place (pipelined ones one after another), chunked bodies are joined in place
+        std::string http_input = std::string("POST /rpc HTTP/1.1\r\nHost: localhost\r\nContent-Length: ") +
+                                 std::to_string(strlen(example_requests[8])) + "\r\n\r\n" + example_requests[8] +
+                                 "POST /rpc HTTP/1.1\r\ntransfer-encoding: Chunked\r\nConnection: close\r\n\r\n";
+        for(size_t i = 0; i < strlen(example_requests[9]); i += 40)
+        {
+            std::string part = std::string(example_requests[9]).substr(i, 40);
+            char chunk_size[16];
+            snprintf(chunk_size, sizeof(chunk_size), "%x;ext=1\r\n", (int)part.size());
+            http_input += chunk_size + part + "\r\n";
+        }
+        http_input += "0\r\nTrailer: none\r\n\r\n";
+        std::string http_copy = http_input;
+        json_rpc_http_request_t http_request;
+        int first_len = strstr(http_input.c_str(), "POST /rpc HTTP/1.1\r\ntransfer") - http_input.c_str();
+        TEST_COND_(json_rpc_http_parse(&http_copy[0], 20, &http_request) == 0 && http_request.header_len == 0);
+        TEST_COND_(json_rpc_http_parse(&http_copy[0], first_len - 1, &http_request) == 0 &&
+                   http_request.header_len > 0 && http_request.body_len == (int)strlen(example_requests[8]));
+        TEST_COND_(json_rpc_http_parse(&http_copy[0], http_copy.size(), &http_request) == first_len);
+        TEST_COND_(std::string(http_request.body, http_request.body_len) == example_requests[8] && http_request.keep_alive);
+        TEST_COND_(std::string(http_request.target, http_request.target_len) == "/rpc" && http_request.minor_version == 1);
+
+        char http_output[512];
+        const char* http_response = 0;
+        int http_response_len = json_rpc_http_handle(&rpc, &http_request, http_output, sizeof(http_output), 0, &http_response);
+        std::string http_str(http_response, http_response_len);
+        std::string http_body = http_str.substr(http_str.find("\r\n\r\n") + 4);
+        TEST_COND_(http_str.find("HTTP/1.1 200 OK\r\n") == 0 && extract_int_param("id", http_body) == 38);
+        TEST_COND_(http_str.find("Content-Length: " + std::to_string(http_body.size()) + "\r\n") != std::string::npos);
+
+        TEST_COND_(json_rpc_http_parse(&http_copy[first_len], http_copy.size() - first_len - 1, &http_request) == 0);
+        TEST_COND_(json_rpc_http_parse(&http_copy[first_len], http_copy.size() - first_len, &http_request) ==
+                   (int)http_copy.size() - first_len);
+        TEST_COND_(std::string(http_request.body, http_request.body_len) == example_requests[9] && !http_request.keep_alive);
+
+        char bad_requests[][96] = {"GET / HTTP/2.0\r\n\r\n", "POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n",
+                                   "POST / HTTP/1.1\r\nContent-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n",
+                                   "POST / HTTP/1.1\r\nContent-Length : 5\r\n\r\n"};
+        TEST_COND_(json_rpc_http_parse(bad_requests[0], strlen(bad_requests[0]), &http_request) == -505);
+        TEST_COND_(json_rpc_http_parse(bad_requests[1], strlen(bad_requests[1]), &http_request) == -501);
+        TEST_COND_(json_rpc_http_parse(bad_requests[2], strlen(bad_requests[2]), &http_request) == -400);
+        TEST_COND_(json_rpc_http_parse(bad_requests[3], strlen(bad_requests[3]), &http_request) == -400);
+        char chunked_requests[][96] = {"POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nFFFFFFFF\r\n0\r\n\r\n",
+                                       "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n40000000\r\n0\r\n\r\n",
+                                       "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n10000000000000005\r\n",
+                                       "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0000000005\r\nhello\r\n0\r\n\r\n"};
+        TEST_COND_(json_rpc_http_parse(chunked_requests[0], strlen(chunked_requests[0]), &http_request) == -413);
+        TEST_COND_(json_rpc_http_parse(chunked_requests[1], strlen(chunked_requests[1]), &http_request) == -413);
+        TEST_COND_(json_rpc_http_parse(chunked_requests[2], strlen(chunked_requests[2]), &http_request) == -413);
+        TEST_COND_(json_rpc_http_parse(chunked_requests[3], strlen(chunked_requests[3]), &http_request) ==
+                   (int)strlen(chunked_requests[3]) && http_request.body_len == 5);
+        char get_request[] = "GET / HTTP/1.0\r\nConnection: keep-alive\r\n\r\n";
+        TEST_COND_(json_rpc_http_parse(get_request, strlen(get_request), &http_request) == (int)strlen(get_request));
+        http_response_len = json_rpc_http_handle(&rpc, &http_request, http_output, sizeof(http_output), 0, &http_response);
+        TEST_COND_(std::string(http_response, http_response_len) ==
+                   "HTTP/1.1 405 Method Not Allowed\r\nAllow: POST\r\nContent-Length: 0\r\nConnection: keep-alive\r\n\r\n");
+
+        // HTTP connection: pipelined requests (sent at once) are answered in order (with one write), then it's closed
+        int http_fds[2];
+        TEST_COND_(socketpair(AF_UNIX, SOCK_STREAM, 0, http_fds) == 0);
+        char http_conn_input[1024];
+        json_rpc_http_conn_t http_conn;
+        json_rpc_http_conn_init(&http_conn, http_fds[0], &rpc, http_conn_input, sizeof(http_conn_input),
+                                http_output, sizeof(http_output), 0);
+        std::thread http_server([&]() { json_rpc_http_conn_serve(&http_conn); close(http_fds[0]); });
+        TEST_COND_(write(http_fds[1], http_input.data(), http_input.size()) == (ssize_t)http_input.size());
+        std::string http_received;
+        char http_read_buffer[256];
+        for(ssize_t n; (n = read(http_fds[1], http_read_buffer, sizeof(http_read_buffer))) > 0;)
+        {
+            http_received.append(http_read_buffer, n);
+        }
+        http_server.join();
+        close(http_fds[1]);
+        size_t second_response = http_received.find("HTTP/1.1 200 OK\r\n", 1);
+        TEST_COND_(http_conn.requests == 2 && http_conn.writes == 1 && second_response != std::string::npos);
+        TEST_COND_(extract_int_param("id", http_received.substr(http_received.find("\r\n\r\n") + 4)) == 38);
+        TEST_COND_(extract_int_param("id", http_received.substr(http_received.find("\r\n\r\n", second_response) + 4)) == 39);
+        TEST_COND_(http_received.find("Connection: close\r\n", second_response) != std::string::npos);
+
+        // HTTP keep-alive: a smaller request after a larger one that was handled is parsed as well
+        TEST_COND_(socketpair(AF_UNIX, SOCK_STREAM, 0, http_fds) == 0);
+        json_rpc_http_conn_init(&http_conn, http_fds[0], &rpc, http_conn_input, sizeof(http_conn_input),
+                                http_output, sizeof(http_output), 0);
+        std::thread keep_alive_server([&]() { json_rpc_http_conn_serve(&http_conn); close(http_fds[0]); });
+        std::string large_request = std::string("POST /rpc HTTP/1.1\r\nExpect: 100-continue\r\nX-Padding: ") +
+                                    std::string(200, 'x') + "\r\nContent-Length: " +
+                                    std::to_string(strlen(example_requests[8])) + "\r\n\r\n" + example_requests[8];
+        std::string small_request = std::string("POST /rpc HTTP/1.1\r\nContent-Length: ") +
+                                    std::to_string(strlen(example_requests[9])) + "\r\n\r\n" + example_requests[9];
+        http_received.clear();
+        TEST_COND_(write(http_fds[1], large_request.data(), large_request.size()) == (ssize_t)large_request.size());
+        for(ssize_t n; http_received.find('}') == std::string::npos;) // (until the first response is received)
+        {
+            if((n = read(http_fds[1], http_read_buffer, sizeof(http_read_buffer))) <= 0)
+            {
+                break;
+            }
+            http_received.append(http_read_buffer, n);
+        }
+        TEST_COND_(write(http_fds[1], small_request.data(), small_request.size()) == (ssize_t)small_request.size());
+        shutdown(http_fds[1], SHUT_WR); // (connection is closed if the request isn't parsed)
+        for(ssize_t n; (n = read(http_fds[1], http_read_buffer, sizeof(http_read_buffer))) > 0;)
+        {
+            http_received.append(http_read_buffer, n);
+        }
+        keep_alive_server.join();
+        close(http_fds[1]);
+        second_response = http_received.find("HTTP/1.1 200 OK\r\n", 1);
+        TEST_COND_(http_conn.requests == 2 && second_response != std::string::npos);
+        TEST_COND_(extract_int_param("id", http_received.substr(http_received.find("\r\n\r\n", second_response) + 4)) == 39);
+        TEST_COND_(http_received.find("100 Continue") == std::string::npos); // (whole request was received at once)
+
+        // client: concurrent calls are sent in batches, and responses are passed back by id
+        struct client_transport { json_rpc_instance_t* rpc; int batches; } transport = {&rpc, 0};
+        char client_requests[2048];
+        char client_responses[2048];
+        json_rpc_client_t client;
+        json_rpc_client_init(&client, [](const char* request, int request_len, char* response, int response_len, void* arg)
+                             {
+                                 json_rpc_data_t data = {request, response, request_len, response_len, 0};
+                                 ((client_transport*)arg)->batches++;
+                                 json_rpc_handle_request(((client_transport*)arg)->rpc, &data);
+                                 return json_rpc_response_len(&data);
+                             }, &transport, client_requests, sizeof(client_requests), client_responses, sizeof(client_responses));
+        client.window_us = 2000;
+        client.max_calls = 4;
+        int client_errors = 0;
+        std::thread callers[4];
+        for(int t = 0; t < 4; t++)
+        {
+            callers[t] = std::thread([&client, &client_errors, t]()
+            {
+                for(int i = 0; i < 10; i++)
+                {
+                    char params[64];
+                    char response[128];
+                    snprintf(params, sizeof(params), "[{\"first\": %d, \"second\": 1, \"op\": \"+\"}]", t * 100 + i);
+                    if(json_rpc_client_call(&client, "calculate", params, response, sizeof(response)) <= 0 ||
+                       extract_int_param("res", extract_str_param("result", response)) != t * 100 + i + 1)
+                    {
+                        __atomic_add_fetch(&client_errors, 1, __ATOMIC_RELAXED);
+                    }
+                }
+            });
+        }
+        for(auto& caller : callers)
+        {
+            caller.join();
+        }
+        TEST_COND_(client_errors == 0 && client.calls == 40 && client.batches_sent == (uint64_t)transport.batches);
+        TEST_COND_(transport.batches < 40);
+        char client_response[128];
+        TEST_COND_(json_rpc_client_call(&client, "no_such_method", 0, client_response, sizeof(client_response)) > 0);
+        TEST_COND_(extract_int_param("code", extract_str_param("error", client_response)) == -32601);
+        TEST_COND_(json_rpc_client_call(&client, "calculate", std::string(1024, ' ').c_str(), client_response, 128) == -1);
+        TEST_COND_(json_rpc_client_call(&client, "calculate", "[{\"first\": 1, \"second\": 1, \"op\": \"+\"}]",
+                                        client_response, 16) == -1); // (response doesn't fit)
+        json_rpc_client_destroy(&client);
+
+        // (responses are matched by their own id, not by an id within the result)
+        json_rpc_client_init(&client, [](const char*, int, char* response, int, void*)
+                             {
+                                 const char* canned = "[{\"jsonrpc\": \"2.0\", \"result\": {\"id\": 7}, \"id\": 1}]";
+                                 strcpy(response, canned);
+                                 return (int)strlen(canned);
+                             }, 0, client_requests, sizeof(client_requests), client_responses, sizeof(client_responses));
+        client.window_us = 0;
+        TEST_COND_(json_rpc_client_call(&client, "get_user", 0, client_response, sizeof(client_response)) > 0);
+        TEST_COND_(extract_int_param("id", extract_str_param("result", client_response)) == 7);
+        json_rpc_client_destroy(&client);
+
+        // capture: requests are recorded with timestamps (and flushed, without the lock, when half is full)
+        json_rpc_capture_t capture;
+        struct capture_sink { std::string data; int flushes; int locked; json_rpc_capture_t* capture; } sink =
+            {"", 0, 0, &capture};
+        char capture_buffer[400];
+        json_rpc_capture_init(&capture, capture_buffer, sizeof(capture_buffer), manual_clock, 1000,
+                              [](const char* data, int len, void* arg)
+                              {
+                                  ((capture_sink*)arg)->data.append(data, len);
+                                  ((capture_sink*)arg)->flushes++;
+                                  ((capture_sink*)arg)->locked += ((capture_sink*)arg)->capture->lock != 0;
+                              }, &sink);
+        json_rpc_enable_capture(&rpc, &capture);
+        manual_time = 5;
+        handle_request_for_example(8, req_data, rpc);
+        manual_time = 7;
+        handle_request_for_example(2, req_data, rpc);
+        TEST_COND_(sink.flushes == 1 && capture.dropped == 0); // (second request didn't fit)
+        char packed_request[256];
+        req_data.request = packed_request;
+        req_data.request_len = json_to_msgpack(example_requests[2], strlen(example_requests[2]),
+                                               packed_request, sizeof(packed_request));
+        json_rpc_handle_request(&rpc, &req_data); // (MessagePack request is recorded once, as received)
+        json_rpc_capture_flush(&capture);
+        json_rpc_enable_capture(&rpc, 0);
+        TEST_COND_(sink.flushes == 2 && sink.locked == 0);
+
+        uint64_t ticks_per_second = 0;
+        uint64_t timestamp = 0;
+        const char* captured = 0;
+        int captured_len = 0;
+        int64_t capture_pos = json_rpc_capture_open(sink.data.data(), sink.data.size(), &ticks_per_second);
+        TEST_COND_(capture_pos == JSON_RPC_CAPTURE_HEADER_LEN && ticks_per_second == 1000);
+        capture_pos = json_rpc_capture_next(sink.data.data(), sink.data.size(), capture_pos,
+                                            &timestamp, &captured, &captured_len);
+        TEST_COND_(timestamp == 5 && std::string(captured, captured_len) == example_requests[8]);
+        capture_pos = json_rpc_capture_next(sink.data.data(), sink.data.size(), capture_pos,
+                                            &timestamp, &captured, &captured_len);
+        TEST_COND_(timestamp == 7 && std::string(captured, captured_len) == example_requests[2]);
+        capture_pos = json_rpc_capture_next(sink.data.data(), sink.data.size(), capture_pos,
+                                            &timestamp, &captured, &captured_len);
+        TEST_COND_(timestamp == 7 && std::string(captured, captured_len) == std::string(packed_request,
+                                                                                        req_data.request_len));
+        TEST_COND_(capture_pos == (int64_t)sink.data.size());
+        TEST_COND_(json_rpc_capture_next(sink.data.data(), sink.data.size(), capture_pos,
+                                         &timestamp, &captured, &captured_len) == -1);
+        TEST_COND_(json_rpc_capture_next(sink.data.data(), sink.data.size() - 1, JSON_RPC_CAPTURE_HEADER_LEN,
+                                         &timestamp, &captured, &captured_len) > 0); // (first record is complete)
+
+        json_rpc_capture_init(&capture, capture_buffer, 64, manual_clock, 1000, 0, 0); // (without flush function)
+        json_rpc_enable_capture(&rpc, &capture);
+        handle_request_for_example(8, req_data, rpc);
+        json_rpc_enable_capture(&rpc, 0);
+        TEST_COND_(capture.dropped == 1 && capture.used == JSON_RPC_CAPTURE_HEADER_LEN);
+
+        // response cache: results of cacheable methods are reused for equal params (with own id)
+        json_rpc_handler_t cached_handlers[1];
+        json_rpc_instance_t cached_rpc;
+        json_rpc_cache_t cache;
+        static json_rpc_cache_entry_t cache_entries[8];
+        json_rpc_init(&cached_rpc, cached_handlers, 1);
+        json_rpc_register_handler(&cached_rpc, "calculate", counted_calculate, json_rpc_handler_cacheable);
+        json_rpc_cache_init(&cache, cache_entries, 8);
+        json_rpc_enable_cache(&cached_rpc, &cache);
+        handle_request_for_example(8, req_data, cached_rpc);
+        res_str = handle_request_for_example(10, req_data, cached_rpc); // (same params, "id": 40)
+        TEST_COND_(calculate_calls == 1);
+        TEST_COND_(extract_int_param("res", res_str) == 160 && extract_int_param("id", res_str) == 40);
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"calculate\", "
+                           "\"params\": [ {\"first\":128,\"second\": 32, \"op\":\"+\"} ], \"id\": 7}";
+        req_data.request_len = strlen(req_data.request);
+        res_str = json_rpc_handle_request(&cached_rpc, &req_data); // (whitespace doesn't matter)
+        TEST_COND_(calculate_calls == 1 && extract_int_param("id", res_str) == 7);
+        handle_request_for_example(9, req_data, cached_rpc);
+        TEST_COND_(calculate_calls == 2);
+        json_rpc_cache_clear(&cache);
+        handle_request_for_example(8, req_data, cached_rpc);
+        TEST_COND_(calculate_calls == 3);
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"calculate\", \"params\": [{\"first\": 1}], \"id\": 8}";
+        req_data.request_len = strlen(req_data.request);
+        json_rpc_handle_request(&cached_rpc, &req_data);
+        res_str = json_rpc_handle_request(&cached_rpc, &req_data); // errors are not cached (entry is released)
+        TEST_COND_(calculate_calls == 5 && extract_int_param("code", extract_str_param("error", res_str)) == -32602);
+
+        // identical calls from many threads are coalesced (others wait for the first one)
+        json_rpc_handler_t slow_handlers[4][1];
+        json_rpc_instance_t slow_rpc[4];
+        std::thread slow_callers[4];
+        std::string slow_results[4];
+        json_rpc_cache_init(&cache, cache_entries, 8);
+        json_rpc_cache_set_timeout(&cache, manual_clock, 1000); // (manual clock: never stale while waited for)
+        for(int t = 0; t < 4; t++)
+        {
+            json_rpc_init(&slow_rpc[t], slow_handlers[t], 1);
+            json_rpc_register_handler(&slow_rpc[t], "calculate", slow_calculate, json_rpc_handler_cacheable);
+            json_rpc_enable_cache(&slow_rpc[t], &cache);
+            slow_callers[t] = std::thread([&slow_rpc, &slow_results, t]()
+            {
+                char response[256];
+                json_rpc_data_t data = {example_requests[8], response, (int)strlen(example_requests[8]),
+                                        (int)sizeof(response), 0};
+                slow_results[t] = json_rpc_handle_request(&slow_rpc[t], &data);
+            });
+        }
+        for(int t = 0; t < 4; t++)
+        {
+            slow_callers[t].join();
+            TEST_COND_(extract_int_param("res", slow_results[t]) == 160);
+        }
+        TEST_COND_(slow_calculate_calls == 1);
+
+        // pending result of a handler that threw is stale after the timeout: next call takes it over
+        slow_calculate_throws = true;
+        req_data.request = "{\"jsonrpc\": \"2.0\", \"method\": \"calculate\", "
+                           "\"params\": [{\"first\": 2, \"second\": 3, \"op\": \"*\"}], \"id\": 9}";
+        req_data.request_len = strlen(req_data.request);
+        bool handler_threw = false;
+        try
+        {
+            json_rpc_handle_request(&slow_rpc[0], &req_data);
+        }
+        catch(const std::runtime_error&)
+        {
+            handler_threw = true;
+        }
+        TEST_COND_(handler_threw && slow_calculate_calls == 2);
+        manual_time += 1000;
+        res_str = json_rpc_handle_request(&slow_rpc[1], &req_data);
+        TEST_COND_(slow_calculate_calls == 3 && extract_int_param("res", res_str) == 6);
+        res_str = json_rpc_handle_request(&slow_rpc[2], &req_data); // (result of the new owner is cached)
+        TEST_COND_(slow_calculate_calls == 3 && extract_int_param("res", res_str) == 6);
+
+        // without a clock, pending result is stale once an identical call waited for it in vain
+        json_rpc_cache_set_timeout(&cache, 0, 0);
+        json_rpc_cache_clear(&cache);
+        slow_calculate_throws = true;
+        handler_threw = false;
+        try
+        {
+            json_rpc_handle_request(&slow_rpc[0], &req_data);
+        }
+        catch(const std::runtime_error&)
+        {
+            handler_threw = true;
+        }
+        res_str = json_rpc_handle_request(&slow_rpc[1], &req_data);
+        TEST_COND_(handler_threw && slow_calculate_calls == 5 && extract_int_param("res", res_str) == 6);
+        res_str = json_rpc_handle_request(&slow_rpc[2], &req_data);
+        TEST_COND_(slow_calculate_calls == 5);
+
+#ifdef JSON_RPC_TINY_TRACE
+        // trace (in Chrome trace event format)
+        json_rpc_trace_t trace;
+        json_rpc_trace_event_t events[16];
+        char trace_json[4096];
+        json_rpc_enable_trace(&rpc, &trace, events, 16);
+        handle_request_for_example(8, req_data, rpc);
+        json_writer_init(&writer, trace_json, sizeof(trace_json));
+        json_writer_begin_array(&writer);
+        json_rpc_trace_export(&rpc, &writer, 1000.0, 1);
+        json_writer_end_array(&writer);
+        json_rpc_enable_trace(&rpc, 0, 0, 0);
+        TEST_COND_(!writer.overflow && json_validate(trace_json, strlen(trace_json)));
+        TEST_COND_(extract_str_param("name", extract_str_param(3, trace_json)) == "calculate"); // handler start
+#endif
+
         std::cout << "\n===== ALL TESTS PASSED =====\n\n";
     }
     catch(const std::exception& e)
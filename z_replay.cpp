@@ -0,0 +1,328 @@
+/*
+ * z_replay.cpp
+ *
+ * This file contains a load tool that replays a capture of requests (see json_rpc_capture_init())
+ * against an instance of json_rpc_tiny, deterministically (in the order and at the times they were recorded):
+ *
+ *   z_replay [--rate recorded|max|<scale>] [--json] <capture file>
+ *
+ * With --rate recorded (the default) requests are sent at recorded times, <scale> (e.g. 2.5) scales
+ * the rate (so gaps between requests are divided by it), and max sends them one after another.
+ * Scheduling is open-loop: a request that is due is sent even if the previous one took longer than expected,
+ * and its latency is measured from the time it was due (not from when it was actually sent),
+ * so that the time a request would have waited is not omitted (coordinated omission).
+ * Both that latency and the service time (of the handler only) are reported as percentiles.
+ *
+ * A capture for testing can be recorded from a log of requests (one per line) with:
+ *
+ *   z_replay --record <requests.ndjson> <capture file> [requests per second]
+ *
+ * Handlers are the same as in z_benchmark.cpp (other methods are answered with errors), register
+ * own handlers to replay captures of real traffic.
+ */
+
+#include "json_rpc_tiny.h"
+#include "json_rpc_tiny_typed.h"
+#include "json_rpc_tiny_log.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <string>
+
+
+// ======== handlers ==========
+
+char* add(rpc_request_info_t* info)
+{
+    int a = 0;
+    int b = 0;
+    if(rpc_extract_param_int(0, &a, info) && rpc_extract_param_int(1, &b, info))
+    {
+        char* res = json_rpc_result_begin(info);
+        if(res)
+        {
+            res = json_format_int(res, a + b);
+        }
+        return json_rpc_result_end(res, info);
+    }
+    return json_rpc_create_error(json_rpc_err_invalid_params, info);
+}
+
+char* search(rpc_request_info_t* info)
+{
+    int age = 0;
+    int len = 0;
+    const char* last_name = rpc_extract_param_str("last_name", &len, info);
+    if(last_name && rpc_extract_param_int("age", &age, info))
+    {
+        return json_rpc_create_result("\"Monty\"", info);
+    }
+    return json_rpc_create_error(json_rpc_err_invalid_params, info);
+}
+
+static const char* const typed_search_names[] = {"last_name", "age"};
+std::string_view typed_search(std::string_view last_name, int age)
+{
+    return (last_name.size() && age) ? "Monty" : "";
+}
+
+char* nop(rpc_request_info_t* info)
+{
+    return json_rpc_create_result("0", info);
+}
+
+
+// ======== clock ==========
+
+typedef std::chrono::steady_clock steady_clock;
+
+static uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// clock used while recording (advanced by the interval between requests)
+static uint64_t record_time = 0;
+static uint64_t record_clock()
+{
+    return record_time;
+}
+
+
+// ======== recording ==========
+
+#define MAX_NUM_OF_HANDLERS 8
+json_rpc_handler_t storage_for_handlers[MAX_NUM_OF_HANDLERS];
+char response_buffer[64 * 1024];
+
+struct record_state
+{
+    json_rpc_instance_t* rpc;
+    json_rpc_data_t data;
+    uint64_t interval;
+};
+
+static void write_capture(const char* data, int len, void* arg)
+{
+    fwrite(data, 1, len, (FILE*)arg);
+}
+
+static void record_line(const char* line, int line_len, void* arg)
+{
+    record_state* state = (record_state*)arg;
+    state->data.request = line;
+    state->data.request_len = line_len;
+    json_rpc_handle_request(state->rpc, &state->data);
+    record_time += state->interval;
+}
+
+int record(json_rpc_instance_t* rpc, const char* log_path, const char* capture_path, double requests_per_second)
+{
+    json_rpc_log_t log;
+    if(!json_rpc_log_open(&log, log_path))
+    {
+        printf("can't open: %s\n", log_path);
+        return 1;
+    }
+    FILE* out = fopen(capture_path, "wb");
+    if(!out)
+    {
+        printf("can't create: %s\n", capture_path);
+        json_rpc_log_close(&log);
+        return 1;
+    }
+
+    static char capture_buffer[1024 * 1024];
+    json_rpc_capture_t capture;
+    json_rpc_capture_init(&capture, capture_buffer, sizeof(capture_buffer), record_clock, 1000000000,
+                          write_capture, out);
+    json_rpc_enable_capture(rpc, &capture);
+
+    record_state state;
+    state.rpc = rpc;
+    state.data.response = response_buffer;
+    state.data.response_len = sizeof(response_buffer);
+    state.data.arg = NULL;
+    state.interval = (uint64_t)(1e9 / requests_per_second);
+
+    json_rpc_log_chunk_t chunk;
+    json_rpc_log_split(&log, &chunk, 1);
+    uint64_t lines = json_rpc_log_for_each_line(&chunk, record_line, &state);
+
+    json_rpc_capture_flush(&capture);
+    json_rpc_enable_capture(rpc, NULL);
+    fclose(out);
+    json_rpc_log_close(&log);
+    printf("recorded %llu requests (%llu dropped) into: %s\n", (unsigned long long)lines,
+           (unsigned long long)capture.dropped, capture_path);
+    return 0;
+}
+
+
+// ======== replay ==========
+
+static void print_percentiles(const char* name, const json_rpc_method_stats_t* histogram, bool json_output)
+{
+    static const int per_mille[] = {500, 900, 990, 999, 1000};
+    static const char* const labels[] = {"p50", "p90", "p99", "p99.9", "max"};
+    if(json_output)
+    {
+        char line[256];
+        json_writer_t w;
+        json_writer_init(&w, line, sizeof(line));
+        json_writer_begin_object(&w);
+        json_writer_key(&w, "name");
+        json_writer_value_str(&w, name, strlen(name));
+        for(int i = 0; i < 5; i++)
+        {
+            json_writer_key(&w, labels[i]);
+            json_writer_value_double(&w, json_rpc_stats_percentile(histogram, per_mille[i]) / 1000.0);
+        }
+        json_writer_end_object(&w);
+        printf("%s\n", line);
+        return;
+    }
+    printf("%-18s", name);
+    for(int i = 0; i < 5; i++)
+    {
+        printf(" %s: %10.1f us", labels[i], json_rpc_stats_percentile(histogram, per_mille[i]) / 1000.0);
+    }
+    printf("\n");
+}
+
+int replay(json_rpc_instance_t* rpc, const char* capture_path, double scale, bool json_output)
+{
+    json_rpc_log_t log; // (any file can be mapped)
+    if(!json_rpc_log_open(&log, capture_path))
+    {
+        printf("can't open: %s\n", capture_path);
+        return 1;
+    }
+    uint64_t ticks_per_second = 0;
+    int64_t pos = json_rpc_capture_open(log.data, log.len, &ticks_per_second);
+    if(pos < 0 || !ticks_per_second)
+    {
+        printf("not a capture: %s\n", capture_path);
+        json_rpc_log_close(&log);
+        return 1;
+    }
+
+    json_rpc_data_t data;
+    data.response = response_buffer;
+    data.response_len = sizeof(response_buffer);
+    data.arg = NULL;
+
+    // histograms (in ns) of latency (from the time the request was due) and of service time
+    static json_rpc_method_stats_t latency;
+    static json_rpc_method_stats_t service_time;
+    uint64_t requests = 0;
+    uint64_t late = 0;
+    uint64_t first_timestamp = 0;
+    uint64_t timestamp = 0;
+    const char* request = NULL;
+    int request_len = 0;
+    double ns_per_tick = 1e9 / ticks_per_second / scale; // (scale is 0 for max rate)
+
+    uint64_t start = now_ns();
+    while((pos = json_rpc_capture_next(log.data, log.len, pos, &timestamp, &request, &request_len)) > 0)
+    {
+        if(!requests)
+        {
+            first_timestamp = timestamp;
+        }
+        uint64_t due = start;
+        uint64_t sent = now_ns();
+        if(scale > 0)
+        {
+            due = start + (uint64_t)((timestamp > first_timestamp ? timestamp - first_timestamp : 0) * ns_per_tick);
+            if(sent < due)
+            {
+                if(due - sent > 200000) // (sleep when it's long enough, spin for the rest)
+                {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(due - sent - 100000));
+                }
+                while((sent = now_ns()) < due)
+                {
+                }
+            }
+            else
+            {
+                late++;
+            }
+        }
+        else
+        {
+            due = sent; // (at max rate requests are due when the previous one is done)
+        }
+
+        data.request = request;
+        data.request_len = request_len;
+        json_rpc_handle_request(rpc, &data);
+        uint64_t done = now_ns();
+
+        latency.latency[json_rpc_latency_bucket(done - due)]++;
+        service_time.latency[json_rpc_latency_bucket(done - sent)]++;
+        requests++;
+    }
+    double elapsed_s = (now_ns() - start) / 1e9;
+    json_rpc_log_close(&log);
+
+    if(json_output)
+    {
+        printf("{\"requests\": %llu, \"late\": %llu, \"seconds\": %.3f, \"requests_per_s\": %.1f}\n",
+               (unsigned long long)requests, (unsigned long long)late, elapsed_s, requests / elapsed_s);
+    }
+    else
+    {
+        printf("replayed %llu requests in %.3f s (%.1f requests/s), %llu sent late\n", (unsigned long long)requests,
+               elapsed_s, requests / elapsed_s, (unsigned long long)late);
+    }
+    print_percentiles("latency", &latency, json_output);
+    print_percentiles("service_time", &service_time, json_output);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    json_rpc_instance_t rpc;
+    json_rpc_init(&rpc, storage_for_handlers, MAX_NUM_OF_HANDLERS);
+    json_rpc_register_handler(&rpc, "add", add);
+    json_rpc_register_handler(&rpc, "search", search);
+    json_rpc_register_handler(&rpc, "nop", nop);
+    json_rpc_register_typed<typed_search, typed_search_names>(&rpc, "typed_search");
+
+    double scale = 1.0;
+    bool json_output = false;
+    const char* capture_path = NULL;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--record") == 0 && i + 2 < argc)
+        {
+            return record(&rpc, argv[i + 1], argv[i + 2], i + 3 < argc ? atof(argv[i + 3]) : 1000.0);
+        }
+        else if(strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+        {
+            i++;
+            scale = strcmp(argv[i], "max") == 0 ? 0 : strcmp(argv[i], "recorded") == 0 ? 1.0 : atof(argv[i]);
+        }
+        else if(strcmp(argv[i], "--json") == 0)
+        {
+            json_output = true;
+        }
+        else
+        {
+            capture_path = argv[i];
+        }
+    }
+
+    if(!capture_path || scale < 0)
+    {
+        printf("usage: %s [--rate recorded|max|<scale>] [--json] <capture file>\n"
+               "       %s --record <requests.ndjson> <capture file> [requests per second]\n", argv[0], argv[0]);
+        return 1;
+    }
+    return replay(&rpc, capture_path, scale, json_output);
+}